@@ -29,10 +29,14 @@
 #include <map>
 #include <string>
 #include <iostream>
+#include <sstream>
 #include <iomanip>
 #include <string.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <limits.h>
+#include <limits>
+#include <new>
 #include <memory>
 #include <vector>
 #include <algorithm>
@@ -61,6 +65,7 @@ typedef enum {
 
 typedef enum { C420, C422, C444 } EChromaType;
 typedef enum { D008, D010, D012, D016 } EBitDepth;
+typedef enum { FP32, FP16, BF16 } EFloatFormat;
 
 #ifdef NO_IPP
 typedef struct {
@@ -90,18 +95,49 @@ bool is_interlaced(ESequenceType st);
 bool is_rgb(ESequenceType st);
 EChromaType get_chromaclass(ESequenceType st);
 
+/* Number of worker threads, defaults to the number of available processors */
+void    mclSetNumThreads(int32_t num);
+int32_t mclGetNumThreads(void);
+
+/* Worker placement from the sysfs topology: workers are pinned round robin over NUMA nodes, physical cores
+   before SMT siblings. Buffers from mclMalloc* are then spread over the nodes by first touch.
+   Returns false when the topology is unknown, workers stay unpinned in that case */
+bool    mclSetAffinity(bool enable);
+int32_t mclGetNumNodes(void);
+void    mclFirstTouch(void* ptr, size_t size);
+
+/* Instruction set of the kernel layer, detected once with CPUID. Kernels are resolved for the active level
+   when they are requested, mclSetCpuLevel() can only lower it and returns false when asked for more */
+typedef enum { CPU_SCALAR, CPU_SSE42, CPU_AVX2, CPU_AVX512 } ECpuLevel;
+bool        mclSetCpuLevel(ECpuLevel level);
+ECpuLevel   mclGetCpuLevel(void);
+const char* mclGetCpuLevelName(ECpuLevel level);
+
 /* File operations with portability issues */
 uint64_t _file_fseek(FILE *fd, int64_t position, int32_t mode);
 uint64_t _file_ftell(FILE *fd);
 
-/* Memory allocation/deletion */
-uint8_t* mclMalloc(uint32_t size, EBitDepth bd);
+/* Memory allocation/deletion: 64 byte aligned blocks from a pool, float rows are padded to avoid 4K aliasing.
+   Freed blocks stay in the pool and are reused, huge pages and pre-faulting apply to new blocks */
+typedef enum { HP_NONE, HP_TRANSPARENT, HP_EXPLICIT } EHugePages;
+void     mclSetPoolOptions(EHugePages hp, bool prefault);
+void     mclGetPoolStats(uint64_t &requests, uint64_t &allocations, uint64_t &bytes);
+void*    mclPoolAlloc(size_t size);
+void     mclPoolFree(void* ptr);
+uint8_t* mclMalloc(size_t size, EBitDepth bd);
 float* mclMalloc_32f_C1(int32_t widthPixels, int32_t heightPixels, int32_t* pStepBytes);
-#ifdef NO_IPP
-#define mclFree(ptr) if (ptr) delete[] ptr; ptr = NULL;
-#else
-#define mclFree(ptr) ippsFree(ptr); ptr = NULL;
-#endif
+#define mclFree(ptr) do { mclPoolFree(ptr); (ptr) = NULL; } while (0)
+
+/* Memory in an unlinked temporary file in $TMPDIR (/tmp by default) for tables that may not fit in RAM, NULL where not supported */
+void*    mclMapTemp(size_t size);
+void     mclUnmapTemp(void* ptr, size_t size);
+
+/* Named POSIX shared memory, created empty and mapped for writing, NULL where not supported. Stores with release
+   order publish everything written before them to readers in other processes, the fence orders all memory accesses */
+void*    mclShmCreate(const char* name, size_t size);
+void     mclShmClose(void* ptr, size_t size);
+void     mclStoreRelease(volatile uint64_t* ptr, uint64_t value);
+void     mclFence(void);
 
 /* Packed to planar formats conversions */
 EErrorStatus mclYCbCr420ToYCrCb420_P2P3R(const uint8_t* pSrcY, int32_t srcYStep, const uint8_t* pSrcUV, int32_t srcUVStep, uint8_t* PDst[3], int32_t dstStep[3], ImageSize roiSize, EBitDepth bd);
@@ -112,10 +148,67 @@ EErrorStatus mclNV16ToYCbCr422_P2P3R(const uint8_t *pSrcY, int32_t srcYStep, con
 EErrorStatus mclCopy_C4P4R(const uint8_t* pSrc, int32_t srcStep, uint8_t* const pDst[4], int32_t dstStep, ImageSize roiSize, EBitDepth bd);
 
 EErrorStatus mclRShiftC_C1IR(uint32_t value, uint8_t* pSrcDst, int32_t srcDstStep, ImageSize roiSize, EBitDepth bd);
+/* Shifted copy, a plain copy for a zero shift */
+EErrorStatus mclRShiftC_C1R(uint32_t value, const uint8_t* pSrc, int32_t srcStep, uint8_t* pDst, int32_t dstStep, ImageSize roiSize, EBitDepth bd);
+
+/* Kernels resolved once per stream: instances are specialised for the sample type and the filter tap count,
+   so inner loops have fixed element sizes and trip counts. The mcl* entry points below give the same results */
+typedef struct {
+    EErrorStatus (*normDiff_L2)(const uint8_t* pSrc1, int32_t src1Step, const uint8_t* pSrc2, int32_t src2Step, ImageSize roiSize, double& value);
+    EErrorStatus (*convert_32f)(const uint8_t* pSrc, int32_t srcStep, float* pDst, int32_t dstStep, ImageSize roiSize);
+} SPixelKernels;
+
+typedef EErrorStatus (*mclFilterFunc)(const float* pSrc, int32_t srcStep, float* pDst, int32_t dstStep, ImageSize dstRoiSize, const float* pKernel, int32_t kernelSize);
+typedef struct {
+    mclFilterFunc row, column;
+    int32_t       size;
+} SFilterKernels;
+
+EErrorStatus mclGetPixelKernels(EBitDepth bd, SPixelKernels &kernels);
+EErrorStatus mclGetFilterKernels(int32_t kernelSize, SFilterKernels &kernels);
+
+/* Byte equality of two planes, rows are compared with memcmp which stops at the first difference */
+bool mclIsEqual_C1R(const uint8_t* pSrc1, int32_t src1Step, const uint8_t* pSrc2, int32_t src2Step, ImageSize roiSize, EBitDepth bd);
+
+/* 64 bit hash of a plane for content keyed caches, planes are chained through the seed */
+uint64_t mclHash_C1R(const uint8_t* pSrc, int32_t srcStep, ImageSize roiSize, EBitDepth bd, uint64_t seed);
+
+/* Squared error of block x block means of two planes, a cheap stand-in for the MSE of the plane downsampled that
+   much. Partial blocks at the right and bottom edges are left out */
+EErrorStatus mclBlockMeanMSE_C1R(const uint8_t* pSrc1, int32_t src1Step, const uint8_t* pSrc2, int32_t src2Step, ImageSize roiSize, int32_t block, double& value, EBitDepth bd);
+
+/* Box averaged float thumbnail of a plane, each destination pixel covers its share of the source rows and columns */
+EErrorStatus mclThumbnail__u32f_C1R(const uint8_t* pSrc, int32_t srcStep, ImageSize roiSize, float* pDst, ImageSize dstSize, EBitDepth bd);
+
+/* Translation between two planes by phase correlation on a centred 2^order square. Normalised cross power spectra
+   of several plane pairs are summed into pAcc (2 * 4^order doubles), the peak of the average correlation surface
+   gives the shift of the 2nd plane against the 1st one with sub-pixel refinement and the peak height (1 for a pure
+   translation) */
+EErrorStatus mclCrossPower_C1R(const uint8_t* pSrc1, int32_t src1Step, const uint8_t* pSrc2, int32_t src2Step, ImageSize roiSize, int32_t order, double* pAcc, EBitDepth bd);
+EErrorStatus mclPhaseCorrelationPeak(const double* pAcc, int32_t order, int32_t count, double& dx, double& dy, double& peak);
+
+/* Separable resize of a plane with bilinear, bicubic (Catmull-Rom) or Lanczos3 filters, the filters are widened
+   for downscaling. The spec holds the taps of both axes for one size pair, output rows are produced in bands
+   by all worker threads, each with its part of the buffer */
+typedef enum { RS_BILINEAR, RS_BICUBIC, RS_LANCZOS } EResizeFilter;
+typedef struct {
+    ImageSize              srcSize, dstSize;
+    int32_t                xTaps, yTaps;
+    std::vector< int32_t > xFirst, yFirst;     // First source sample of each output column and row
+    std::vector< float >   xWeights, yWeights;
+    int32_t                bandRows;           // Source rows of the largest band
+} SResizeSpec;
+EErrorStatus mclResizeInit(ImageSize srcSize, ImageSize dstSize, EResizeFilter filter, SResizeSpec &spec);
+EErrorStatus mclResizeGetBufferSize(const SResizeSpec &spec, int32_t* pBufferSize);
+EErrorStatus mclResize_C1R(const uint8_t* pSrc, int32_t srcStep, uint8_t* pDst, int32_t dstStep, const SResizeSpec &spec, uint8_t* pBuffer, EBitDepth bd);
 
 /* PSNR */
 EErrorStatus mclNormDiff_L2_C1R(const uint8_t* pSrc1, int32_t src1Step, const uint8_t* pSrc2, int32_t src2Step, ImageSize roiSize, double& pValue, EBitDepth bd);
 
+/* Temporal: squared change of pSrc1 - pSrc2 since the previous call, the difference is kept in pPrev (roiSize
+   samples, dense). With reset the difference is only stored. Sums of both planes come along for mean based measures */
+EErrorStatus mclTemporalDiff_C1R(const uint8_t* pSrc1, int32_t src1Step, const uint8_t* pSrc2, int32_t src2Step, int32_t* pPrev, ImageSize roiSize, bool reset, double& sse, double& sum1, double& sum2, EBitDepth bd);
+
 /* SSIM */
 EErrorStatus mclConvert__u32f_C1R(const uint8_t* pSrc, int32_t srcStep, float* pDst, int32_t dstStep, ImageSize roiSize, EBitDepth bd);
 EErrorStatus mclSqr_32f_C1R(const float* pSrc, int32_t srcStep, float* pDst, int32_t dstStep, ImageSize roiSize);
@@ -124,4 +217,15 @@ EErrorStatus mclMean_32f_C1R(const float* pSrc, int32_t srcStep, ImageSize roiSi
 EErrorStatus mclFilterRow_32f_C1R(const float* pSrc, int32_t srcStep, float* pDst, int32_t dstStep, ImageSize dstRoiSize, const float* pKernel, int32_t kernelSize, int32_t xAnchor);
 EErrorStatus mclFilterColumn_32f_C1R(const float* pSrc, int32_t srcStep, float* pDst, int32_t dstStep, ImageSize dstRoiSize, const float* pKernel, int32_t kernelSize, int32_t xAnchor);
 
+/* Block SSIM: 8x8 windows on a 4 pixel grid built from 4x4 block sums (x264 and libvpx style) */
+EErrorStatus mclSSIM4x4GetBufferSize(int32_t width, int32_t* pBufferSize);
+EErrorStatus mclSSIMFast_C1R(const uint8_t* pSrc1, int32_t src1Step, const uint8_t* pSrc2, int32_t src2Step, ImageSize roiSize, double& value, uint8_t* pBuffer, EBitDepth bd);
+EErrorStatus mclSSIMBox_C1R(const uint8_t* pSrc1, int32_t src1Step, const uint8_t* pSrc2, int32_t src2Step, ImageSize roiSize, double& value, uint8_t* pBuffer, EBitDepth bd);
+
+/* Half precision storage of float planes: FP16 (IEEE binary16) or BF16, values are widened to FP32 for arithmetic */
+EErrorStatus mclConvert_32f16f(const float* pSrc, uint16_t* pDst, int32_t len, EFloatFormat ff);
+EErrorStatus mclConvert_16f32f(const uint16_t* pSrc, float* pDst, int32_t len, EFloatFormat ff);
+EErrorStatus mclConvert__u16f_C1R(const uint8_t* pSrc, int32_t srcStep, uint16_t* pDst, int32_t dstStep, ImageSize roiSize, EBitDepth bd, EFloatFormat ff);
+EErrorStatus mclDownsample2x_16f_C1R(const uint16_t* pSrc, int32_t srcStep, uint16_t* pDst, int32_t dstStep, ImageSize dstRoiSize, EFloatFormat ff);
+
 #endif // __METRICS_CALC_LITE_UTILS_H__
@@ -28,6 +28,10 @@
 #define MASK_APSNR     (1 << 1)
 #define MASK_MSE       (1 << 2)
 #define MASK_SSIM      (1 << 3)
+#define MASK_SSIM_FAST (1 << 8)
+#define MASK_SSIM_BOX  (1 << 9)
+#define MASK_TPSNR     (1 << 10)
+#define MASK_TFLICKER  (1 << 11)
 
 #if !defined(NO_IPP)
 #define MASK_ARTIFACTS (1 << 4)
@@ -85,6 +89,133 @@ protected:
     EBitDepth     m_bd;
     uint32_t      m_RShift;
     uint32_t      m_source_pixel_size;
+    uint64_t      m_frame_size; // Samples in one raw frame
+
+    /* Decoded frames kept for revisits. Entries own pooled buffers with the layout of the decoded planes,
+       buffers are swapped with the current frame instead of copied */
+    typedef struct {
+        int32_t   frame;
+        uint8_t  *data;
+        uint64_t  used;
+    } SCachedFrame;
+
+    std::vector< SCachedFrame > m_cache;
+    uint32_t      m_cache_frames;
+    uint64_t      m_cache_tick, m_cache_hits, m_cache_misses;
+
+    /* Moves the current frame into the cache and takes over the buffer of the requested frame on a hit, or
+       the one of the least recently used entry on a miss. Planes are rebased from planes[0], the start of the
+       decoded block. Returns true when the requested frame is now current */
+    bool CacheSwap(int32_t frame, SImage *planes, SImage &meta) {
+        size_t   k, slot = m_cache.size();
+        uint8_t *base = planes[0].data, *data;
+        bool     hit;
+
+        if (!m_cache_frames) return false;
+        for (k = 0; k < m_cache.size(); k++) {
+            if (m_cache[k].frame == frame) { slot = k; break; }
+        }
+        hit = slot < m_cache.size();
+        if (hit) m_cache_hits++; else m_cache_misses++;
+
+        if (!hit) {
+            if (m_cur_frame < 0) return false; // Nothing decoded yet
+            if (m_cache.size() < m_cache_frames) {
+                SCachedFrame entry = { -1, mclMalloc((size_t)m_frame_size, m_bd), 0 };
+                if (!entry.data) return false;
+                m_cache.push_back(entry);
+            } else {
+                for (k = slot = 0; k < m_cache.size(); k++) {
+                    if (m_cache[k].used < m_cache[slot].used) slot = k;
+                }
+            }
+        }
+
+        data = m_cache[slot].data;
+        for (k = 0; k < 4; k++) {
+            if (planes[k].data) planes[k].data = data + (planes[k].data - base);
+        }
+        if (meta.data == base) meta.data = data;
+        m_cache[slot].data  = base;
+        m_cache[slot].frame = m_cur_frame;
+        m_cache[slot].used  = ++m_cache_tick;
+
+        return hit;
+    };
+
+    uint64_t GetCacheMemorySize(void) const {
+        return (uint64_t)m_cache_frames * m_frame_size * ((m_bd == D008) ? 1 : 2);
+    };
+
+    /* Window of the planes returned by GetFrame() in luma samples of a frame or field, a zero width keeps whole planes.
+       Chroma planes get the window scaled to their size. Only the pointer and the ROI change */
+    ImagePoint    m_win_org;
+    ImageSize     m_win_size;
+
+    /* Dense fields of interlaced sources: every decoded plane holds the rows of the top field followed by the ones of
+       the bottom field. Each field is unpacked straight into its rows, GetFrame() then returns them instead of strided
+       views into the frame */
+    bool          m_dense;
+
+    int32_t GetFieldCount(void) const { return (m_dense && m_intl) ? 2 : 1; };
+
+    /* Rows of field f out of n in a plane, n is 1 for the whole frame. Fields are interleaved in source frames
+       and stacked in dense planes */
+    static SImage FieldRows(const SImage &plane, int32_t f, int32_t n, bool stacked) {
+        SImage rows = plane;
+
+        if (n < 2) return rows;
+        rows.roi.height = plane.roi.height >> 1;
+        if (!plane.data) return rows;
+        if (stacked) { rows.data += (size_t)f * rows.roi.height * plane.step; }
+        else         { rows.data += (size_t)f * plane.step; rows.step <<= 1; }
+        return rows;
+    };
+
+    /* Source planes read in place get a block of their own for dense fields, with the same layout */
+    EErrorStatus DetachPlanes(SImage *planes, const SImage &meta) {
+        uint8_t *data;
+
+        if (GetFieldCount() < 2 || planes[0].data != meta.data) return MCL_ERR_NONE;
+        if (NULL == (data = mclMalloc((size_t)m_frame_size, m_bd))) return MCL_ERR_MEMORY_ALLOC;
+        for (int32_t i = 0; i < 4; i++) {
+            if (planes[i].data) planes[i].data = data + (planes[i].data - meta.data);
+        }
+        return MCL_ERR_NONE;
+    };
+
+    /* Shifts field f out of n of the planes to the output bit depth. Unpacked planes are shifted in place, planes
+       read in place are shifted out of the raw frame, which has their layout */
+    void ShiftPlanes(SImage *planes, const uint8_t *raw, int32_t count, int32_t f, int32_t n) {
+        for (int32_t i = 0; i < count; i++) {
+            SImage src = planes[i], dst = FieldRows(planes[i], f, n, true);
+
+            if (!planes[i].data) continue;
+            if (!raw || raw == planes[0].data) { mclRShiftC_C1IR(m_RShift, dst.data, dst.step, dst.roi, m_bd); continue; }
+            src.data = (uint8_t*)raw + (planes[i].data - planes[0].data);
+            src = FieldRows(src, f, n, false);
+            mclRShiftC_C1R(m_RShift, src.data, src.step, dst.data, dst.step, dst.roi, m_bd);
+        }
+    };
+
+    /* Plane of the current frame or field */
+    void GetPlane(const SImage *planes, int32_t idx, SImage *dst) const {
+        ImageSize luma = planes[0].roi;
+
+        *dst = m_intl ? FieldRows(planes[idx], m_bottom, 2, GetFieldCount() > 1) : planes[idx];
+        if (m_intl) luma.height >>= 1;
+        ApplyWindow(dst, luma);
+    };
+
+    void ApplyWindow(SImage *plane, ImageSize luma) const {
+        if (!m_win_size.width || !luma.width || !luma.height) return;
+
+        int32_t x = (int32_t)((int64_t)m_win_org.x * plane->roi.width / luma.width), y = (int32_t)((int64_t)m_win_org.y * plane->roi.height / luma.height);
+
+        plane->roi.width  = (int32_t)((int64_t)m_win_size.width * plane->roi.width / luma.width);
+        plane->roi.height = (int32_t)((int64_t)m_win_size.height * plane->roi.height / luma.height);
+        if (plane->data) plane->data += (size_t)y * plane->step + (size_t)x * ((m_bd == D008) ? 1 : 2);
+    };
 
 public:
     CReader() :
@@ -97,13 +228,29 @@ public:
         m_bottom(0),
         m_bd(D008),
         m_RShift(0),
-        m_source_pixel_size(0)
-    {};
+        m_source_pixel_size(0),
+        m_frame_size(0),
+        m_cache_frames(0),
+        m_cache_tick(0),
+        m_cache_hits(0),
+        m_cache_misses(0),
+        m_dense(false)
+    {
+        m_win_org.x = m_win_org.y = 0; m_win_size.width = m_win_size.height = 0;
+    };
 
     virtual ~CReader() {
         if (m_file) { fclose(m_file); m_file = 0; }
+        for (size_t k = 0; k < m_cache.size(); k++) { mclFree(m_cache[k].data); }
     };
 
+    /* Number of decoded frames kept besides the current one, 0 disables the cache */
+    virtual void     SetCacheSize(uint32_t frames) { m_cache_frames = frames; };
+    virtual uint64_t GetCacheHits(void) const     { return m_cache_hits; };
+    virtual uint64_t GetCacheMisses(void) const   { return m_cache_misses; };
+    virtual void     SetDenseFields(bool enable)  { m_dense = enable; };
+    void          SetWindow(ImagePoint org, ImageSize size) { m_win_org = org; m_win_size = size; };
+
     int32_t       GetFramesCount(void) const   { return m_num_fields; };
     bool          GetInterlaced(void) const    { return m_intl; };
     EBitDepth     GetBitDepth() const          { return m_bd; };
@@ -112,6 +259,7 @@ public:
     virtual EErrorStatus OpenReadFile(std::string name, uint32_t w, uint32_t h, ESequenceType type, int32_t order, EBitDepth bd, uint32_t RShift) = 0;
     virtual bool ReadRawFrame(uint32_t field) = 0;
     virtual void GetFrame(int32_t idx, void *dst) = 0;
+    virtual uint64_t GetMemorySize(void) const = 0;
 };
 
 class CRGBReader : public CReader {
@@ -148,14 +296,14 @@ public:
         }
         if(NULL != (m_file = fopen(name.c_str(),"rb"))) {
             m_source_pixel_size = ( bd == D008 || m_type == A2RGB10P || m_type == A2RGB10I ) ? 1 : 2;
-            m_Meta.step         = (m_type == RGBPP || m_type == RGBPI) ? w * h * 3 : w * h * 4;
+            m_frame_size        = (uint64_t)w * h * ((m_type == RGBPP || m_type == RGBPI) ? 3 : 4);
             m_Meta.roi.width    = w;
             m_Meta.roi.height   = h;
-            m_Meta.data         = mclMalloc(m_Meta.step, bd);
+            m_Meta.data         = mclMalloc((size_t)m_frame_size, bd);
             if (!m_Meta.data)  return MCL_ERR_MEMORY_ALLOC;
 
             _file_fseek(m_file, 0, SEEK_END);
-            m_num_fields = (uint32_t)(_file_ftell(m_file) / (m_Meta.step*m_source_pixel_size));
+            m_num_fields = (uint32_t)(_file_ftell(m_file) / (m_frame_size*m_source_pixel_size));
             _file_fseek(m_file, 0, SEEK_SET);
 
             if(0 != (m_intl = is_interlaced(type))) m_num_fields <<= 1;
@@ -172,13 +320,13 @@ public:
                 m_planes[3].roi.height = 0;
                 m_planes[3].step = 0;
             } else {
-                m_planes[0].data = mclMalloc(m_Meta.step, bd);
+                m_planes[0].data = mclMalloc((size_t)m_frame_size, bd);
                 if (!m_planes[0].data) return MCL_ERR_MEMORY_ALLOC;
                 m_planes[1].data = m_planes[0].data + m_planes[0].roi.height*m_planes[0].step;
                 m_planes[2].data = m_planes[1].data + m_planes[1].roi.height*m_planes[1].step;
                 m_planes[3].data = m_planes[2].data + m_planes[2].roi.height*m_planes[2].step;
             }
-            return MCL_ERR_NONE;
+            return DetachPlanes(m_planes, m_Meta);
         } else {
             return MCL_ERR_INVALID_PARAM;
         }
@@ -187,46 +335,50 @@ public:
     bool ReadRawFrame(uint32_t field) {
         uint8_t  *planes[4];
         ImageSize roi = m_planes[0].roi;
+        int32_t   n = GetFieldCount();
 
-        for(int32_t i=0; i<4; i++) { planes[i] = m_planes[i].data; }
         if(m_intl) { m_bottom = (m_field_order)^(field&0x1); field >>= 1; }
-        if(m_cur_frame != (int32_t)field) {
-            _file_fseek(m_file, ((uint64_t)field)*(m_Meta.step*m_source_pixel_size), SEEK_SET);
-            size_t res = fread( m_Meta.data, m_source_pixel_size, m_Meta.step, m_file );
-            switch (m_type) {
-                case RGB32P:
-                case RGB32I:
-                case ARGB16P:
-                    mclCopy_C4P4R(m_Meta.data, m_planes[0].step<<2, planes, m_planes[0].step, roi, m_bd);
-                    break;
-                case A2RGB10P:
-                case A2RGB10I:
-                    planes[0] = m_planes[2].data; planes[2] = m_planes[0].data;
-                    mclA2RGB10ToRGB_C4P4R(m_Meta.data, m_planes[0].step, planes, m_planes[0].step, roi, m_bd);
-                    break;
-                default:
-                    break;
-            }
-            mclRShiftC_C1IR(m_RShift, m_planes[0].data, m_planes[0].step, m_planes[0].roi, m_bd);
-            mclRShiftC_C1IR(m_RShift, m_planes[1].data, m_planes[1].step, m_planes[1].roi, m_bd);
-            mclRShiftC_C1IR(m_RShift, m_planes[2].data, m_planes[2].step, m_planes[2].roi, m_bd);
-            if (m_type != RGBPP && m_type != RGBPI) {
-                mclRShiftC_C1IR(m_RShift, m_planes[3].data, m_planes[3].step, m_planes[3].roi, m_bd);
+        if(m_cur_frame != (int32_t)field && CacheSwap((int32_t)field, m_planes, m_Meta)) {
+            m_cur_frame = (int32_t)field;
+            return false;
+        } else if(m_cur_frame != (int32_t)field) {
+            _file_fseek(m_file, ((uint64_t)field)*(m_frame_size*m_source_pixel_size), SEEK_SET);
+            size_t res = fread( m_Meta.data, m_source_pixel_size, (size_t)m_frame_size, m_file );
+            roi.height = FieldRows(m_planes[0], 0, n, true).roi.height;
+            for(int32_t f=0; f<n; f++) {
+                const uint8_t *raw = NULL;
+
+                for(int32_t i=0; i<4; i++) { planes[i] = FieldRows(m_planes[i], f, n, true).data; }
+                switch (m_type) {
+                    case RGB32P:
+                    case RGB32I:
+                    case ARGB16P:
+                        mclCopy_C4P4R(m_Meta.data + f*(m_planes[0].step<<2), (m_planes[0].step<<2)*n, planes, m_planes[0].step, roi, m_bd);
+                        break;
+                    case A2RGB10P:
+                    case A2RGB10I:
+                        std::swap(planes[0], planes[2]);
+                        mclA2RGB10ToRGB_C4P4R(m_Meta.data + f*(m_planes[0].step<<1), m_planes[0].step*n, planes, m_planes[0].step, roi, m_bd);
+                        break;
+                    default:
+                        raw = m_Meta.data; // Planes read in place
+                        break;
+                }
+                ShiftPlanes(m_planes, raw, 4, f, n);
             }
             m_cur_frame = (int32_t)field;
-            return (res != m_Meta.step);
+            return (res != m_frame_size);
         } else {
             return false;
         }
     };
 
     void GetFrame(int32_t idx, void *dst) {
-        memcpy((uint8_t*)dst, (uint8_t*)(m_planes+idx), sizeof(SImage));
-        SImage *destination = (SImage*) dst;
-        if(m_intl) {
-            if(m_bottom) destination->data += destination->step;
-            destination->step <<= 1; destination->roi.height >>= 1;
-        }
+        GetPlane(m_planes, idx, (SImage*)dst);
+    };
+
+    uint64_t GetMemorySize(void) const {
+        return m_frame_size * ((m_bd == D008) ? 1 : 2) * ((m_planes[0].data != m_Meta.data) ? 2 : 1) + GetCacheMemorySize();
     };
 };
 
@@ -266,14 +418,14 @@ public:
         if(NULL != (m_file = fopen(name.c_str(),"rb"))) {
             m_source_pixel_size = ( bd == D008 || m_type == Y410P || m_type == Y410I ) ? 1 : 2;
             if(get_chromaclass(type) == C420) {
-                m_Meta.step        = w * h * 3 / 2;
-                m_Meta.data        = mclMalloc(m_Meta.step, bd);
+                m_frame_size       = (uint64_t)w * h * 3 / 2;
+                m_Meta.data        = mclMalloc((size_t)m_frame_size, bd);
                 m_Meta.roi.width   = 1;
                 m_Meta.roi.height  = 1;
                 if (!m_Meta.data) return MCL_ERR_MEMORY_ALLOC;
 
                 _file_fseek(m_file, 0, SEEK_END);
-                m_num_fields = (uint32_t)(_file_ftell(m_file) / (m_Meta.step*m_source_pixel_size));
+                m_num_fields = (uint32_t)(_file_ftell(m_file) / (m_frame_size*m_source_pixel_size));
                 _file_fseek(m_file, 0, SEEK_SET);
 
                 if(0 != (m_intl = is_interlaced(type))) m_num_fields <<= 1;
@@ -300,21 +452,21 @@ public:
                         break;
                     case NV12P:
                     case NV12I:
-                        m_planes[0].data = mclMalloc(m_Meta.step, bd);
+                        m_planes[0].data = mclMalloc((size_t)m_frame_size, bd);
                         if (!m_planes[0].data) return MCL_ERR_MEMORY_ALLOC;
                         m_planes[2].data = m_planes[0].data + m_planes[0].roi.height*m_planes[0].step;
                         m_planes[1].data = m_planes[2].data + m_planes[2].roi.height*m_planes[2].step;
                         break;
                 }
             } else if(get_chromaclass(type) == C422) {
-                m_Meta.step        = w * h * 2;
-                m_Meta.data        = mclMalloc(m_Meta.step, bd);
+                m_frame_size       = (uint64_t)w * h * 2;
+                m_Meta.data        = mclMalloc((size_t)m_frame_size, bd);
                 m_Meta.roi.width   = 1;
                 m_Meta.roi.height  = 1;
                 if (!m_Meta.data) return MCL_ERR_MEMORY_ALLOC;
 
                 _file_fseek(m_file, 0, SEEK_END);
-                m_num_fields = (uint32_t)(_file_ftell(m_file) / (m_Meta.step*m_source_pixel_size));
+                m_num_fields = (uint32_t)(_file_ftell(m_file) / (m_frame_size*m_source_pixel_size));
                 _file_fseek(m_file, 0, SEEK_SET);
 
                 if(0 != (m_intl = is_interlaced(type))) m_num_fields <<= 1;
@@ -338,7 +490,7 @@ public:
                     case YUY2I:
                     case NV16P:
                     case NV16I:
-                        m_planes[0].data = mclMalloc(m_Meta.step, bd);
+                        m_planes[0].data = mclMalloc((size_t)m_frame_size, bd);
                         if (!m_planes[0].data) return MCL_ERR_MEMORY_ALLOC;
                         m_planes[1].data = m_planes[0].data + m_planes[0].roi.height*m_planes[0].step;
                         m_planes[2].data = m_planes[1].data + m_planes[1].roi.height*m_planes[1].step;
@@ -347,16 +499,16 @@ public:
             } else if(get_chromaclass(type) == C444) {
                 if (   type == I444P || type == I444I
                     || type == I410P || type == I410I)
-                    m_Meta.step        = w * h * 3;
+                    m_frame_size       = (uint64_t)w * h * 3;
                 else
-                    m_Meta.step        = w * h * 4;
-                m_Meta.data        = mclMalloc(m_Meta.step, bd);
+                    m_frame_size       = (uint64_t)w * h * 4;
+                m_Meta.data        = mclMalloc((size_t)m_frame_size, bd);
                 m_Meta.roi.width   = 1;
                 m_Meta.roi.height  = 1;
                 if (!m_Meta.data) return MCL_ERR_MEMORY_ALLOC;
 
                 _file_fseek(m_file, 0, SEEK_END);
-                m_num_fields = (uint32_t)(_file_ftell(m_file) / (m_Meta.step*m_source_pixel_size));
+                m_num_fields = (uint32_t)(_file_ftell(m_file) / (m_frame_size*m_source_pixel_size));
                 _file_fseek(m_file, 0, SEEK_SET);
 
                 if(0 != (m_intl = is_interlaced(type))) m_num_fields <<= 1;
@@ -371,7 +523,7 @@ public:
                     case AYUVI:
                     case Y416P:
                     case Y416I:
-                        m_planes[0].data = mclMalloc(m_Meta.step, bd);
+                        m_planes[0].data = mclMalloc((size_t)m_frame_size, bd);
                         if (!m_planes[0].data) return MCL_ERR_MEMORY_ALLOC;
                         m_planes[1].data = m_planes[0].data + m_planes[0].roi.height*m_planes[0].step;
                         m_planes[2].data = m_planes[1].data + m_planes[1].roi.height*m_planes[1].step;
@@ -389,7 +541,7 @@ public:
                         break;
                     case Y410P:
                     case Y410I:
-                        m_planes[0].data = mclMalloc(m_Meta.step, bd);
+                        m_planes[0].data = mclMalloc((size_t)m_frame_size, bd);
                         if (!m_planes[0].data) return MCL_ERR_MEMORY_ALLOC;
                         m_planes[1].data = m_planes[0].data + m_planes[0].roi.height*m_planes[0].step;
                         m_planes[2].data = m_planes[1].data + m_planes[1].roi.height*m_planes[1].step;
@@ -398,862 +550,2601 @@ public:
                 }
             }
 
-            return MCL_ERR_NONE;
+            return DetachPlanes(m_planes, m_Meta);
         } else {
             return MCL_ERR_INVALID_PARAM;
         }
     };
 
     bool ReadRawFrame(uint32_t field) {
-        uint8_t *planes[4];
-        int32_t  steps[4];
+        uint8_t  *planes[4];
+        int32_t   steps[4];
+        ImageSize roi = m_planes[0].roi;
+        int32_t   n = GetFieldCount();
 
-        for(int32_t i=0; i<4; i++) { planes[i] = m_planes[i].data; steps[i] = m_planes[i].step; }
         if(m_intl) { m_bottom = (m_field_order)^(field&0x1); field >>= 1; }
-        if(m_cur_frame != (int32_t)field) {
-            _file_fseek(m_file, ((uint64_t)field)*(m_Meta.step*m_source_pixel_size), SEEK_SET);
-            size_t res = fread( m_Meta.data, m_source_pixel_size, m_Meta.step, m_file );
-            switch (m_type) {
-                case NV12P:
-                case NV12I:
-                    mclYCbCr420ToYCrCb420_P2P3R(m_Meta.data, m_planes[0].step, m_Meta.data+m_planes[0].step*m_planes[0].roi.height, m_planes[0].step, planes, steps, m_planes[0].roi, m_bd);
-                    break;
-                case YUY2P:
-                case YUY2I:
-                    mclYCbCr422_C2P3R(m_Meta.data, m_planes[0].step<<1, planes, steps, m_planes[0].roi, m_bd);
-                    break;
-                case NV16P:
-                case NV16I:
-                    mclNV16ToYCbCr422_P2P3R(m_Meta.data, m_planes[0].step, m_Meta.data+m_planes[0].step*m_planes[0].roi.height, m_planes[0].step, planes, steps, m_planes[0].roi, m_bd);
-                    break;
-                case AYUVP:
-                case AYUVI:
-                    planes[2] = m_planes[0].data;
-                    planes[0] = m_planes[2].data;
-                    mclCopy_C4P4R(m_Meta.data, m_planes[0].step<<2, planes, m_planes[0].step, m_planes[0].roi, m_bd);
-                    break;
-                case Y416P:
-                case Y416I:
-                    planes[1] = m_planes[0].data;
-                    planes[0] = m_planes[1].data;
-                    mclCopy_C4P4R(m_Meta.data, m_planes[0].step << 2, planes, m_planes[0].step, m_planes[0].roi, m_bd);
-                    break;
-                case Y410P:
-                case Y410I:
-                    mclY410ToYUV_C4P4R(m_Meta.data, m_planes[0].step, planes, m_planes[0].step, m_planes[0].roi, m_bd);
-                    break;
-                default:
-                    break;
-            }
-            mclRShiftC_C1IR(m_RShift, m_planes[0].data, m_planes[0].step, m_planes[0].roi, m_bd);
-            mclRShiftC_C1IR(m_RShift, m_planes[1].data, m_planes[1].step, m_planes[1].roi, m_bd);
-            mclRShiftC_C1IR(m_RShift, m_planes[2].data, m_planes[2].step, m_planes[2].roi, m_bd);
+        if(m_cur_frame != (int32_t)field && CacheSwap((int32_t)field, m_planes, m_Meta)) {
             m_cur_frame = (int32_t)field;
-            return (res != m_Meta.step);
-        } else {
             return false;
-        }
-    };
-
-    void GetFrame(int32_t idx, void *dst) {
-        memcpy((uint8_t*)dst, (uint8_t*)(m_planes+idx), sizeof(SImage));
-        SImage *destination = (SImage*) dst;
-        if(m_intl) {
-            if(m_bottom) destination->data += destination->step;
-            destination->step <<= 1; destination->roi.height >>= 1;
-        }
-    };
-};
-
-class CMetricEvaluator {
-protected:
-    std::vector< std::pair< std::string, std::pair<uint32_t, uint32_t> > > metrics;
-    uint32_t   m_num_planes, c_mask[5];
-    CReader       *m_i1, *m_i2;
-public:
-    virtual ~CMetricEvaluator(void) {};
-    void InitFrameParams(CReader *i1, CReader *i2) { m_i1 = i1; m_i2 = i2; };
-    void InitComputationParams(Component cmps,
-        std::vector< std::string > &st, std::vector< bool > &oflag, std::vector< double > &avg)
-    {
-        m_num_planes = (uint32_t)cmps.size() - 1;
-
-        for(uint32_t i=0; i < m_num_planes; i++)
-            c_mask[i] = cmps[i].second|cmps[m_num_planes].second;
+        } else if(m_cur_frame != (int32_t)field) {
+            const uint8_t *chroma = m_Meta.data + m_planes[0].step*m_planes[0].roi.height;
 
-        c_mask[m_num_planes] = cmps[m_num_planes].second;
+            _file_fseek(m_file, ((uint64_t)field)*(m_frame_size*m_source_pixel_size), SEEK_SET);
+            size_t res = fread( m_Meta.data, m_source_pixel_size, (size_t)m_frame_size, m_file );
+            roi.height = FieldRows(m_planes[0], 0, n, true).roi.height;
+            for(int32_t f=0; f<n; f++) {
+                const uint8_t *raw = NULL;
 
-        for(uint32_t i=0; i < metrics.size(); i++) {
-            for(uint32_t j=0; j < m_num_planes; j++) {
-                if(metrics[i].second.second&c_mask[j]) {
-                    c_mask[j] |= metrics[i].second.second;
-                    st.push_back(std::string(1, cmps[j].first) + std::string("-") + metrics[i].first);
-                    oflag.push_back((metrics[i].second.first&cmps[j].second)!=0);
-                    avg.push_back(0.0);
+                for(int32_t i=0; i<4; i++) { planes[i] = FieldRows(m_planes[i], f, n, true).data; steps[i] = m_planes[i].step; }
+                switch (m_type) {
+                    case NV12P:
+                    case NV12I:
+                        mclYCbCr420ToYCrCb420_P2P3R(m_Meta.data + f*m_planes[0].step, m_planes[0].step*n, chroma + f*m_planes[0].step, m_planes[0].step*n, planes, steps, roi, m_bd);
+                        break;
+                    case YUY2P:
+                    case YUY2I:
+                        mclYCbCr422_C2P3R(m_Meta.data + f*(m_planes[0].step<<1), (m_planes[0].step<<1)*n, planes, steps, roi, m_bd);
+                        break;
+                    case NV16P:
+                    case NV16I:
+                        mclNV16ToYCbCr422_P2P3R(m_Meta.data + f*m_planes[0].step, m_planes[0].step*n, chroma + f*m_planes[0].step, m_planes[0].step*n, planes, steps, roi, m_bd);
+                        break;
+                    case AYUVP:
+                    case AYUVI:
+                        std::swap(planes[0], planes[2]);
+                        mclCopy_C4P4R(m_Meta.data + f*(m_planes[0].step<<2), (m_planes[0].step<<2)*n, planes, m_planes[0].step, roi, m_bd);
+                        break;
+                    case Y416P:
+                    case Y416I:
+                        std::swap(planes[0], planes[1]);
+                        mclCopy_C4P4R(m_Meta.data + f*(m_planes[0].step<<2), (m_planes[0].step<<2)*n, planes, m_planes[0].step, roi, m_bd);
+                        break;
+                    case Y410P:
+                    case Y410I:
+                        mclY410ToYUV_C4P4R(m_Meta.data + f*(m_planes[0].step<<1), m_planes[0].step*n, planes, m_planes[0].step, roi, m_bd);
+                        break;
+                    default:
+                        raw = m_Meta.data; // Planes read in place
+                        break;
                 }
+                ShiftPlanes(m_planes, raw, 3, f, n);
             }
-            if(metrics[i].second.first&c_mask[m_num_planes]) {
-                st.push_back(metrics[i].first);
-                oflag.push_back(true);
-                avg.push_back(0.0);
-            }
+            m_cur_frame = (int32_t)field;
+            return (res != m_frame_size);
+        } else {
+            return false;
         }
     };
-    virtual int32_t AllocateResourses(void) = 0;
-    virtual void ComputeMetrics(std::vector< double > &val, std::vector< double > &avg) = 0;
-};
 
-class CPSNREvaluator: public CMetricEvaluator {
-public:
-    CPSNREvaluator() {
-        std::pair< std::string, std::pair<uint32_t, uint32_t> >   metric_pair;
-        metric_pair.first = "MSE";   metric_pair.second.first = MASK_MSE;   metric_pair.second.second = MASK_MSE;   metrics.push_back(metric_pair);
-        metric_pair.first = "PSNR";  metric_pair.second.first = MASK_PSNR;  metric_pair.second.second = MASK_PSNR;  metrics.push_back(metric_pair);
-        metric_pair.first = "APSNR"; metric_pair.second.first = MASK_APSNR; metric_pair.second.second = MASK_APSNR; metrics.push_back(metric_pair);
+    void GetFrame(int32_t idx, void *dst) {
+        GetPlane(m_planes, idx, (SImage*)dst);
     };
-    ~CPSNREvaluator(void) {};
-    int32_t AllocateResourses(void) { return 0; };
-    void ComputeMetrics(std::vector< double > &val, std::vector< double > &avg) {
-        SImage i1_p, i2_p;
-        double sum[5] = {0.0, 0.0, 0.0, 0.0, 0.0};
-        size_t i, j = val.size();
-        ESequenceType sqtype = m_i1->GetSqType();
-        ImageSize a = {2,2};
-
-        for(i=0; i<m_num_planes; i++) {
-            if(c_mask[i]&MASK_MSE) {
-                m_i1->GetFrame((int32_t)i, &i1_p); m_i2->GetFrame((int32_t)i, &i2_p);
-                mclNormDiff_L2_C1R(i1_p.data,  i1_p.step, i2_p.data,  i2_p.step, i1_p.roi, sum[i], m_i1->GetBitDepth());
-                sum[i] = sum[i]*sum[i]/(double)(i1_p.roi.width*i1_p.roi.height);
-                val.push_back(sum[i]); avg[j++] += sum[i];
-            }
-        }
-
-        switch(get_chromaclass(sqtype)) {
-            case C444:
-                sum[m_num_planes] = (sum[0]+sum[1]+sum[2]+sum[3])/(double)m_num_planes; break;
-            case C422:
-                sum[3] = (2.0*sum[0]+sum[1]+sum[2])/4.0; break;
-            case C420:
-            default:
-                sum[3] = (4.0*sum[0]+sum[1]+sum[2])/6.0; break;
-        }
 
-        if(c_mask[m_num_planes]&MASK_MSE) { val.push_back(sum[m_num_planes]); avg[j++] += sum[m_num_planes]; }
-        for(i=0; i<=m_num_planes; i++) { if(c_mask[i]&MASK_PSNR) { val.push_back(MSEToPSNR(sum[i], MaxError(m_i1->GetBitDepth()))); avg[j++] += sum[i]; } }
-        for(i=0; i<=m_num_planes; i++) { if(c_mask[i]&MASK_APSNR) { val.push_back(MSEToPSNR(sum[i], MaxError(m_i1->GetBitDepth()))); avg[j++] += MSEToPSNR(sum[i], MaxError(m_i1->GetBitDepth())); } }
+    uint64_t GetMemorySize(void) const {
+        return m_frame_size * ((m_bd == D008) ? 1 : 2) * ((m_planes[0].data != m_Meta.data) ? 2 : 1) + GetCacheMemorySize();
     };
 };
 
-class CSSIMEvaluator: public CMetricEvaluator {
+/* Decorator bringing the planes of another reader to the plane sizes of the reference input, for inputs of
+   different resolutions. Every frame or field is resized when it is read, resized pictures are cached alongside the
+   decoded ones of the source */
+class CScaledReader : public CReader {
 private:
-    float  *m_mu1, *m_mu2, *m_mu1_sq, *m_mu2_sq, *m_mu1_mu2, *m_tmp;
-    int32_t m_step, mc_ksz[3], m_xkidx[4], m_ykidx[4];
-    float   m_ssim_c1, m_ssim_c2, m_kernel_values[11+7+5], *mc_krn[3];
+    CReader      *m_src;
+    SImage        m_planes[4];
+    SResizeSpec   m_spec[4];
+    ImageSize     m_size[4];  // Target plane sizes of a frame or field
+    EResizeFilter m_filter;
+    uint8_t      *m_buffer;
+    uint64_t      m_bytes;
 
-    int32_t GaussianKernel(int32_t KernelSize, float sigma, float* pKernel) {
-        int32_t i;
+public:
+    CScaledReader(CReader *src, const ImageSize size[4], EResizeFilter filter): m_src(src), m_filter(filter), m_buffer(0), m_bytes(0) {
+        memset(&m_planes, 0, sizeof(m_planes));
+        for (int32_t i = 0; i < 4; i++) m_size[i] = size[i];
+    };
 
-        float val, sum = 0.0f;
-        for (i = 0; i < KernelSize; i++) {
-            val = (float)(i - KernelSize / 2);
-            pKernel[i] = (float)exp(-(float)(val * val) / (float)(2.0f * sigma * sigma));
-            sum += pKernel[i];
-        }
+    virtual ~CScaledReader() {
+        delete m_src;
+        if (m_planes[0].data) { mclFree(m_planes[0].data); } // Start of the planes, swapped with cache entries
+        if (m_buffer) { mclFree(m_buffer); }
+    };
 
-        for (i = 0; i < KernelSize; i++) pKernel[i] /= sum;
+    EErrorStatus OpenReadFile(std::string name, uint32_t w, uint32_t h, ESequenceType type, int32_t order, EBitDepth bd, uint32_t RShift) {
+        EErrorStatus sts = m_src->OpenReadFile(name, w, h, type, order, bd, RShift);
+        int32_t      bytes = (bd == D008) ? 1 : 2, buffer = 0, size, i;
+        size_t       offset = 0;
+        uint8_t     *data;
 
-        return 0;
-    }
+        if (sts != MCL_ERR_NONE) return sts;
+        m_type = type; m_field_order = order; m_bd = bd; m_RShift = RShift;
+        m_num_fields = m_src->GetFramesCount(); m_intl = m_src->GetInterlaced();
 
-    void testFastSSIM_32f(
-        const float* pSrc1, int32_t src1Step, const float* pSrc2, int32_t src2Step, const float* pSrc3, int32_t src3Step,
-        const float* pSrc4, int32_t src4Step, const float* pSrc5, int32_t src5Step, float* pDst, int32_t dstStep,
-        ImageSize roiSize, float C1, float C2)
-    {
-        int32_t     i, j;
-        float  t1, t2, t3, t4, *pMx, *pMy, *pSx2, *pSy2, *pSxy, *pDi;
+        for (i = 0; i < 4; i++) {
+            SImage plane;
 
-        C2 += C1;
+            m_src->GetFrame(i, &plane);
+            memset(&m_planes[i], 0, sizeof(SImage));
+            if (plane.roi.width < 1 || plane.roi.height < 1 || m_size[i].width < 1 || m_size[i].height < 1) continue;
 
-        for (j = 0; j<roiSize.height; j++) {
-            pMx = (float*)((uint8_t*)(pSrc1)+j * src1Step); pMy = (float*)((uint8_t*)(pSrc2)+j * src2Step);
-            pSx2 = (float*)((uint8_t*)(pSrc3)+j * src3Step); pSy2 = (float*)((uint8_t*)(pSrc4)+j * src4Step);
-            pSxy = (float*)((uint8_t*)(pSrc5)+j * src5Step); pDi = (float*)((uint8_t*)(pDst)+j * dstStep);
-            for (i = 0; i<roiSize.width; i++) {
-                t1 = (*pMx)*(*pMy); t1 = t1 + t1 + C1; t2 = (*pSxy) + (*pSxy) - t1 + C2;
-                t3 = (*pMx)*(*pMx) + (*pMy)*(*pMy) + C1; t4 = (*pSx2) + (*pSy2) - t3 + C2;
-                t2 *= t1; t4 *= t3;
-                *pDi = (t4 >= FLT_EPSILON) ? (t2 / t4) : ((t3 >= FLT_EPSILON) ? (t1 / t3) : (1.0f));
-                pMx++; pMy++; pSx2++; pSy2++; pSxy++; pDi++;
-            }
+            m_planes[i].roi  = m_size[i];
+            m_planes[i].step = m_size[i].width * bytes;
+            if (mclResizeInit(plane.roi, m_size[i], m_filter, m_spec[i]) != MCL_ERR_NONE) return MCL_ERR_INVALID_PARAM;
+            mclResizeGetBufferSize(m_spec[i], &size);
+            buffer = (std::max)(buffer, size);
+            offset += (size_t)m_planes[i].step * m_size[i].height;
         }
-    }
 
-public:
-    CSSIMEvaluator(): m_ssim_c1(0), m_ssim_c2(0), m_step(0) {
-        std::pair< std::string, std::pair<uint32_t, uint32_t> >   metric_pair;
-        metric_pair.first = "SSIM"; metric_pair.second.first = MASK_SSIM; metric_pair.second.second = MASK_SSIM; metrics.push_back(metric_pair);
-        m_mu1 = m_mu2 = m_mu1_sq = m_mu2_sq = m_mu1_mu2 = m_tmp = 0;
-        GaussianKernel(11, 1.5,   m_kernel_values);
-        GaussianKernel( 7, 0.75,  m_kernel_values+11);
-        GaussianKernel( 5, 0.375, m_kernel_values+18);
-        mc_krn[0] = m_kernel_values; mc_krn[1] = m_kernel_values+11; mc_krn[2] = m_kernel_values+18;
-        mc_ksz[0] = 11; mc_ksz[1] = 7; mc_ksz[2] = 5;
-        m_xkidx[0] = m_xkidx[1] = m_xkidx[2] = m_xkidx[3] = m_ykidx[0] = m_ykidx[1] = m_ykidx[2] = m_ykidx[3] = 0;
-    };
-    ~CSSIMEvaluator(void) {
-        mclFree(m_mu1); mclFree(m_mu2); mclFree(m_mu1_sq); mclFree(m_mu2_sq); mclFree(m_mu1_mu2); mclFree(m_tmp);
+        m_frame_size = offset / bytes;
+        m_bytes  = offset + buffer;
+        data     = mclMalloc((size_t)m_frame_size, bd);
+        m_buffer = mclMalloc(buffer, D008);
+        if (!data || !m_buffer) { if (data) { mclFree(data); } return MCL_ERR_MEMORY_ALLOC; }
+        if (m_intl) m_cache_frames *= 2; // Both fields of every cached source frame
+
+        for (i = 0, offset = 0; i < 4; i++) {
+            if (!m_planes[i].step) continue;
+            m_planes[i].data = data + offset;
+            offset += (size_t)m_planes[i].step * m_planes[i].roi.height;
+        }
+        return MCL_ERR_NONE;
     };
 
-    int32_t AllocateResourses(void) {
-        SImage ref;
-
-        m_i1->GetFrame(0, &ref);
-
-        m_mu1     = mclMalloc_32f_C1(ref.roi.width, ref.roi.height, &m_step);
-        m_mu2     = mclMalloc_32f_C1(ref.roi.width, ref.roi.height, &m_step);
-        m_mu1_sq  = mclMalloc_32f_C1(ref.roi.width, ref.roi.height, &m_step);
-        m_mu2_sq  = mclMalloc_32f_C1(ref.roi.width, ref.roi.height, &m_step);
-        m_mu1_mu2 = mclMalloc_32f_C1(ref.roi.width, ref.roi.height, &m_step);
-        m_tmp     = mclMalloc_32f_C1(ref.roi.width, ref.roi.height, &m_step);
+    /* Scaled pictures are cached like the decoded ones, so revisits skip the resize as well as the read */
+    bool ReadRawFrame(uint32_t field) {
+        bool   err = m_src->ReadRawFrame(field);
+        SImage meta;
 
-        if(!m_mu1 || !m_mu2 || !m_mu1_sq || !m_mu2_sq || !m_mu1_mu2 || !m_tmp)
-            return MCL_ERR_MEMORY_ALLOC;
+        memset(&meta, 0, sizeof(meta));
+        if (m_cur_frame != (int32_t)field && CacheSwap((int32_t)field, m_planes, meta)) {
+            m_cur_frame = (int32_t)field;
+        } else if (m_cur_frame != (int32_t)field) {
+            for (int32_t i = 0; i < 4; i++) {
+                SImage plane;
 
-        for(int32_t i=0; i<4; i++) {
-            if(i!=0) {
-                switch (get_chromaclass(m_i1->GetSqType())) {
-                case C444:
-                    break;
-                case C422:
-                    m_xkidx[i]++; break;
-                case C420:
-                default:
-                    m_xkidx[i]++; m_ykidx[i]++; break;
-                }
+                if (!m_planes[i].data) continue;
+                m_src->GetFrame(i, &plane);
+                mclResize_C1R(plane.data, plane.step, m_planes[i].data, m_planes[i].step, m_spec[i], m_buffer, m_bd);
             }
-            if(m_i1->GetInterlaced()) m_ykidx[i]++;
+            m_cur_frame = (int32_t)field;
         }
-
-        float max_e = (float)MaxError(m_i1->GetBitDepth());
-        m_ssim_c1 = 0.0001f*max_e*max_e;
-        m_ssim_c2 = 0.0009f*max_e*max_e;
-        
-        return MCL_ERR_NONE;
+        return err;
     };
 
-    void ComputeMetrics(std::vector< double > &val, std::vector< double > &avg) {
-        double     idx[5]  = {0.0, 0.0, 0.0, 0.0, 0.0};
-        double     aidx[5] = {0.0, 0.0, 0.0, 0.0, 0.0};
-        ImageSize  flt, flt_h;
-        uint32_t   i, j = (uint32_t)val.size(), shift, shift_h;
-        SImage     i1_p, i2_p;
+    void GetFrame(int32_t idx, void *dst) {
+        memcpy((uint8_t*)dst, (uint8_t*)(m_planes+idx), sizeof(SImage));
+        ApplyWindow((SImage*)dst, m_planes[0].roi);
+    };
 
-        for(i=0; i<m_num_planes; i++) {
-            if(c_mask[i]&MASK_SSIM) {
-                m_i1->GetFrame(i, &i1_p); m_i2->GetFrame(i, &i2_p);
+    uint64_t GetMemorySize(void) const { return m_src->GetMemorySize() + m_bytes + GetCacheMemorySize(); };
 
-                mclConvert__u32f_C1R(i1_p.data, i1_p.step, m_mu1, m_step, i1_p.roi, m_i1->GetBitDepth());
-                mclConvert__u32f_C1R(i2_p.data, i2_p.step, m_mu2, m_step, i2_p.roi, m_i1->GetBitDepth());
+    void     SetCacheSize(uint32_t frames) { m_src->SetCacheSize(frames); m_cache_frames = frames; };
+    uint64_t GetCacheHits(void) const      { return m_src->GetCacheHits(); };
+    uint64_t GetCacheMisses(void) const    { return m_src->GetCacheMisses(); };
+    void     SetDenseFields(bool enable)   { m_src->SetDenseFields(enable); };
+};
 
-                mclSqr_32f_C1R(m_mu1, m_step, m_mu1_sq, m_step, i1_p.roi);
-                mclSqr_32f_C1R(m_mu2, m_step, m_mu2_sq, m_step, i1_p.roi);
-                mclMul_32f_C1R(m_mu1, m_step, m_mu2, m_step, m_mu1_mu2, m_step, i1_p.roi);
+#if !defined(NO_IPP) && !defined(LEGACY_IPP)
+const short mpegmatrix [ 64 ] = {
+    8,  16, 19, 22, 26, 27, 29, 34,
+    16, 16, 22, 21, 27, 29, 34, 37,
+    19, 22, 26, 27, 29, 31, 34, 38,
+    22, 22, 26, 27, 29, 34, 37, 40,
+    22, 26, 27, 29, 32, 35, 40, 48,
+    26, 27, 29, 32, 35, 40, 48, 58,
+    26, 27, 29, 34, 38, 46, 56, 69,
+    27, 29, 35, 38, 46, 56, 69, 83 };
 
-                flt.width  = i1_p.roi.width  - (mc_ksz[m_xkidx[i]]&~1);
-                flt.height = i1_p.roi.height - (mc_ksz[m_ykidx[i]]&~1);
-                shift = (mc_ksz[m_xkidx[i]]>>1) + (mc_ksz[m_ykidx[i]]>>1)*m_step/sizeof(float);
+/* MWDVQM difference of one pair of 8x8 float blocks, the blocks are overwritten */
+inline void MWDVQMBlock(float *fb1, float *fb2, const float *impm, float &avg_bdif, float &max_bdif)
+{
+    float f1c, f2c;
 
-                flt_h.width  = i1_p.roi.width  - (mc_ksz[m_xkidx[i]]&~1);
-                flt_h.height = i1_p.roi.height;
-                shift_h = (mc_ksz[m_xkidx[i]]>>1);
+    ippiDCT8x8Fwd_32f_C1I(fb1); ippiDCT8x8Fwd_32f_C1I(fb2);
+    f1c = (fb1[0]>0.0f) ? powf((fb1[0] / 1024.0f), 0.65f) / fb1[0] : 1.0f;
+    f2c = (fb2[0]>0.0f) ? powf((fb2[0] / 1024.0f), 0.65f) / fb2[0] : 1.0f;
+    ippsMulC_32f_I(f1c,fb1,64); ippsMulC_32f_I(f2c,fb2,64); ippsSub_32f_I(fb2,fb1,64); ippsMul_32f_I(impm,fb1,64); ippsAbs_32f_I(fb1,64);
+    ippsMax_32f(fb1,64,&max_bdif); ippsMean_32f(fb1,64,&avg_bdif,ippAlgHintAccurate);
+}
+#endif
 
-                mclFilterRow_32f_C1R(m_mu1+shift_h,     m_step, m_tmp+shift_h,   m_step, flt_h, mc_krn[m_xkidx[i]], mc_ksz[m_xkidx[i]], mc_ksz[m_xkidx[i]]>>1);
-                mclFilterColumn_32f_C1R(m_tmp+shift,    m_step, m_mu1+shift,     m_step, flt,   mc_krn[m_ykidx[i]], mc_ksz[m_ykidx[i]], mc_ksz[m_ykidx[i]]>>1);
-                mclFilterRow_32f_C1R(m_mu2+shift_h,     m_step, m_tmp+shift_h,   m_step, flt_h, mc_krn[m_xkidx[i]], mc_ksz[m_xkidx[i]], mc_ksz[m_xkidx[i]]>>1);
-                mclFilterColumn_32f_C1R(m_tmp+shift,    m_step, m_mu2+shift,     m_step, flt,   mc_krn[m_ykidx[i]], mc_ksz[m_ykidx[i]], mc_ksz[m_ykidx[i]]>>1);
-                mclFilterRow_32f_C1R(m_mu1_sq+shift_h,  m_step, m_tmp+shift_h,   m_step, flt_h, mc_krn[m_xkidx[i]], mc_ksz[m_xkidx[i]], mc_ksz[m_xkidx[i]]>>1);
-                mclFilterColumn_32f_C1R(m_tmp+shift,    m_step, m_mu1_sq+shift,  m_step, flt,   mc_krn[m_ykidx[i]], mc_ksz[m_ykidx[i]], mc_ksz[m_ykidx[i]]>>1);
-                mclFilterRow_32f_C1R(m_mu2_sq+shift_h,  m_step, m_tmp+shift_h,   m_step, flt_h, mc_krn[m_xkidx[i]], mc_ksz[m_xkidx[i]], mc_ksz[m_xkidx[i]]>>1);
-                mclFilterColumn_32f_C1R(m_tmp+shift,    m_step, m_mu2_sq+shift,  m_step, flt,   mc_krn[m_ykidx[i]], mc_ksz[m_ykidx[i]], mc_ksz[m_ykidx[i]]>>1);
-                mclFilterRow_32f_C1R(m_mu1_mu2+shift_h, m_step, m_tmp+shift_h,   m_step, flt_h, mc_krn[m_xkidx[i]], mc_ksz[m_xkidx[i]], mc_ksz[m_xkidx[i]]>>1);
-                mclFilterColumn_32f_C1R(m_tmp+shift,    m_step, m_mu1_mu2+shift, m_step, flt,   mc_krn[m_ykidx[i]], mc_ksz[m_ykidx[i]], mc_ksz[m_ykidx[i]]>>1);
+#if !defined(NO_IPP) && !defined(LEGACY_IPP)
+const int mmsim_depth = 5;
+#endif
 
-                testFastSSIM_32f(m_mu1+shift, m_step, m_mu2+shift, m_step, m_mu1_sq+shift, m_step,
-                   m_mu2_sq+shift, m_step, m_mu1_mu2+shift, m_step, m_tmp+shift, m_step, flt, m_ssim_c1, m_ssim_c2);
+/* Intermediates of the current frame pair shared by all evaluators: float planes, pyramid levels and
+   plane statistics. Entries are built on first request and dropped by Retire() once the frame is done,
+   the memory is kept for the next frame. Different planes may be requested from different threads */
+class CFrameStore {
+public:
+    enum { STAT_NORM_L2, STAT_MWDVQM_MEAN, STAT_MWDVQM_MAX, STAT_COUNT };
 
-                mclMean_32f_C1R(m_tmp+shift, m_step, flt, idx[i]);
+private:
+    CReader  *m_i1, *m_i2;
+    float    *m_f[4][2];
+    int32_t   m_fstep[4];
+    bool      m_fvalid[4];
+    double    m_stat[4][STAT_COUNT];
+    bool      m_svalid[4][STAT_COUNT];
+    int32_t   m_band;
+    SPixelKernels m_px;     // Kernels for the sample type of the stream
+    int8_t    m_ident[4];   // Planes of both inputs are byte identical, -1 until checked
+    uint8_t  *m_prev[4][2]; // Planes of the previous frame for the repeat check
+    uint32_t  m_num_prev;
+    bool      m_prev_valid;
+    uint64_t  m_ident_cnt, m_repeat_cnt;
+    bool      m_failed[4];  // A buffer reserved on request could not be allocated, per plane for concurrent requests
+#if !defined(NO_IPP) && !defined(LEGACY_IPP)
+    Ipp32f   *m_pyr[4][2];  // Levels 1..mmsim_depth-1 side by side
+    int32_t   m_pstep[4];
+    int32_t   m_levels[4];  // Number of valid levels including level 0
+    IppiResizeSpec_32f *m_pSpec[4];
+    Ipp8u    *m_pBuffer[4];
+    EFloatFormat m_ff;      // Storage format of MS-SSIM planes and pyramid
+    uint16_t *m_h[4][2];    // FP16/BF16 level 0
+    uint16_t *m_hpyr[4][2]; // FP16/BF16 levels 1..mmsim_depth-1, laid out as m_pyr
+    int32_t   m_hstep[4];
+    bool      m_hvalid[4];
+#endif
 
-                val.push_back(idx[i]); avg[j++] += idx[i];
-            }
+public:
+    CFrameStore(void): m_i1(0), m_i2(0), m_band(0), m_num_prev(0), m_prev_valid(false), m_ident_cnt(0), m_repeat_cnt(0) {
+        for (int32_t i = 0; i < 4; i++) {
+            m_f[i][0] = m_f[i][1] = 0; m_fstep[i] = 0; m_fvalid[i] = false;
+            m_ident[i] = -1; m_prev[i][0] = m_prev[i][1] = 0; m_failed[i] = false;
+            for (int32_t j = 0; j < STAT_COUNT; j++) { m_stat[i][j] = 0.0; m_svalid[i][j] = false; }
+#if !defined(NO_IPP) && !defined(LEGACY_IPP)
+            m_pyr[i][0] = m_pyr[i][1] = 0; m_pstep[i] = 0; m_levels[i] = 0; m_pSpec[i] = 0; m_pBuffer[i] = 0;
+            m_h[i][0] = m_h[i][1] = 0; m_hpyr[i][0] = m_hpyr[i][1] = 0; m_hstep[i] = 0; m_hvalid[i] = false;
+#endif
+        }
+#if !defined(NO_IPP) && !defined(LEGACY_IPP)
+        m_ff = FP32;
+#endif
+    };
+    ~CFrameStore(void) {
+        for (int32_t i = 0; i < 4; i++) {
+            mclFree(m_f[i][0]); mclFree(m_f[i][1]);
+            mclFree(m_prev[i][0]); mclFree(m_prev[i][1]);
+#if !defined(NO_IPP) && !defined(LEGACY_IPP)
+            mclFree(m_pyr[i][0]); mclFree(m_pyr[i][1]);
+            ippsFree(m_pSpec[i]); ippsFree(m_pBuffer[i]);
+            mclFree(m_h[i][0]); mclFree(m_h[i][1]); mclFree(m_hpyr[i][0]); mclFree(m_hpyr[i][1]);
+#endif
+        }
+    };
+
+    void InitFrameParams(CReader *i1, CReader *i2) {
+        m_i1 = i1; m_i2 = i2;
+        mclGetPixelKernels(i1->GetBitDepth(), m_px);
+    };
+    const SPixelKernels& GetPixelKernels(void) const { return m_px; };
+
+    /* Output rows per band for evaluators working under a memory budget, 0 means whole planes.
+       Banded evaluators read the reader planes directly and leave the float planes alone */
+    void SetBandHeight(int32_t band) { m_band = band; };
+    int32_t GetBandHeight(void) const { return m_band; };
+
+    /* Frame is done, everything has to be rebuilt for the next one */
+    void Retire(void) {
+        for (int32_t i = 0; i < 4; i++) {
+            m_fvalid[i] = false;
+            if (m_ident[i] > 0) m_ident_cnt++;
+            m_ident[i] = -1;
+            for (int32_t j = 0; j < STAT_COUNT; j++) m_svalid[i][j] = false;
+#if !defined(NO_IPP) && !defined(LEGACY_IPP)
+            m_levels[i] = 0; m_hvalid[i] = false;
+#endif
+        }
+    };
+
+    /* Byte identical planes have known results (MSE 0, SSIM 1, ...), evaluators skip their work */
+    bool IsIdentical(uint32_t i) {
+        if (m_ident[i] < 0) {
+            SImage i1_p, i2_p;
+
+            m_i1->GetFrame(i, &i1_p); m_i2->GetFrame(i, &i2_p);
+            m_ident[i] = mclIsEqual_C1R(i1_p.data, i1_p.step, i2_p.data, i2_p.step, i1_p.roi, m_i1->GetBitDepth()) ? 1 : 0;
+        }
+        return m_ident[i] > 0;
+    };
+
+    /* Both inputs repeating their previous frame repeat its results too. Keeps a copy of the compared planes */
+    int32_t ReserveRepeatCheck(uint32_t num_planes) {
+        for (uint32_t i = 0; i < num_planes; i++) {
+            SImage plane;
+
+            m_i1->GetFrame(i, &plane);
+            m_prev[i][0] = mclMalloc((size_t)plane.roi.width * plane.roi.height, m_i1->GetBitDepth());
+            m_prev[i][1] = mclMalloc((size_t)plane.roi.width * plane.roi.height, m_i1->GetBitDepth());
+            if (!m_prev[i][0] || !m_prev[i][1]) return MCL_ERR_MEMORY_ALLOC;
+        }
+        m_num_prev = num_planes; m_prev_valid = false;
+
+        return MCL_ERR_NONE;
+    };
+    bool CheckRepeat(void) {
+        EBitDepth bd = m_i1->GetBitDepth();
+        int32_t   bpp = (bd == D008) ? 1 : 2;
+        bool      repeat = m_prev_valid;
+        uint32_t  i;
+        int32_t   img;
+
+        if (!m_num_prev) return false;
+
+        for (i = 0; i < m_num_prev && repeat; i++) {
+            for (img = 0; img < 2 && repeat; img++) {
+                SImage p;
+
+                (img ? m_i2 : m_i1)->GetFrame(i, &p);
+                if (p.roi.width && p.roi.height) repeat = mclIsEqual_C1R(p.data, p.step, m_prev[i][img], p.roi.width * bpp, p.roi, bd);
+            }
+        }
+        if (repeat) { m_repeat_cnt++; return true; }
+
+        for (i = 0; i < m_num_prev; i++) {
+            for (img = 0; img < 2; img++) {
+                SImage p;
+
+                (img ? m_i2 : m_i1)->GetFrame(i, &p);
+                for (int32_t y = 0; y < p.roi.height; y++) memcpy(m_prev[i][img] + (size_t)y * p.roi.width * bpp, p.data + (size_t)y * p.step, (size_t)p.roi.width * bpp);
+            }
+        }
+        m_prev_valid = true;
+        return false;
+    };
+    uint64_t GetIdenticalCount(void) const { return m_ident_cnt; };
+    uint64_t GetRepeatCount(void) const { return m_repeat_cnt; };
+
+    /* Float planes */
+    int32_t ReserveFloat(uint32_t i) {
+        SImage plane;
+
+        if (m_f[i][0] && m_f[i][1]) return MCL_ERR_NONE;
+
+        m_i1->GetFrame(i, &plane);
+        m_f[i][0] = mclMalloc_32f_C1(plane.roi.width, plane.roi.height, &m_fstep[i]);
+        m_f[i][1] = mclMalloc_32f_C1(plane.roi.width, plane.roi.height, &m_fstep[i]);
+        if (!m_f[i][0] || !m_f[i][1]) { m_failed[i] = true; return MCL_ERR_MEMORY_ALLOC; }
+
+        return MCL_ERR_NONE;
+    };
+    /* Consumers reserve their buffers in AllocateResourses(). Requests that have to reserve and fail return 0
+       with step 0 and are reported by Failed() once the frame is done */
+    bool Failed(void) const { return m_failed[0] || m_failed[1] || m_failed[2] || m_failed[3]; };
+    // Direct access for producers filling the plane themselves, CommitFloat() marks it as built
+    float* AcquireFloat(uint32_t i, int32_t img, int32_t &step) {
+        step = 0;
+        if (ReserveFloat(i) != MCL_ERR_NONE) return 0;
+        step = m_fstep[i];
+        return m_f[i][img];
+    };
+    void CommitFloat(uint32_t i) { m_fvalid[i] = true; };
+    bool HasFloat(uint32_t i) const { return m_fvalid[i]; };
+    const float* GetFloat(uint32_t i, int32_t img, int32_t &step) {
+        step = 0;
+        if (!m_fvalid[i]) {
+            SImage i1_p, i2_p;
+
+            if (ReserveFloat(i) != MCL_ERR_NONE) return 0;
+            m_i1->GetFrame(i, &i1_p); m_i2->GetFrame(i, &i2_p);
+            m_px.convert_32f(i1_p.data, i1_p.step, m_f[i][0], m_fstep[i], i1_p.roi);
+            m_px.convert_32f(i2_p.data, i2_p.step, m_f[i][1], m_fstep[i], i2_p.roi);
+            m_fvalid[i] = true;
+        }
+        step = m_fstep[i];
+        return m_f[i][img];
+    };
+
+    /* Plane statistics */
+    bool GetStat(uint32_t i, int32_t id, double &value) const {
+        if (!m_svalid[i][id]) return false;
+        value = m_stat[i][id];
+        return true;
+    };
+    void SetStat(uint32_t i, int32_t id, double value) { m_stat[i][id] = value; m_svalid[i][id] = true; };
+    double GetNormL2(uint32_t i) {
+        if (!m_svalid[i][STAT_NORM_L2]) {
+            SImage i1_p, i2_p;
+
+            m_i1->GetFrame(i, &i1_p); m_i2->GetFrame(i, &i2_p);
+            if (IsIdentical(i)) m_stat[i][STAT_NORM_L2] = 0.0;
+            else m_px.normDiff_L2(i1_p.data, i1_p.step, i2_p.data, i2_p.step, i1_p.roi, m_stat[i][STAT_NORM_L2]);
+            m_svalid[i][STAT_NORM_L2] = true;
+        }
+        return m_stat[i][STAT_NORM_L2];
+    };
+
+#if !defined(NO_IPP) && !defined(LEGACY_IPP)
+    // Levels 1 and up are stored next to each other in rows of the level 1 buffer
+    static int32_t levelOffset(int32_t width, int32_t scale) {
+        int32_t xofs = 0;
+        for (int32_t k = 1; k < scale; k++) xofs += width >> k;
+        return xofs;
+    };
+
+    /* Half precision planes halve the footprint of MS-SSIM inputs on very large frames,
+       has to be selected before anything is reserved */
+    void SetFloatFormat(EFloatFormat ff) { m_ff = ff; };
+    EFloatFormat GetFloatFormat(void) const { return m_ff; };
+    int32_t ReserveHalf(uint32_t i) {
+        SImage plane;
+
+        if (m_h[i][0] && m_h[i][1]) return MCL_ERR_NONE;
+
+        m_i1->GetFrame(i, &plane);
+        m_hstep[i] = (plane.roi.width * (int32_t)sizeof(uint16_t) + 63) & ~63;
+        m_h[i][0] = (uint16_t*)mclMalloc((m_hstep[i] >> 1) * plane.roi.height, D016);
+        m_h[i][1] = (uint16_t*)mclMalloc((m_hstep[i] >> 1) * plane.roi.height, D016);
+        if (!m_h[i][0] || !m_h[i][1]) { m_failed[i] = true; return MCL_ERR_MEMORY_ALLOC; }
+
+        return MCL_ERR_NONE;
+    };
+    const uint16_t* GetHalf(uint32_t i, int32_t img, int32_t &step) {
+        step = 0;
+        if (!m_hvalid[i]) {
+            SImage i1_p, i2_p;
+
+            if (ReserveHalf(i) != MCL_ERR_NONE) return 0;
+            m_i1->GetFrame(i, &i1_p); m_i2->GetFrame(i, &i2_p);
+            mclConvert__u16f_C1R(i1_p.data, i1_p.step, m_h[i][0], m_hstep[i], i1_p.roi, m_i1->GetBitDepth(), m_ff);
+            mclConvert__u16f_C1R(i2_p.data, i2_p.step, m_h[i][1], m_hstep[i], i2_p.roi, m_i1->GetBitDepth(), m_ff);
+            m_hvalid[i] = true;
+        }
+        step = m_hstep[i];
+        return m_h[i][img];
+    };
+
+    /* Dyadic pyramid for MS-SSIM, level 0 is the float plane */
+    int32_t ReservePyramid(uint32_t i) {
+        SImage   plane;
+        IppiSize sSize, dSize;
+        int      specSize = 0, initSize = 0, bufSize = 0;
+        int      specSizeMax = 0, bufSizeMax = 0;
+
+        if (m_ff != FP32) { // 2x2 box average on half planes, no resize engine
+            if (ReserveHalf(i) != MCL_ERR_NONE) return MCL_ERR_MEMORY_ALLOC;
+            if (m_hpyr[i][0] && m_hpyr[i][1]) return MCL_ERR_NONE;
+
+            m_i1->GetFrame(i, &plane);
+            m_pstep[i] = m_hstep[i];
+            m_hpyr[i][0] = (uint16_t*)mclMalloc((m_pstep[i] >> 1) * std::max(1, plane.roi.height >> 1), D016);
+            m_hpyr[i][1] = (uint16_t*)mclMalloc((m_pstep[i] >> 1) * std::max(1, plane.roi.height >> 1), D016);
+            return (m_hpyr[i][0] && m_hpyr[i][1]) ? MCL_ERR_NONE : MCL_ERR_MEMORY_ALLOC;
+        }
+
+        if (ReserveFloat(i) != MCL_ERR_NONE) return MCL_ERR_MEMORY_ALLOC;
+        if (m_pyr[i][0] && m_pyr[i][1]) return MCL_ERR_NONE;
+
+        m_i1->GetFrame(i, &plane);
+        m_pyr[i][0] = mclMalloc_32f_C1(plane.roi.width, std::max(1, plane.roi.height >> 1), &m_pstep[i]);
+        m_pyr[i][1] = mclMalloc_32f_C1(plane.roi.width, std::max(1, plane.roi.height >> 1), &m_pstep[i]);
+        if (!m_pyr[i][0] || !m_pyr[i][1]) return MCL_ERR_MEMORY_ALLOC;
+
+        // Over-allocate temporary buffers for resize to cover odd sizes
+        sSize = plane.roi;
+        for (int l = 0; l<mmsim_depth; l++) {
+            dSize.width = sSize.width >> 1;
+            dSize.height = sSize.height >> 1;
+            ippiResizeGetSize_32f(sSize, dSize, ippSuper, 0, &specSize, &initSize);
+            if (specSize > specSizeMax) specSizeMax = specSize;
+            sSize = dSize;
+        }
+        m_pSpec[i] = (IppiResizeSpec_32f*)ippsMalloc_8u(2 * specSizeMax);
+        if (!m_pSpec[i])  return MCL_ERR_MEMORY_ALLOC;
+
+        sSize = plane.roi;
+        for (int l = 0; l<mmsim_depth; l++) {
+            dSize.width = sSize.width >> 1;
+            dSize.height = sSize.height >> 1;
+            ippiResizeSuperInit_32f(sSize, dSize, m_pSpec[i]);
+            ippiResizeGetBufferSize_32f(m_pSpec[i], dSize, 1, &bufSize);
+            if (bufSize > bufSizeMax) bufSizeMax = bufSize;
+            sSize = dSize;
+        }
+        m_pBuffer[i] = ippsMalloc_8u(2 * bufSizeMax);
+        if (!m_pBuffer[i])  return MCL_ERR_MEMORY_ALLOC;
+
+        return MCL_ERR_NONE;
+    };
+    const uint16_t* GetHalfLevel(uint32_t i, int32_t img, int32_t scale, int32_t &step) {
+        SImage    plane;
+        IppiSize  ds_roi;
+
+        if (!scale) return GetHalf(i, img, step);
+        step = 0;
+        if (ReservePyramid(i) != MCL_ERR_NONE) { m_failed[i] = true; return 0; }
+
+        m_i1->GetFrame(i, &plane);
+        if (!m_levels[i]) { if (!GetHalf(i, 0, step)) return 0; m_levels[i] = 1; }
+        for (int32_t k = m_levels[i]; k <= scale; k++) {
+            int32_t sstep;
+
+            ds_roi.width = (plane.roi.width >> (k - 1)) >> 1; ds_roi.height = (plane.roi.height >> (k - 1)) >> 1;
+            for (int32_t n = 0; n < 2; n++) {
+                const uint16_t *pSrc = GetHalfLevel(i, n, k - 1, sstep);
+                mclDownsample2x_16f_C1R(pSrc, sstep, m_hpyr[i][n] + levelOffset(plane.roi.width, k), m_pstep[i], ds_roi, m_ff);
+            }
+            m_levels[i] = k + 1;
+        }
+
+        step = m_pstep[i];
+        return m_hpyr[i][img] + levelOffset(plane.roi.width, scale);
+    };
+    // Level in the storage format selected by SetFloatFormat()
+    const void* GetLevel(uint32_t i, int32_t img, int32_t scale, int32_t &step) {
+        SImage    plane;
+        IppiPoint dstOffset = { 0, 0 };
+        IppiSize  pr_roi, ds_roi;
+
+        if (m_ff != FP32) return GetHalfLevel(i, img, scale, step);
+        if (!scale) return GetFloat(i, img, step);
+        step = 0;
+        if (ReservePyramid(i) != MCL_ERR_NONE) { m_failed[i] = true; return 0; }
+
+        m_i1->GetFrame(i, &plane);
+        if (!m_levels[i]) { if (!GetFloat(i, 0, step)) return 0; m_levels[i] = 1; }
+        for (int32_t k = m_levels[i]; k <= scale; k++) {
+            int32_t sstep;
+
+            pr_roi.width = plane.roi.width >> (k - 1); pr_roi.height = plane.roi.height >> (k - 1);
+            ds_roi.width = pr_roi.width >> 1; ds_roi.height = pr_roi.height >> 1;
+            pr_roi.width &= ~0x1; pr_roi.height &= ~0x1; // Possibly discard last column/row to match reference MS-SSIM code
+            ippiResizeSuperInit_32f(pr_roi, ds_roi, m_pSpec[i]);
+            for (int32_t n = 0; n < 2; n++) {
+                const Ipp32f *pSrc = (const Ipp32f*)GetLevel(i, n, k - 1, sstep);
+                ippiResizeSuper_32f_C1R(pSrc, sstep, m_pyr[i][n] + levelOffset(plane.roi.width, k), m_pstep[i], dstOffset, ds_roi, m_pSpec[i], m_pBuffer[i]);
+            }
+            m_levels[i] = k + 1;
+        }
+
+        step = m_pstep[i];
+        return m_pyr[i][img] + levelOffset(plane.roi.width, scale);
+    };
+#endif
+};
+
+const int32_t screen_block = 4;               // Screening proxy compares luma means of blocks this large
+const int32_t fused_band_bytes = 256 * 1024; // Working set of one band, sized to stay in L2
+
+/* Walks every plane pair once in row bands and feeds all per-pixel consumers while the band is in cache:
+   squared error for MSE/PSNR/APSNR, float conversion for SSIM/MS-SSIM and 8x8 DCT blocks for MWDVQM.
+   Results go to the frame store. Only planes with at least two such consumers are fused, the others
+   are built lazily by the store on request */
+class CFusedPass {
+private:
+    CReader     *m_i1, *m_i2;
+    CFrameStore *m_store;
+    uint32_t     m_num_planes, m_mask[4];
+#if !defined(NO_IPP) && !defined(LEGACY_IPP)
+    float        m_impm[64];
+#endif
+
+    void processPlane(uint32_t i) {
+        SImage    i1_p, i2_p;
+        EBitDepth bd = m_i1->GetBitDepth();
+        const SPixelKernels &px = m_store->GetPixelKernels();
+        int32_t   bpp = (bd == D008) ? 1 : 2, y, band, fstep = 0;
+        float    *pF1 = 0, *pF2 = 0;
+        double    sse = 0.0;
+        ImageSize roi;
+#if !defined(NO_IPP) && !defined(LEGACY_IPP)
+        float     bmean = 0.0f, bmax = 0.0f;
+#endif
+
+        // Evaluators have known results for identical planes and need none of the shared data
+        if (m_store->IsIdentical(i)) return;
+
+        m_i1->GetFrame(i, &i1_p); m_i2->GetFrame(i, &i2_p);
+
+        if (m_mask[i] & FUSED_FLOAT) {
+            pF1 = m_store->AcquireFloat(i, 0, fstep);
+            pF2 = m_store->AcquireFloat(i, 1, fstep);
+        }
+
+        band = fused_band_bytes / (i1_p.roi.width * (2 * bpp + ((m_mask[i] & FUSED_FLOAT) ? 2 * (int32_t)sizeof(float) : 0)));
+        band = std::max(8, band & ~7);
+
+        for (y = 0; y < i1_p.roi.height; y += band) {
+            const uint8_t *p1 = i1_p.data + y * i1_p.step, *p2 = i2_p.data + y * i2_p.step;
+
+            roi.width = i1_p.roi.width; roi.height = std::min(band, i1_p.roi.height - y);
+
+            if (m_mask[i] & FUSED_SSE) {
+                double norm = 0.0;
+                px.normDiff_L2(p1, i1_p.step, p2, i2_p.step, roi, norm);
+                sse += floor(norm * norm + 0.5); // Sum of squared integer differences is integer
+            }
+            if (m_mask[i] & FUSED_FLOAT) {
+                px.convert_32f(p1, i1_p.step, (float*)((uint8_t*)pF1 + y * fstep), fstep, roi);
+                px.convert_32f(p2, i2_p.step, (float*)((uint8_t*)pF2 + y * fstep), fstep, roi);
+            }
+#if !defined(NO_IPP) && !defined(LEGACY_IPP)
+            if (m_mask[i] & FUSED_MWDVQM) {
+                float     fb1[64], fb2[64], max_bdif, avg_bdif;
+                ImageSize sz8x8 = { 8, 8 };
+
+                for (int32_t m = y >> 3; m < ((y + roi.height) >> 3); m++) {
+                    for (int32_t k = 0; k < (roi.width >> 3); k++) {
+                        if (m_mask[i] & FUSED_FLOAT) { // Same block origin as the byte based addressing below
+                            ippiCopy_32f_C1R((float*)((uint8_t*)pF1 + (m << 3) * fstep) + (k << 3) / bpp, fstep, fb1, 8 * sizeof(float), sz8x8);
+                            ippiCopy_32f_C1R((float*)((uint8_t*)pF2 + (m << 3) * fstep) + (k << 3) / bpp, fstep, fb2, 8 * sizeof(float), sz8x8);
+                        } else if (bd == D008) {
+                            ippiConvert_8u32f_C1R((uint8_t*)(i1_p.data+((m*i1_p.step+k)<<3)), i1_p.step, fb1, 8*sizeof(float), sz8x8);
+                            ippiConvert_8u32f_C1R((uint8_t*)(i2_p.data+((m*i2_p.step+k)<<3)), i2_p.step, fb2, 8*sizeof(float), sz8x8);
+                        } else {
+                            ippiConvert_16u32f_C1R((uint16_t*)(i1_p.data+((m*i1_p.step+k)<<3)), i1_p.step, fb1, 8*sizeof(float), sz8x8);
+                            ippiConvert_16u32f_C1R((uint16_t*)(i2_p.data+((m*i2_p.step+k)<<3)), i2_p.step, fb2, 8*sizeof(float), sz8x8);
+                        }
+                        MWDVQMBlock(fb1, fb2, m_impm, avg_bdif, max_bdif);
+                        bmean += avg_bdif; bmax = std::max(bmax, max_bdif);
+                    }
+                }
+            }
+#endif
+        }
+
+        if (m_mask[i] & FUSED_SSE) m_store->SetStat(i, CFrameStore::STAT_NORM_L2, sqrt(sse));
+        if (m_mask[i] & FUSED_FLOAT) m_store->CommitFloat(i);
+#if !defined(NO_IPP) && !defined(LEGACY_IPP)
+        if (m_mask[i] & FUSED_MWDVQM) {
+            m_store->SetStat(i, CFrameStore::STAT_MWDVQM_MEAN, bmean);
+            m_store->SetStat(i, CFrameStore::STAT_MWDVQM_MAX, bmax);
+        }
+#endif
+    }
+
+public:
+    enum { FUSED_SSE = 1, FUSED_FLOAT = 2, FUSED_MWDVQM = 4 };
+
+    CFusedPass(void): m_i1(0), m_i2(0), m_store(0), m_num_planes(0) {
+        for (int32_t i = 0; i < 4; i++) m_mask[i] = 0;
+#if !defined(NO_IPP) && !defined(LEGACY_IPP)
+        for (int32_t i = 0; i < 64; i++) m_impm[i] = 1.0f/(float)mpegmatrix[i];
+#endif
+    };
+    ~CFusedPass(void) {};
+
+    int32_t Init(CReader *i1, CReader *i2, CFrameStore *store, const Component &cmps) {
+        m_i1 = i1; m_i2 = i2; m_store = store;
+        m_num_planes = (uint32_t)cmps.size() - 1;
+
+        for (uint32_t i = 0; i < m_num_planes; i++) {
+            uint32_t cm = cmps[i].second | cmps[m_num_planes].second, groups = 0;
+
+            m_mask[i] = 0;
+#if !defined(NO_IPP) && !defined(LEGACY_IPP)
+            if (cm & MASK_MSE)                                    { m_mask[i] |= FUSED_SSE;    groups++; }
+            if ((cm & ((store->GetFloatFormat() == FP32) ? (MASK_SSIM | MASK_MSSIM | MASK_ARTIFACTS) : MASK_SSIM)) && !store->GetBandHeight()) { m_mask[i] |= FUSED_FLOAT; groups++; }
+            if (cm & MASK_MWDVQM)                                 { m_mask[i] |= FUSED_MWDVQM; groups++; }
+#else
+            if (cm & MASK_MSE)                                    { m_mask[i] |= FUSED_SSE;    groups++; }
+            if ((cm & MASK_SSIM) && !store->GetBandHeight())      { m_mask[i] |= FUSED_FLOAT;  groups++; }
+#endif
+            if (groups < 2) { m_mask[i] = 0; continue; } // Nothing to share
+
+            if ((m_mask[i] & FUSED_FLOAT) && m_store->ReserveFloat(i) != MCL_ERR_NONE) return MCL_ERR_MEMORY_ALLOC;
+        }
+
+        return MCL_ERR_NONE;
+    };
+
+    bool IsActive(void) const { return (m_mask[0] | m_mask[1] | m_mask[2] | m_mask[3]) != 0; };
+
+    void Run(void) {
+        int32_t p;
+
+#if defined(_OPENMP)
+        #pragma omp parallel for schedule(dynamic,1)
+#endif
+        for (p = 0; p < (int32_t)m_num_planes; p++) {
+            if (m_mask[p]) processPlane(p);
+        }
+    };
+};
+
+/* Intermediate results behind the requested metrics, in the order they are produced. Metrics asked for overall
+   need their intermediates on every plane, MS-SSIM needs SSIM on all scales, ARTIFACTS on the two coarsest ones.
+   Costs are rough operation counts per picture, good for comparing plans rather than predicting run time */
+class CMetricPlan {
+public:
+    typedef enum { NODE_SSE, NODE_CONVERT, NODE_PYRAMID, NODE_SSIM, NODE_SSIM_FAST, NODE_SSIM_BOX, NODE_MWDVQM, NODE_UQI, NODE_TEMPORAL } ENode;
+
+private:
+    struct SStep {
+        ENode                 node;
+        int32_t               plane, scale;
+        double                cost;
+        std::vector< int32_t > deps;
+        std::string           users;
+    };
+    std::vector< SStep > m_steps;
+    uint32_t             m_scales[4]; // SSIM scales of every plane as a bit mask
+    uint32_t             m_nodes;     // Bit per ENode present in the plan
+
+    int32_t add(ENode node, int32_t plane, int32_t scale, double cost, int32_t dep, const std::string &users) {
+        SStep step;
+
+        step.node = node; step.plane = plane; step.scale = scale; step.cost = cost; step.users = users;
+        if (dep >= 0) step.deps.push_back(dep);
+        m_steps.push_back(step);
+        m_nodes |= 1 << node;
+        return (int32_t)m_steps.size() - 1;
+    };
+
+    // Requested metrics of the mask the plane contributes to
+    static std::string users(const Component &cmps, int32_t plane, uint32_t mask) {
+        static const struct { uint32_t mask; const char *name; } names[] = {
+            { MASK_PSNR, "PSNR" }, { MASK_APSNR, "APSNR" }, { MASK_SSIM, "SSIM" },
+#if !defined(NO_IPP)
+            { MASK_MSSIM, "MSSIM" }, { MASK_ARTIFACTS, "ARTIFACTS" }, { MASK_MWDVQM, "MWDVQM" }, { MASK_UQI, "UQI" },
+#endif
+            { MASK_SSIM_FAST, "SSIM_FAST" }, { MASK_SSIM_BOX, "SSIM_BOX" }, { MASK_TPSNR, "TPSNR" }, { MASK_TFLICKER, "TFLICKER" } };
+        size_t      overall = cmps.size() - 1;
+        std::string str;
+
+        for (size_t k = 0; k < sizeof(names) / sizeof(names[0]); k++) {
+            if (!(names[k].mask & mask)) continue;
+            if (cmps[plane].second & names[k].mask) str += std::string(" ") + cmps[plane].first + "-" + names[k].name;
+            if (cmps[overall].second & names[k].mask) str += std::string(" ") + names[k].name;
+        }
+        return str;
+    };
+
+public:
+    CMetricPlan(void): m_nodes(0) { m_scales[0] = m_scales[1] = m_scales[2] = m_scales[3] = 0; };
+
+    void Build(const Component &cmps, CReader *i1) {
+        const double ssim_taps = 5 * 2 * 11 + 20; // Five separable 11-tap Gaussian maps and the index
+        uint32_t     num_planes = (uint32_t)cmps.size() - 1;
+
+        m_steps.clear(); m_nodes = 0;
+        for (uint32_t i = 0; i < num_planes; i++) {
+            uint32_t cm = cmps[i].second | cmps[num_planes].second, scales = 0;
+            SImage   plane;
+            double   px;
+
+            i1->GetFrame(i, &plane);
+            px = (double)plane.roi.width * plane.roi.height;
+
+            if (cm & (MASK_MSE | MASK_PSNR | MASK_APSNR)) add(NODE_SSE, i, 0, 3.0 * px, -1, users(cmps, i, MASK_MSE | MASK_PSNR | MASK_APSNR));
+            if (cm & MASK_SSIM) scales |= 1;
+#if !defined(NO_IPP) && !defined(LEGACY_IPP)
+            if (cm & MASK_MSSIM) scales |= (1 << mmsim_depth) - 1;
+            if (cm & MASK_ARTIFACTS) scales |= 3 << (mmsim_depth - 2);
+#endif
+            m_scales[i] = scales;
+            if (scales) {
+                int32_t level = add(NODE_CONVERT, i, 0, 2.0 * px, -1, "");
+
+                for (int32_t k = 0; (scales >> k) != 0; k++) {
+                    double kpx = px / (double)(1 << (2 * k));
+
+                    if (k) level = add(NODE_PYRAMID, i, k, 2.0 * 10.0 * kpx, level, "");
+                    if (!(scales & (1 << k))) continue;
+#if !defined(NO_IPP) && !defined(LEGACY_IPP)
+                    add(NODE_SSIM, i, k, ssim_taps * kpx, level, users(cmps, i, ((k == 0) ? MASK_SSIM : 0) | MASK_MSSIM | ((k >= mmsim_depth - 2) ? MASK_ARTIFACTS : 0)));
+#else
+                    add(NODE_SSIM, i, k, ssim_taps * kpx, level, users(cmps, i, MASK_SSIM));
+#endif
+                }
+            }
+            if (cm & MASK_SSIM_FAST) add(NODE_SSIM_FAST, i, 0, 12.0 * px, -1, users(cmps, i, MASK_SSIM_FAST));
+            if (cm & MASK_SSIM_BOX)  add(NODE_SSIM_BOX, i, 0, 24.0 * px, -1, users(cmps, i, MASK_SSIM_BOX));
+            if (cm & (MASK_TPSNR | MASK_TFLICKER)) add(NODE_TEMPORAL, i, 0, 6.0 * px, -1, users(cmps, i, MASK_TPSNR | MASK_TFLICKER));
+#if !defined(NO_IPP)
+            if (cm & MASK_MWDVQM)    add(NODE_MWDVQM, i, 0, 40.0 * px, -1, users(cmps, i, MASK_MWDVQM));
+            if (cm & MASK_UQI)       add(NODE_UQI, i, 0, 50.0 * px, -1, users(cmps, i, MASK_UQI));
+#endif
+        }
+    };
+
+    bool     Needs(ENode node) const          { return ((m_nodes >> node) & 1) != 0; };
+    uint32_t GetScales(int32_t plane) const   { return m_scales[plane]; };
+
+    double GetCost(void) const {
+        double cost = 0.0;
+
+        for (size_t s = 0; s < m_steps.size(); s++) cost += m_steps[s].cost;
+        return cost;
+    };
+
+    void Print(const Component &cmps, int32_t pictures) const {
+        static const char *names[] = { "SSE", "CONVERT", "PYRAMID", "SSIM", "SSIM_FAST", "SSIM_BOX", "MWDVQM", "UQI", "TEMPORAL" };
+
+        for (size_t s = 0; s < m_steps.size(); s++) {
+            const SStep &step = m_steps[s];
+
+            std::cout << "<plan_step=" << s + 1 << "> " << cmps[step.plane].first << " " << names[step.node];
+            if (step.node == NODE_PYRAMID || step.node == NODE_SSIM) std::cout << " " << step.scale;
+            std::cout << " cost=" << std::setprecision(3) << std::setiosflags(std::ios::fixed) << step.cost * 1e-6 << "M";
+            for (size_t d = 0; d < step.deps.size(); d++) std::cout << ((d == 0) ? " after=" : ",") << step.deps[d] + 1;
+            if (!step.users.empty()) std::cout << " for=" << step.users.substr(1);
+            std::cout << "</plan_step>" << std::endl;
+        }
+        std::cout << "<plan_metric=COST> " << GetCost() * 1e-6 << "M per picture, " << GetCost() * 1e-6 * pictures << "M for " << pictures << " pictures</plan_metric>" << std::endl;
+    };
+};
+
+class CMetricEvaluator {
+protected:
+    std::vector< std::pair< std::string, std::pair<uint32_t, uint32_t> > > metrics;
+    uint32_t   m_num_planes, c_mask[5];
+    std::vector< std::pair< uint32_t, uint32_t > > m_outputs; // Metric bit and plane of every value pushed, the overall plane is m_num_planes
+    CReader       *m_i1, *m_i2;
+    CFrameStore   *m_store;
+    const CMetricPlan *m_plan;
+public:
+    CMetricEvaluator(void): m_store(0), m_plan(0) {};
+    virtual ~CMetricEvaluator(void) {};
+    void InitFrameParams(CReader *i1, CReader *i2, CFrameStore *store) { m_i1 = i1; m_i2 = i2; m_store = store; };
+    void SetPlan(const CMetricPlan *plan) { m_plan = plan; };
+    void InitComputationParams(Component cmps,
+        std::vector< std::string > &st, std::vector< bool > &oflag, std::vector< double > &avg)
+    {
+        m_num_planes = (uint32_t)cmps.size() - 1;
+
+        for(uint32_t i=0; i < m_num_planes; i++)
+            c_mask[i] = cmps[i].second|cmps[m_num_planes].second;
+
+        c_mask[m_num_planes] = cmps[m_num_planes].second;
+
+        for(uint32_t i=0; i < metrics.size(); i++) {
+            for(uint32_t j=0; j < m_num_planes; j++) {
+                if(metrics[i].second.second&c_mask[j]) {
+                    c_mask[j] |= metrics[i].second.second;
+                    st.push_back(std::string(1, cmps[j].first) + std::string("-") + metrics[i].first);
+                    m_outputs.push_back(std::make_pair(metrics[i].second.first, j));
+                    oflag.push_back((metrics[i].second.first&cmps[j].second)!=0);
+                    avg.push_back(0.0);
+                }
+            }
+            if(metrics[i].second.first&c_mask[m_num_planes]) {
+                st.push_back(metrics[i].first);
+                m_outputs.push_back(std::make_pair(metrics[i].second.first, m_num_planes));
+                oflag.push_back(true);
+                avg.push_back(0.0);
+            }
+        }
+    };
+    /* Bytes AllocateResourses() is going to request for the given band height (0 for whole planes) */
+    virtual uint64_t EstimateMemory(int32_t /*band*/) { return 0; };
+    const std::vector< std::pair< uint32_t, uint32_t > >& GetOutputs(void) const { return m_outputs; };
+    /* Expensive evaluators are left out on frames screening passes */
+    virtual bool IsHeavy(void) const { return false; };
+    virtual int32_t AllocateResourses(void) = 0;
+    virtual void ComputeMetrics(std::vector< double > &val, std::vector< double > &avg) = 0;
+};
+
+class CPSNREvaluator: public CMetricEvaluator {
+public:
+    CPSNREvaluator() {
+        std::pair< std::string, std::pair<uint32_t, uint32_t> >   metric_pair;
+        metric_pair.first = "MSE";   metric_pair.second.first = MASK_MSE;   metric_pair.second.second = MASK_MSE;   metrics.push_back(metric_pair);
+        metric_pair.first = "PSNR";  metric_pair.second.first = MASK_PSNR;  metric_pair.second.second = MASK_PSNR;  metrics.push_back(metric_pair);
+        metric_pair.first = "APSNR"; metric_pair.second.first = MASK_APSNR; metric_pair.second.second = MASK_APSNR; metrics.push_back(metric_pair);
+    };
+    ~CPSNREvaluator(void) {};
+    int32_t AllocateResourses(void) { return 0; };
+    void ComputeMetrics(std::vector< double > &val, std::vector< double > &avg) {
+        double sum[5] = {0.0, 0.0, 0.0, 0.0, 0.0};
+        size_t i, j = val.size();
+        ESequenceType sqtype = m_i1->GetSqType();
+        int32_t p;
+
+#if defined(_OPENMP)
+        #pragma omp parallel for schedule(dynamic,1)
+#endif
+        for(p=0; p<(int32_t)m_num_planes; p++) {
+            if(c_mask[p]&MASK_MSE) {
+                SImage i1_p;
+
+                m_i1->GetFrame(p, &i1_p);
+                sum[p] = m_store->GetNormL2(p);
+                sum[p] = sum[p]*sum[p]/(double)(i1_p.roi.width*i1_p.roi.height);
+            }
+        }
+
+        for(i=0; i<m_num_planes; i++) { if(c_mask[i]&MASK_MSE) { val.push_back(sum[i]); avg[j++] += sum[i]; } }
+
+        switch(get_chromaclass(sqtype)) {
+            case C444:
+                sum[m_num_planes] = (sum[0]+sum[1]+sum[2]+sum[3])/(double)m_num_planes; break;
+            case C422:
+                sum[3] = (2.0*sum[0]+sum[1]+sum[2])/4.0; break;
+            case C420:
+            default:
+                sum[3] = (4.0*sum[0]+sum[1]+sum[2])/6.0; break;
+        }
+
+        if(c_mask[m_num_planes]&MASK_MSE) { val.push_back(sum[m_num_planes]); avg[j++] += sum[m_num_planes]; }
+        for(i=0; i<=m_num_planes; i++) { if(c_mask[i]&MASK_PSNR) { val.push_back(MSEToPSNR(sum[i], MaxError(m_i1->GetBitDepth()))); avg[j++] += sum[i]; } }
+        for(i=0; i<=m_num_planes; i++) { if(c_mask[i]&MASK_APSNR) { val.push_back(MSEToPSNR(sum[i], MaxError(m_i1->GetBitDepth()))); avg[j++] += MSEToPSNR(sum[i], MaxError(m_i1->GetBitDepth())); } }
+    };
+};
+
+typedef struct {
+    float  *mu1, *mu2, *mu1_sq, *mu2_sq, *mu1_mu2, *tmp;
+    float  *src1, *src2; // Converted band of both planes, whole planes come from the frame store
+    int32_t step;
+} ssim_buffers;
+
+class CSSIMEvaluator: public CMetricEvaluator {
+private:
+    ssim_buffers m_buf[4]; // Separate scratch per plane so planes can be processed concurrently
+    int32_t mc_ksz[3], m_xkidx[4], m_ykidx[4];
+    SFilterKernels m_xflt[4], m_yflt[4]; // Row and column filters of every plane for its tap counts
+    float   m_ssim_c1, m_ssim_c2, m_kernel_values[11+7+5], *mc_krn[3];
+
+    int32_t GaussianKernel(int32_t KernelSize, float sigma, float* pKernel) {
+        int32_t i;
+
+        float val, sum = 0.0f;
+        for (i = 0; i < KernelSize; i++) {
+            val = (float)(i - KernelSize / 2);
+            pKernel[i] = (float)exp(-(float)(val * val) / (float)(2.0f * sigma * sigma));
+            sum += pKernel[i];
+        }
+
+        for (i = 0; i < KernelSize; i++) pKernel[i] /= sum;
+
+        return 0;
+    }
+
+    void testFastSSIM_32f(
+        const float* pSrc1, int32_t src1Step, const float* pSrc2, int32_t src2Step, const float* pSrc3, int32_t src3Step,
+        const float* pSrc4, int32_t src4Step, const float* pSrc5, int32_t src5Step, float* pDst, int32_t dstStep,
+        ImageSize roiSize, float C1, float C2)
+    {
+        int32_t     i, j;
+        float  t1, t2, t3, t4, *pMx, *pMy, *pSx2, *pSy2, *pSxy, *pDi;
+
+        C2 += C1;
+
+        for (j = 0; j<roiSize.height; j++) {
+            pMx = (float*)((uint8_t*)(pSrc1)+j * src1Step); pMy = (float*)((uint8_t*)(pSrc2)+j * src2Step);
+            pSx2 = (float*)((uint8_t*)(pSrc3)+j * src3Step); pSy2 = (float*)((uint8_t*)(pSrc4)+j * src4Step);
+            pSxy = (float*)((uint8_t*)(pSrc5)+j * src5Step); pDi = (float*)((uint8_t*)(pDst)+j * dstStep);
+            for (i = 0; i<roiSize.width; i++) {
+                t1 = (*pMx)*(*pMy); t1 = t1 + t1 + C1; t2 = (*pSxy) + (*pSxy) - t1 + C2;
+                t3 = (*pMx)*(*pMx) + (*pMy)*(*pMy) + C1; t4 = (*pSx2) + (*pSy2) - t3 + C2;
+                t2 *= t1; t4 *= t3;
+                *pDi = (t4 >= FLT_EPSILON) ? (t2 / t4) : ((t3 >= FLT_EPSILON) ? (t1 / t3) : (1.0f));
+                pMx++; pMy++; pSx2++; pSy2++; pSxy++; pDi++;
+            }
+        }
+    }
+
+public:
+    CSSIMEvaluator(): m_ssim_c1(0), m_ssim_c2(0) {
+        std::pair< std::string, std::pair<uint32_t, uint32_t> >   metric_pair;
+        metric_pair.first = "SSIM"; metric_pair.second.first = MASK_SSIM; metric_pair.second.second = MASK_SSIM; metrics.push_back(metric_pair);
+        memset(m_buf, 0, sizeof(m_buf));
+        GaussianKernel(11, 1.5,   m_kernel_values);
+        GaussianKernel( 7, 0.75,  m_kernel_values+11);
+        GaussianKernel( 5, 0.375, m_kernel_values+18);
+        mc_krn[0] = m_kernel_values; mc_krn[1] = m_kernel_values+11; mc_krn[2] = m_kernel_values+18;
+        mc_ksz[0] = 11; mc_ksz[1] = 7; mc_ksz[2] = 5;
+        m_xkidx[0] = m_xkidx[1] = m_xkidx[2] = m_xkidx[3] = m_ykidx[0] = m_ykidx[1] = m_ykidx[2] = m_ykidx[3] = 0;
+    };
+    ~CSSIMEvaluator(void) {
+        for(int32_t i=0; i<4; i++) {
+            mclFree(m_buf[i].mu1); mclFree(m_buf[i].mu2); mclFree(m_buf[i].mu1_sq); mclFree(m_buf[i].mu2_sq); mclFree(m_buf[i].mu1_mu2); mclFree(m_buf[i].tmp);
+            mclFree(m_buf[i].src1); mclFree(m_buf[i].src2);
+        }
+    };
+
+    // Input rows held at once: the band plus the filter halo
+    int32_t bandRows(uint32_t i, int32_t band, int32_t height) const {
+        return band ? std::min(band + (mc_ksz[m_ykidx[i]]&~1), height) : height;
+    };
+
+    uint64_t EstimateMemory(int32_t band) {
+        uint64_t size = 0;
+
+        initKernelIndexes();
+        for(uint32_t i=0; i<m_num_planes; i++) {
+            SImage plane;
+
+            if(!(c_mask[i]&MASK_SSIM)) continue;
+
+            m_i1->GetFrame(i, &plane);
+            size += (uint64_t)(band ? 8 : 6) * plane.roi.width * bandRows(i, band, plane.roi.height) * sizeof(float);
+            if(!band) size += 2ull * plane.roi.width * plane.roi.height * sizeof(float);
+        }
+        return size;
+    };
+
+    bool IsHeavy(void) const { return true; };
+    int32_t AllocateResourses(void) {
+        int32_t band = m_store->GetBandHeight();
+
+        initKernelIndexes();
+        for(uint32_t i=0; i<m_num_planes; i++) {
+            ssim_buffers &b = m_buf[i];
+            SImage  plane;
+            int32_t rows;
+
+            if(!(c_mask[i]&MASK_SSIM)) continue;
+
+            m_i1->GetFrame(i, &plane);
+            rows = bandRows(i, band, plane.roi.height);
+
+            b.mu1     = mclMalloc_32f_C1(plane.roi.width, rows, &b.step);
+            b.mu2     = mclMalloc_32f_C1(plane.roi.width, rows, &b.step);
+            b.mu1_sq  = mclMalloc_32f_C1(plane.roi.width, rows, &b.step);
+            b.mu2_sq  = mclMalloc_32f_C1(plane.roi.width, rows, &b.step);
+            b.mu1_mu2 = mclMalloc_32f_C1(plane.roi.width, rows, &b.step);
+            b.tmp     = mclMalloc_32f_C1(plane.roi.width, rows, &b.step);
+            if(!b.mu1 || !b.mu2 || !b.mu1_sq || !b.mu2_sq || !b.mu1_mu2 || !b.tmp)
+                return MCL_ERR_MEMORY_ALLOC;
+
+            if(band) {
+                b.src1 = mclMalloc_32f_C1(plane.roi.width, rows, &b.step);
+                b.src2 = mclMalloc_32f_C1(plane.roi.width, rows, &b.step);
+                if(!b.src1 || !b.src2) return MCL_ERR_MEMORY_ALLOC;
+            }
+            else if(m_store->ReserveFloat(i) != MCL_ERR_NONE) return MCL_ERR_MEMORY_ALLOC;
+        }
+
+        float max_e = (float)MaxError(m_i1->GetBitDepth());
+        m_ssim_c1 = 0.0001f*max_e*max_e;
+        m_ssim_c2 = 0.0009f*max_e*max_e;
+        
+        return MCL_ERR_NONE;
+    };
+
+    void initKernelIndexes(void) {
+        for(int32_t i=0; i<4; i++) {
+            m_xkidx[i] = m_ykidx[i] = 0;
+            if(i!=0) {
+                switch (get_chromaclass(m_i1->GetSqType())) {
+                case C444:
+                    break;
+                case C422:
+                    m_xkidx[i]++; break;
+                case C420:
+                default:
+                    m_xkidx[i]++; m_ykidx[i]++; break;
+                }
+            }
+            if(m_i1->GetInterlaced()) m_ykidx[i]++;
+            mclGetFilterKernels(mc_ksz[m_xkidx[i]], m_xflt[i]);
+            mclGetFilterKernels(mc_ksz[m_ykidx[i]], m_yflt[i]);
+        }
+    };
+
+    // SSIM index of the rows of roi which have the full filter support inside roi
+    void filterPlane(uint32_t i, const float *src1, const float *src2, int32_t sstep, ImageSize roi, double &idx) {
+        ssim_buffers &b = m_buf[i];
+        ImageSize  flt, flt_h;
+        uint32_t   shift, shift_h;
+
+        mclSqr_32f_C1R(src1, sstep, b.mu1_sq, b.step, roi);
+        mclSqr_32f_C1R(src2, sstep, b.mu2_sq, b.step, roi);
+        mclMul_32f_C1R(src1, sstep, src2, sstep, b.mu1_mu2, b.step, roi);
+
+        flt.width  = roi.width  - (mc_ksz[m_xkidx[i]]&~1);
+        flt.height = roi.height - (mc_ksz[m_ykidx[i]]&~1);
+        shift = (mc_ksz[m_xkidx[i]]>>1) + (mc_ksz[m_ykidx[i]]>>1)*b.step/sizeof(float);
+
+        flt_h.width  = roi.width  - (mc_ksz[m_xkidx[i]]&~1);
+        flt_h.height = roi.height;
+        shift_h = (mc_ksz[m_xkidx[i]]>>1);
+
+        const SFilterKernels &fx = m_xflt[i], &fy = m_yflt[i];
+        fx.row(src1+shift_h,         sstep,  b.tmp+shift_h,   b.step, flt_h, mc_krn[m_xkidx[i]], fx.size);
+        fy.column(b.tmp+shift,       b.step, b.mu1+shift,     b.step, flt,   mc_krn[m_ykidx[i]], fy.size);
+        fx.row(src2+shift_h,         sstep,  b.tmp+shift_h,   b.step, flt_h, mc_krn[m_xkidx[i]], fx.size);
+        fy.column(b.tmp+shift,       b.step, b.mu2+shift,     b.step, flt,   mc_krn[m_ykidx[i]], fy.size);
+        fx.row(b.mu1_sq+shift_h,     b.step, b.tmp+shift_h,   b.step, flt_h, mc_krn[m_xkidx[i]], fx.size);
+        fy.column(b.tmp+shift,       b.step, b.mu1_sq+shift,  b.step, flt,   mc_krn[m_ykidx[i]], fy.size);
+        fx.row(b.mu2_sq+shift_h,     b.step, b.tmp+shift_h,   b.step, flt_h, mc_krn[m_xkidx[i]], fx.size);
+        fy.column(b.tmp+shift,       b.step, b.mu2_sq+shift,  b.step, flt,   mc_krn[m_ykidx[i]], fy.size);
+        fx.row(b.mu1_mu2+shift_h,    b.step, b.tmp+shift_h,   b.step, flt_h, mc_krn[m_xkidx[i]], fx.size);
+        fy.column(b.tmp+shift,       b.step, b.mu1_mu2+shift, b.step, flt,   mc_krn[m_ykidx[i]], fy.size);
+
+        testFastSSIM_32f(b.mu1+shift, b.step, b.mu2+shift, b.step, b.mu1_sq+shift, b.step,
+           b.mu2_sq+shift, b.step, b.mu1_mu2+shift, b.step, b.tmp+shift, b.step, flt, m_ssim_c1, m_ssim_c2);
+
+        mclMean_32f_C1R(b.tmp+shift, b.step, flt, idx);
+    }
+
+    void computePlane(uint32_t i, double &idx) {
+        ssim_buffers &b = m_buf[i];
+        SImage     i1_p, i2_p;
+        int32_t    sstep, band = m_store->GetBandHeight(), halo = mc_ksz[m_ykidx[i]]&~1;
+
+        if(m_store->IsIdentical(i)) { idx = 1.0; return; }
+
+        m_i1->GetFrame(i, &i1_p); m_i2->GetFrame(i, &i2_p);
+
+        if(!band) {
+            const float *src1 = m_store->GetFloat(i, 0, sstep), *src2 = m_store->GetFloat(i, 1, sstep);
+            if (!src1 || !src2) { idx = 0.0; return; } // Reported by the store
+            filterPlane(i, src1, src2, sstep, i1_p.roi, idx);
+            return;
+        }
+
+        // Bands overlap by the filter halo, band means are weighted by their number of output rows
+        double sum = 0.0, mean;
+        int32_t outputs = i1_p.roi.height - halo;
+        for(int32_t y = 0; y < outputs; y += band) {
+            ImageSize roi = { i1_p.roi.width, std::min(band, outputs - y) + halo };
+
+            m_store->GetPixelKernels().convert_32f(i1_p.data + y*i1_p.step, i1_p.step, b.src1, b.step, roi);
+            m_store->GetPixelKernels().convert_32f(i2_p.data + y*i2_p.step, i2_p.step, b.src2, b.step, roi);
+            mean = 0.0;
+            filterPlane(i, b.src1, b.src2, b.step, roi, mean);
+            sum += mean * (roi.height - halo);
+        }
+        if(outputs > 0) idx = sum / outputs;
+    }
+
+    void ComputeMetrics(std::vector< double > &val, std::vector< double > &avg) {
+        double     idx[5]  = {0.0, 0.0, 0.0, 0.0, 0.0};
+        uint32_t   i, j = (uint32_t)val.size();
+        int32_t    p;
+
+#if defined(_OPENMP)
+        #pragma omp parallel for schedule(dynamic,1)
+#endif
+        for(p=0; p<(int32_t)m_num_planes; p++) {
+            if(c_mask[p]&MASK_SSIM) computePlane(p, idx[p]);
+        }
+
+        for(i=0; i<m_num_planes; i++) { if(c_mask[i]&MASK_SSIM) { val.push_back(idx[i]); avg[j++] += idx[i]; } }
+
+        if(c_mask[m_num_planes]&MASK_SSIM) {
+            switch(get_chromaclass(m_i1->GetSqType())) {
+                case C444:
+                    idx[m_num_planes] = (idx[0]+idx[1]+idx[2]+idx[3])/(double)m_num_planes; break;
+                case C422:
+                    idx[3] = (2.0*idx[0]+idx[1]+idx[2])/4.0; break;
+                case C420:
+                default:
+                    idx[3] = (4.0*idx[0]+idx[1]+idx[2])/6.0; break;
+            }
+            val.push_back(idx[m_num_planes]); avg[j++] += idx[m_num_planes];
+        }
+    };
+};
+
+class CSSIMBlockEvaluator: public CMetricEvaluator {
+private:
+    uint8_t *m_buf[4];
+public:
+    CSSIMBlockEvaluator() {
+        m_buf[0] = m_buf[1] = m_buf[2] = m_buf[3] = 0;
+        std::pair< std::string, std::pair<uint32_t, uint32_t> >   metric_pair;
+        metric_pair.first = "SSIM_FAST"; metric_pair.second.first = MASK_SSIM_FAST; metric_pair.second.second = MASK_SSIM_FAST; metrics.push_back(metric_pair);
+        metric_pair.first = "SSIM_BOX";  metric_pair.second.first = MASK_SSIM_BOX;  metric_pair.second.second = MASK_SSIM_BOX;  metrics.push_back(metric_pair);
+    };
+    ~CSSIMBlockEvaluator(void) { for(int32_t i=0; i<4; i++) { mclFree(m_buf[i]); } };
+    uint64_t EstimateMemory(int32_t /*band*/) {
+        SImage   plane;
+        int32_t  bsize;
+        uint64_t size = 0;
+
+        for(uint32_t i=0; i<m_num_planes; i++) {
+            if(!(c_mask[i]&(MASK_SSIM_FAST|MASK_SSIM_BOX))) continue;
+
+            m_i1->GetFrame(i, &plane);
+            if (mclSSIM4x4GetBufferSize(plane.roi.width, &bsize) == MCL_ERR_NONE) size += bsize;
+        }
+        return size;
+    };
+    int32_t AllocateResourses(void) {
+        SImage  plane;
+        int32_t bsize;
+
+        for(uint32_t i=0; i<m_num_planes; i++) {
+            if(!(c_mask[i]&(MASK_SSIM_FAST|MASK_SSIM_BOX))) continue;
+
+            m_i1->GetFrame(i, &plane);
+            // 8x8 windows need at least one full window in both directions
+            if (plane.roi.height < 8 || mclSSIM4x4GetBufferSize(plane.roi.width, &bsize) != MCL_ERR_NONE) return MCL_ERR_INVALID_PARAM;
+
+            m_buf[i] = mclMalloc(bsize, D008);
+            if (!m_buf[i]) return MCL_ERR_MEMORY_ALLOC;
+        }
+
+        return MCL_ERR_NONE;
+    };
+    void ComputeMetrics(std::vector< double > &val, std::vector< double > &avg) {
+        double   fs_idx[5] = {0.0, 0.0, 0.0, 0.0, 0.0};
+        double   bx_idx[5] = {0.0, 0.0, 0.0, 0.0, 0.0};
+        uint32_t i, j = (uint32_t)val.size();
+        int32_t  p;
+
+#if defined(_OPENMP)
+        #pragma omp parallel for schedule(dynamic,1)
+#endif
+        for(p=0; p<(int32_t)m_num_planes; p++) {
+            if(c_mask[p]&(MASK_SSIM_FAST|MASK_SSIM_BOX)) {
+                SImage i1_p, i2_p;
+
+                if(m_store->IsIdentical(p)) { fs_idx[p] = bx_idx[p] = 1.0; continue; }
+                m_i1->GetFrame(p, &i1_p); m_i2->GetFrame(p, &i2_p);
+                if(c_mask[p]&MASK_SSIM_FAST) mclSSIMFast_C1R(i1_p.data, i1_p.step, i2_p.data, i2_p.step, i1_p.roi, fs_idx[p], m_buf[p], m_i1->GetBitDepth());
+                if(c_mask[p]&MASK_SSIM_BOX)  mclSSIMBox_C1R(i1_p.data, i1_p.step, i2_p.data, i2_p.step, i1_p.roi, bx_idx[p], m_buf[p], m_i1->GetBitDepth());
+            }
+        }
+
+        switch(get_chromaclass(m_i1->GetSqType())) {
+            case C444:
+                fs_idx[m_num_planes] = (fs_idx[0]+fs_idx[1]+fs_idx[2]+fs_idx[3])/(double)m_num_planes;
+                bx_idx[m_num_planes] = (bx_idx[0]+bx_idx[1]+bx_idx[2]+bx_idx[3])/(double)m_num_planes; break;
+            case C422:
+                fs_idx[3] = (2.0*fs_idx[0]+fs_idx[1]+fs_idx[2])/4.0;
+                bx_idx[3] = (2.0*bx_idx[0]+bx_idx[1]+bx_idx[2])/4.0; break;
+            case C420:
+            default:
+                fs_idx[3] = (4.0*fs_idx[0]+fs_idx[1]+fs_idx[2])/6.0;
+                bx_idx[3] = (4.0*bx_idx[0]+bx_idx[1]+bx_idx[2])/6.0; break;
+        }
+
+        for(i=0; i<=m_num_planes; i++) { if(c_mask[i]&MASK_SSIM_FAST) { val.push_back(fs_idx[i]); avg[j++] += fs_idx[i]; } }
+        for(i=0; i<=m_num_planes; i++) { if(c_mask[i]&MASK_SSIM_BOX)  { val.push_back(bx_idx[i]); avg[j++] += bx_idx[i]; } }
+    };
+};
+
+/* Temporal consistency, scored on the fly from the previous picture: TPSNR is the PSNR of the frame-to-frame
+   change of the 2nd input against that of the 1st one, TFLICKER the difference of their mean level changes.
+   Only ref - dis of the previous picture and the plane means are kept, the first picture scores as unchanged */
+class CTemporalEvaluator: public CMetricEvaluator {
+private:
+    int32_t *m_prev[4];
+    double   m_mean[4][2];
+    bool     m_first;
+public:
+    CTemporalEvaluator(): m_first(true) {
+        m_prev[0] = m_prev[1] = m_prev[2] = m_prev[3] = 0;
+        std::pair< std::string, std::pair<uint32_t, uint32_t> >   metric_pair;
+        metric_pair.first = "TPSNR";    metric_pair.second.first = MASK_TPSNR;    metric_pair.second.second = MASK_TPSNR;    metrics.push_back(metric_pair);
+        metric_pair.first = "TFLICKER"; metric_pair.second.first = MASK_TFLICKER; metric_pair.second.second = MASK_TFLICKER; metrics.push_back(metric_pair);
+    };
+    ~CTemporalEvaluator(void) { for(int32_t i=0; i<4; i++) { mclPoolFree(m_prev[i]); } };
+    uint64_t EstimateMemory(int32_t /*band*/) {
+        SImage   plane;
+        uint64_t size = 0;
+
+        for(uint32_t i=0; i<m_num_planes; i++) {
+            if(!(c_mask[i]&(MASK_TPSNR|MASK_TFLICKER))) continue;
+
+            m_i1->GetFrame(i, &plane);
+            size += (uint64_t)plane.roi.width * plane.roi.height * sizeof(int32_t);
+        }
+        return size;
+    };
+    int32_t AllocateResourses(void) {
+        SImage plane;
+
+        for(uint32_t i=0; i<m_num_planes; i++) {
+            if(!(c_mask[i]&(MASK_TPSNR|MASK_TFLICKER))) continue;
+
+            m_i1->GetFrame(i, &plane);
+            m_prev[i] = (int32_t*)mclMalloc((size_t)plane.roi.width * plane.roi.height * sizeof(int32_t), D008);
+            if (!m_prev[i]) return MCL_ERR_MEMORY_ALLOC;
+        }
+
+        return MCL_ERR_NONE;
+    };
+    void ComputeMetrics(std::vector< double > &val, std::vector< double > &avg) {
+        double   mse[5] = {0.0, 0.0, 0.0, 0.0, 0.0};
+        double   flk[5] = {0.0, 0.0, 0.0, 0.0, 0.0};
+        uint32_t i, j = (uint32_t)val.size();
+        int32_t  p;
+        bool     first = m_first;
+
+#if defined(_OPENMP)
+        #pragma omp parallel for schedule(dynamic,1)
+#endif
+        for(p=0; p<(int32_t)m_num_planes; p++) {
+            if(c_mask[p]&(MASK_TPSNR|MASK_TFLICKER)) {
+                SImage i1_p, i2_p;
+                double sse, sum1, sum2, px;
+
+                m_i1->GetFrame(p, &i1_p); m_i2->GetFrame(p, &i2_p);
+                mclTemporalDiff_C1R(i1_p.data, i1_p.step, i2_p.data, i2_p.step, m_prev[p], i1_p.roi, m_first, sse, sum1, sum2, m_i1->GetBitDepth());
+                px = (double)i1_p.roi.width * i1_p.roi.height;
+                mse[p] = sse / px;
+                if (!first) flk[p] = fabs((sum2 / px - m_mean[p][1]) - (sum1 / px - m_mean[p][0]));
+                m_mean[p][0] = sum1 / px; m_mean[p][1] = sum2 / px;
+            }
+        }
+        m_first = false;
+
+        // The first picture has no change to score, it reports nan and stays out of the averages
+        if (first) {
+            for(i=0; i<=m_num_planes; i++) { if(c_mask[i]&MASK_TPSNR)    val.push_back(std::numeric_limits< double >::quiet_NaN()); }
+            for(i=0; i<=m_num_planes; i++) { if(c_mask[i]&MASK_TFLICKER) val.push_back(std::numeric_limits< double >::quiet_NaN()); }
+            return;
+        }
+
+        switch(get_chromaclass(m_i1->GetSqType())) {
+            case C444:
+                mse[m_num_planes] = (mse[0]+mse[1]+mse[2]+mse[3])/(double)m_num_planes;
+                flk[m_num_planes] = (flk[0]+flk[1]+flk[2]+flk[3])/(double)m_num_planes; break;
+            case C422:
+                mse[3] = (2.0*mse[0]+mse[1]+mse[2])/4.0;
+                flk[3] = (2.0*flk[0]+flk[1]+flk[2])/4.0; break;
+            case C420:
+            default:
+                mse[3] = (4.0*mse[0]+mse[1]+mse[2])/6.0;
+                flk[3] = (4.0*flk[0]+flk[1]+flk[2])/6.0; break;
+        }
+
+        for(i=0; i<=m_num_planes; i++) { if(c_mask[i]&MASK_TPSNR)    { val.push_back(MSEToPSNR(mse[i], MaxError(m_i1->GetBitDepth()))); avg[j++] += mse[i]; } }
+        for(i=0; i<=m_num_planes; i++) { if(c_mask[i]&MASK_TFLICKER) { val.push_back(flk[i]); avg[j++] += flk[i]; } }
+    };
+};
+
+#if !defined(NO_IPP) && !defined(LEGACY_IPP)
+typedef struct {
+    Ipp32f **ppMu1;     // Placeholder for line buffer pointers for filtered Mu1 
+    Ipp32f **ppMu2;     // Placeholder for line buffer pointers for filtered Mu2
+    Ipp32f **ppMu1S;    // Placeholder for line buffer pointers for filtered Mu1*Mu1
+    Ipp32f **ppMu2S;    // Placeholder for line buffer pointers for filtered Mu2*Mu2
+    Ipp32f **ppMu12;    // Placeholder for line buffer pointers for filtered Mu1*Mu2
+
+    Ipp32f **ppData;    // Line buffer pointers data (allocated for max filter size)
+    Ipp32f  *pData;     // Filtered data (allocated for max filter size)
+    Ipp32s   step;      // Filtered data step
+
+    Ipp8u   *pRowBuf;   // Buffer for filtering along the rows
+    Ipp8u   *pColBuf;   // Buffer for filtering along the columns
+
+    Ipp32f  *pStage;    // FP32 rows widened from half precision sources (allocated only for FP16/BF16 storage)
+    Ipp32s   stageStep; // Staged rows step
+} ssim_context;
+
+typedef struct {
+    int      plane;     // Plane index
+    int      scale;     // Pyramid level
+    int      y_offset;  // First row of the patch
+    int      height;    // Number of rows in the patch
+    double   mssim;     // Partial sum of SSIM indexes
+    double   mcs;       // Partial sum of contrast-structure indexes
+    int      artcnt;    // Number of indexes below artifacts threshold
+} ssim_task;
+
+/* Sample type of MS-SSIM sources, all but SSIM_SRC_32F are widened row by row into the context stage */
+typedef enum { SSIM_SRC_32F, SSIM_SRC_16F, SSIM_SRC_BF16, SSIM_SRC_8U, SSIM_SRC_16U } ESSIMSource;
+
+const int min_patch_kernels = 4; // Patch must be at least 4 filter heights tall to amortize the pipeline start-up
+const float artifacts_threshold = 0.3f;
+
+class CMSSIMEvaluator : public CMetricEvaluator {
+private:
+    Ipp32f * m_kernel_values;
+    std::vector< ssim_context > m_ssim_ctx; // One context per worker thread
+    std::vector< ssim_task >    m_tasks;
+
+    Ipp32f   m_ssim_c1, m_ssim_c2;
+
+    Ipp32s   mc_ksz[3], m_xkidx[4], m_ykidx[4];
+    Ipp32f  *mc_krn[3];
+    IppiSize m_roi[4];
+
+    int allocateSSIMContext(Ipp32s xs, Ipp32s ys, Ipp32s width, bool staged, ssim_context* pCtx) {
+        IppiSize roi;
+        int      bsize, tsize = 5 * ys + 5;
+
+        pCtx->pData = ippiMalloc_32f_C1(width, tsize, &pCtx->step);
+        pCtx->ppData = (Ipp32f**)ippsMalloc_8s(sizeof(Ipp32f*) * 2 * tsize);
+
+        roi.width = width; roi.height = ys;
+        ippiFilterRowBorderPipelineGetBufferSize_32f_C1R(roi, xs, &bsize);
+        pCtx->pRowBuf = ippsMalloc_8u(bsize);
+
+        roi.width = width; roi.height = 1;
+        ippiFilterColumnPipelineGetBufferSize_32f_C1R(roi, ys, &bsize);
+        pCtx->pColBuf = ippsMalloc_8u(bsize);
+
+        // Filter height rows of both images
+        pCtx->pStage = staged ? ippiMalloc_32f_C1(width, 2 * ys, &pCtx->stageStep) : 0;
+
+        if (!pCtx->pData || !pCtx->ppData || !pCtx->pRowBuf || !pCtx->pColBuf || (staged && !pCtx->pStage)) return -2;
+
+        // First touch from the owning worker keeps the pages on its node
+        memset(pCtx->pData, 0, pCtx->step * tsize);
+        if (pCtx->pStage) memset(pCtx->pStage, 0, pCtx->stageStep * 2 * ys);
+
+        return 0;
+    }
+
+    void freeSSIMContext(ssim_context* pCtx) {
+        ippsFree(pCtx->pRowBuf);
+        ippsFree(pCtx->pColBuf);
+        ippsFree(pCtx->ppData);
+        ippiFree(pCtx->pData);
+        if (pCtx->pStage) ippiFree(pCtx->pStage);
+    }
+
+    // Widen half precision or integer rows into the staging area of the context
+    static void loadRows(const void* pSrc, const int srcStep, const int width, const int rows, Ipp32f* pDst, const int dstStep, const ESSIMSource src) {
+        IppiSize roi = { width, rows };
+
+        if (src == SSIM_SRC_8U || src == SSIM_SRC_16U) {
+            mclConvert__u32f_C1R((const uint8_t*)pSrc, srcStep, pDst, dstStep, roi, (src == SSIM_SRC_8U) ? D008 : D016);
+            return;
+        }
+        for (int r = 0; r < rows; r++)
+            mclConvert_16f32f((const uint16_t*)((const Ipp8u*)pSrc + r * srcStep), (float*)((Ipp8u*)pDst + r * dstStep), width, (src == SSIM_SRC_16F) ? FP16 : BF16);
+    }
+
+    // Planes with SSIM only are read straight from the reader when working in bands
+    bool rawPlane(int i) const { return m_store->GetBandHeight() && !(c_mask[i] & (MASK_MSSIM | MASK_ARTIFACTS)); }
+    ESSIMSource storeSource(void) const {
+        switch (m_store->GetFloatFormat()) {
+        case FP16: return SSIM_SRC_16F;
+        case BF16: return SSIM_SRC_BF16;
+        default:   return SSIM_SRC_32F;
+        }
+    }
+
+    /* FP32 sources are filtered in place, others are widened row by row into pCtx->pStage */
+    inline void getSSIMIndexes_32f_R(const void* pSrc1v, const void* pSrc2v, const int planeStep, const ESSIMSource src, const int x_offset, const int y_offset, const IppiSize ds_roi, ssim_context *pCtx,
+        const Ipp32f* xknl, const int xsz, const Ipp32f* yknl, const int ysz, const Ipp32f C1, const Ipp32f C2, double &mssim, double &mcs, int &artf)
+    {
+        int      i, j, srcStep = planeStep;
+        Ipp32f **pTmp;
+        IppiSize i_roi, o_roi;
+        IppStatus status;
+        const int tsize = 5 * ysz + 5;
+        const Ipp32f *pSrc1, *pSrc2;
+        const Ipp8u  *pRows1 = 0, *pRows2 = 0;
+
+        /* Build-up filtering pipeline*/
+        if (src != SSIM_SRC_32F) {
+            pRows1 = (const Ipp8u*)pSrc1v + (y_offset - (ysz >> 1))*planeStep;
+            pRows2 = (const Ipp8u*)pSrc2v + (y_offset - (ysz >> 1))*planeStep;
+            srcStep = pCtx->stageStep;
+            pSrc1 = pCtx->pStage;
+            pSrc2 = (const Ipp32f*)((const Ipp8u*)pCtx->pStage + ysz*srcStep);
+            loadRows(pRows1, planeStep, ds_roi.width, ysz, (Ipp32f*)pSrc1, srcStep, src);
+            loadRows(pRows2, planeStep, ds_roi.width, ysz, (Ipp32f*)pSrc2, srcStep, src);
+            pRows1 += ysz*planeStep; pRows2 += ysz*planeStep;
+        } else {
+            pSrc1 = (const Ipp32f*)((const Ipp8u*)pSrc1v + (y_offset - (ysz >> 1))*srcStep);
+            pSrc2 = (const Ipp32f*)((const Ipp8u*)pSrc2v + (y_offset - (ysz >> 1))*srcStep);
+        }
+
+        for (int i = 0; i < tsize; i++)
+            pCtx->ppData[i + tsize] = pCtx->ppData[i] = (Ipp32f*)((Ipp8u*)pCtx->pData + i * pCtx->step);
+
+        pCtx->ppMu1 = pCtx->ppData;
+        pCtx->ppMu2 = pCtx->ppMu1 + ysz;
+        pCtx->ppMu1S = pCtx->ppMu2 + ysz;
+        pCtx->ppMu2S = pCtx->ppMu1S + ysz;
+        pCtx->ppMu12 = pCtx->ppMu2S + ysz;
+        pTmp = pCtx->ppMu12 + ysz;
+
+        i_roi.width = ds_roi.width - xsz + 1; i_roi.height = ysz;
+        status = ippiFilterRowBorderPipeline_32f_C1R(pSrc1 + x_offset, srcStep, pCtx->ppMu1, i_roi, xknl, xsz, xsz >> 1, ippBorderInMem, 0.0f, pCtx->pRowBuf);
+        status = ippiFilterRowBorderPipeline_32f_C1R(pSrc2 + x_offset, srcStep, pCtx->ppMu2, i_roi, xknl, xsz, xsz >> 1, ippBorderInMem, 0.0f, pCtx->pRowBuf);
+
+        i_roi.width = ds_roi.width; i_roi.height = 1;
+        for (i = 0; i < ysz - 1; i++) {
+            status = ippsSqr_32f(pSrc1, *pTmp, ds_roi.width);
+            status = ippiFilterRowBorderPipeline_32f_C1R(*pTmp + x_offset, srcStep, pCtx->ppMu1S + i, i_roi, xknl, xsz, xsz >> 1, ippBorderInMem, 0.0f, pCtx->pRowBuf);
+            status = ippsSqr_32f(pSrc2, *pTmp, ds_roi.width);
+            status = ippiFilterRowBorderPipeline_32f_C1R(*pTmp + x_offset, srcStep, pCtx->ppMu2S + i, i_roi, xknl, xsz, xsz >> 1, ippBorderInMem, 0.0f, pCtx->pRowBuf);
+            status = ippsMul_32f(pSrc1, pSrc2, *pTmp, ds_roi.width);
+            status = ippiFilterRowBorderPipeline_32f_C1R(*pTmp + x_offset, srcStep, pCtx->ppMu12 + i, i_roi, xknl, xsz, xsz >> 1, ippBorderInMem, 0.0f, pCtx->pRowBuf);
+
+            pSrc1 = (const Ipp32f*)((const Ipp8u*)pSrc1 + srcStep);
+            pSrc2 = (const Ipp32f*)((const Ipp8u*)pSrc2 + srcStep);
+        }
+
+        /* Process ROI */
+        o_roi.width = ds_roi.width - xsz + 1; o_roi.height = 1;
+        for (i = 0; i < ds_roi.height; i++) {
+            if (pRows1 && i) { // Last row of the window replaces the previous one in the stage
+                loadRows(pRows1, planeStep, ds_roi.width, 1, (Ipp32f*)pSrc1, srcStep, src);
+                loadRows(pRows2, planeStep, ds_roi.width, 1, (Ipp32f*)pSrc2, srcStep, src);
+                pRows1 += planeStep; pRows2 += planeStep;
+            }
+            status = ippiFilterRowBorderPipeline_32f_C1R(pSrc1 + x_offset, srcStep, pCtx->ppMu1 + ysz - 1, i_roi, xknl, xsz, xsz >> 1, ippBorderInMem, 0.0f, pCtx->pRowBuf);
+            status = ippiFilterRowBorderPipeline_32f_C1R(pSrc2 + x_offset, srcStep, pCtx->ppMu2 + ysz - 1, i_roi, xknl, xsz, xsz >> 1, ippBorderInMem, 0.0f, pCtx->pRowBuf);
+            status = ippsSqr_32f(pSrc1, *pTmp, ds_roi.width);
+            status = ippiFilterRowBorderPipeline_32f_C1R(*pTmp + x_offset, srcStep, pCtx->ppMu1S + ysz - 1, i_roi, xknl, xsz, xsz >> 1, ippBorderInMem, 0.0f, pCtx->pRowBuf);
+            status = ippsSqr_32f(pSrc2, *pTmp, ds_roi.width);
+            status = ippiFilterRowBorderPipeline_32f_C1R(*pTmp + x_offset, srcStep, pCtx->ppMu2S + ysz - 1, i_roi, xknl, xsz, xsz >> 1, ippBorderInMem, 0.0f, pCtx->pRowBuf);
+            status = ippsMul_32f(pSrc1, pSrc2, *pTmp, ds_roi.width);
+            status = ippiFilterRowBorderPipeline_32f_C1R(*pTmp + x_offset, srcStep, pCtx->ppMu12 + ysz - 1, i_roi, xknl, xsz, xsz >> 1, ippBorderInMem, 0.0f, pCtx->pRowBuf);
+            status = ippiFilterColumnPipeline_32f_C1R((const Ipp32f**)pCtx->ppMu1, pTmp[0], srcStep, o_roi, yknl, ysz, pCtx->pColBuf);
+            status = ippiFilterColumnPipeline_32f_C1R((const Ipp32f**)pCtx->ppMu2, pTmp[1], srcStep, o_roi, yknl, ysz, pCtx->pColBuf);
+            status = ippiFilterColumnPipeline_32f_C1R((const Ipp32f**)pCtx->ppMu1S, pTmp[2], srcStep, o_roi, yknl, ysz, pCtx->pColBuf);
+            status = ippiFilterColumnPipeline_32f_C1R((const Ipp32f**)pCtx->ppMu2S, pTmp[3], srcStep, o_roi, yknl, ysz, pCtx->pColBuf);
+            status = ippiFilterColumnPipeline_32f_C1R((const Ipp32f**)pCtx->ppMu12, pTmp[4], srcStep, o_roi, yknl, ysz, pCtx->pColBuf);
+
+            Ipp32f  t1, t2, t3, t4, *pMx, *pMy, *pSx2, *pSy2, *pSxy;
+            Ipp64f  tmp;
+            pMx = pTmp[0]; pMy = pTmp[1]; pSx2 = pTmp[2]; pSy2 = pTmp[3]; pSxy = pTmp[4];
+            
+            for (j = 0; j<o_roi.width; j++) {
+                t1 = (*pMx)*(*pMy); t1 = t1 + t1 + C1;
+                t2 = (*pSxy) + (*pSxy) - t1 + C2;
+                t3 = (*pMx)*(*pMx) + (*pMy)*(*pMy) + C1;
+                t4 = (*pSx2) + (*pSy2) - t3 + C2;
+
+                mcs += t2 / (Ipp64f)t4;
+                tmp = (t1*t2) / (Ipp64f)(t3*t4);
+                mssim += tmp;
+                if (tmp < artifacts_threshold) (artf)++;
+                pMx++; pMy++; pSx2++; pSy2++; pSxy++;
+            }
+            
+            if (!pRows1) {
+                pSrc1 = (const Ipp32f*)((const Ipp8u*)pSrc1 + srcStep);
+                pSrc2 = (const Ipp32f*)((const Ipp8u*)pSrc2 + srcStep);
+            }
+
+            if ((pCtx->ppMu1 - pCtx->ppData) == (tsize - 1)) {
+                pCtx->ppMu1 = pCtx->ppData;
+                pCtx->ppMu2 = pCtx->ppMu1 + ysz;
+                pCtx->ppMu1S = pCtx->ppMu2 + ysz;
+                pCtx->ppMu2S = pCtx->ppMu1S + ysz;
+                pCtx->ppMu12 = pCtx->ppMu2S + ysz;
+                pTmp = pCtx->ppMu12 + ysz;
+            }
+            else {
+                pCtx->ppMu1++; pCtx->ppMu2++; pCtx->ppMu1S++; pCtx->ppMu2S++; pCtx->ppMu12++; pTmp++;
+            }
+        }
+    }
+
+public:
+    CMSSIMEvaluator() : m_ssim_c1(0), m_ssim_c2(0) {
+        std::pair< std::string, std::pair<unsigned int, unsigned int> >   metric_pair;
+        metric_pair.first = "MSSIM"; metric_pair.second.first = MASK_MSSIM; metric_pair.second.second = MASK_MSSIM; metrics.push_back(metric_pair);
+        metric_pair.first = "SSIM"; metric_pair.second.first = MASK_SSIM; metric_pair.second.second = MASK_SSIM; metrics.push_back(metric_pair);
+        metric_pair.first = "ARTIFACTS"; metric_pair.second.first = MASK_ARTIFACTS; metric_pair.second.second = MASK_ARTIFACTS; metrics.push_back(metric_pair);
+
+        m_xkidx[0] = m_xkidx[1] = m_xkidx[2] = m_xkidx[3] = m_ykidx[0] = m_ykidx[1] = m_ykidx[2] = m_ykidx[3] = 0;
+
+        m_kernel_values = 0;
+        for (int i = 0; i < 4; i++) { m_roi[i].width = m_roi[i].height = 0; }
+    };
+
+    ~CMSSIMEvaluator(void) {
+        for (size_t i = 0; i < m_ssim_ctx.size(); i++) freeSSIMContext(&m_ssim_ctx[i]);
+        ippsFree(m_kernel_values);
+    };
+
+    int GetGaussianSize(Ipp32f sigma, Ipp32f accuracy, Ipp32f* p, int maxsz) {
+        const int MaxKernelSize = 1023;
+        Ipp32f filter_tmp[MaxKernelSize];
+        int    i, gfsz = 0;
+        Ipp32f *tp;
+
+        Ipp32f val, sum = 0.0f;
+        for (i = 0; i < MaxKernelSize; i++) {
+            val = (Ipp32f)(i - MaxKernelSize / 2);
+            filter_tmp[i] = (Ipp32f)exp(-(Ipp32f)(val * val) / (Ipp32f)(2.0f * sigma * sigma));
+            sum += filter_tmp[i];
+        }
+        accuracy *= sum; sum = 0.0f; tp = p;
+        for (i = 0; i < MaxKernelSize; i++) {
+            if (filter_tmp[i] > accuracy) {
+                if (maxsz--) {
+                    gfsz++; *tp++ = (Ipp32f)filter_tmp[i]; sum += filter_tmp[i];
+                } else {
+                    return -1;
+                }
+            }
+        }
+        for (i = 0; i < gfsz; i++) *p++ /= (Ipp32f)sum;
+
+        return gfsz;
+    }
+
+    uint64_t EstimateMemory(int32_t band) {
+        Ipp32f   knl[1024];
+        uint64_t size = 0, bytes = (m_store->GetFloatFormat() == FP32) ? sizeof(Ipp32f) : sizeof(uint16_t);
+        int      ysz = GetGaussianSize(1.5f, 0.0001f, knl, 1024);
+        SImage   plane;
+
+        for (int i = 0; i < (int)m_num_planes; i++) {
+            if (!(c_mask[i] & (MASK_MSSIM | MASK_SSIM | MASK_ARTIFACTS))) continue;
+
+            m_i1->GetFrame(i, &plane);
+            if (c_mask[i] & (MASK_MSSIM | MASK_ARTIFACTS)) // Level 0 and the levels above it
+                size += 2 * bytes * plane.roi.width * (uint64_t)(plane.roi.height + (plane.roi.height >> 1));
+            else if (!band)
+                size += 2 * bytes * plane.roi.width * (uint64_t)plane.roi.height;
+        }
+        m_i1->GetFrame(0, &plane);
+        size += (uint64_t)mclGetNumThreads() * (7 * ysz + 5) * plane.roi.width * sizeof(Ipp32f);
+
+        return size;
+    };
+
+    bool IsHeavy(void) const { return true; };
+    int AllocateResourses(void) {
+        SImage  ref;
+        int     asz = 0;
+        float   sigma = 1.5f;
+
+        m_i1->GetFrame(0, &ref);
+
+        m_kernel_values = ippsMalloc_32f(1024);
+
+        mc_krn[0] = m_kernel_values;
+        mc_ksz[0] = GetGaussianSize(sigma, 0.0001f, mc_krn[0], 1024); asz += mc_ksz[0];
+        mc_krn[1] = m_kernel_values + asz;
+        mc_ksz[1] = GetGaussianSize(sigma / 2.0f, 0.0001f, mc_krn[1], 1024 - asz); asz += mc_ksz[1];
+        mc_krn[2] = m_kernel_values + asz;
+        mc_ksz[2] = GetGaussianSize(sigma / 4.0f, 0.0001f, mc_krn[2], 1024 - asz);
+
+        for (int i = 0; i<(int)m_num_planes; i++) {
+            if (i != 0) {
+                switch (get_chromaclass(m_i1->GetSqType())) {
+                case C444:
+                    break;
+                case C422:
+                    m_xkidx[i]++; break;
+                case C420:
+                default:
+                    m_xkidx[i]++; m_ykidx[i]++; break;
+                }
+            }
+            if (m_i1->GetInterlaced()) m_ykidx[i]++;
+        }
+
+        float max_e = (float)MaxError(m_i1->GetBitDepth());
+        m_ssim_c1 = 0.0001f*max_e*max_e;
+        m_ssim_c2 = 0.0009f*max_e*max_e;
+
+        // Minimal frame size requirements check
+        IppiSize mSize = { 176, 176 };
+        if ((c_mask[1] & (MASK_MSSIM | MASK_SSIM | MASK_ARTIFACTS)) || (c_mask[2] & (MASK_MSSIM | MASK_SSIM | MASK_ARTIFACTS))) {
+            if (get_chromaclass(m_i1->GetSqType()) == C422) {
+                mSize.width *= 2;
+            }
+            else if (get_chromaclass(m_i1->GetSqType()) == C444) {
+                mSize.width *= 2;
+                mSize.height *= 2;
+            }
+        }
+        if ((ref.roi.width < mSize.width || ref.roi.height < mSize.height)) return -3;
+
+        // One filtering context per worker, allocated by the worker itself, luma kernels are the largest ones
+        int ctx_cnt = mclGetNumThreads(), ctx_err = 0, c;
+        bool staged = m_store->GetFloatFormat() != FP32 || m_store->GetBandHeight();
+
+        m_ssim_ctx.resize(ctx_cnt);
+#if defined(_OPENMP)
+        #pragma omp parallel for schedule(static,1) num_threads(ctx_cnt) reduction(|:ctx_err)
+#endif
+        for (c = 0; c < ctx_cnt; c++)
+            ctx_err |= allocateSSIMContext(mc_ksz[m_xkidx[0]], mc_ksz[m_ykidx[0]], ref.roi.width, staged, &m_ssim_ctx[c]);
+        if (ctx_err) return -2;
+
+        for (int i = 0; i<(int)m_num_planes; i++) {
+            SImage plane;
+
+            if (!(c_mask[i] & (MASK_MSSIM | MASK_SSIM | MASK_ARTIFACTS))) continue;
+
+            m_i1->GetFrame(i, &plane);
+            m_roi[i] = plane.roi;
+            if (c_mask[i] & (MASK_MSSIM | MASK_ARTIFACTS)) {
+                if (m_store->ReservePyramid(i) != MCL_ERR_NONE) return -2;
+            }
+            else if (rawPlane(i)) continue;
+            else if (m_store->GetFloatFormat() != FP32) {
+                if (m_store->ReserveHalf(i) != MCL_ERR_NONE) return -2;
+            }
+            else if (m_store->ReserveFloat(i) != MCL_ERR_NONE) return -2;
+        }
+
+        return 0;
+    };
+
+    void ComputeMetrics(std::vector< double > &val, std::vector< double > &avg) {
+        const double pwrs[mmsim_depth] = { 0.0448, 0.2856, 0.3001, 0.2363, 0.1333 };
+        double      ms_idx[5] = { 0.0, 0.0, 0.0, 0.0, 0.0 };
+        double      ss_idx[5] = { 0.0, 0.0, 0.0, 0.0, 0.0 };
+        double      af_idx[5] = { 0.0, 0.0, 0.0, 0.0, 0.0 };
+        double      mssim[mmsim_depth], mcs[mmsim_depth], artcnt[mmsim_depth];
+        int         depth[4] = { 0, 0, 0, 0 }, planes[4], plane_cnt = 0;
+        uint32_t    scales[4] = { 0, 0, 0, 0 };
+        int         r, k, i, j = (int)val.size();
+        int         ctx_cnt = (int)m_ssim_ctx.size();
+
+        for (i = 0; i<(int)m_num_planes; i++) {
+            if (c_mask[i] & (MASK_MSSIM | MASK_SSIM | MASK_ARTIFACTS)) {
+                if (m_store->IsIdentical(i)) { ms_idx[i] = ss_idx[i] = 1.0; af_idx[i] = 0.0; continue; }
+                depth[i] = (c_mask[i] & (MASK_MSSIM | MASK_ARTIFACTS)) ? mmsim_depth : 1;
+                scales[i] = m_plan ? m_plan->GetScales(i) : (1u << depth[i]) - 1; // Scales the requested metrics read
+                planes[plane_cnt++] = i;
+            }
+        }
+
+        // Stage 1: convert and downsample planes independently, other evaluators may have built some levels already
+#if defined(_OPENMP)
+        #pragma omp parallel for schedule(dynamic,1) num_threads(ctx_cnt)
+#endif
+        for (r = 0; r < plane_cnt; r++) {
+            int step;
+            if (!rawPlane(planes[r])) m_store->GetLevel(planes[r], 0, depth[planes[r]] - 1, step);
+        }
+
+        // Stage 2: split every (plane, scale) pair into patches and run them all from one queue,
+        // so small chroma planes and coarse scales fill in the gaps instead of idling threads
+        m_tasks.clear();
+        for (r = 0; r < plane_cnt; r++) {
+            i = planes[r];
+            for (k = 0; k < depth[i]; k++) {
+                if (!(scales[i] & (1 << k))) continue;
+                int ysz = mc_ksz[m_ykidx[i]];
+                int i_height = (m_roi[i].height >> k) - ysz + 1;
+                int patch_cnt = i_height / (min_patch_kernels * ysz);
+
+                if (patch_cnt > ctx_cnt) patch_cnt = ctx_cnt;
+                if (patch_cnt < 1) patch_cnt = 1;
+                int patch_height = i_height / patch_cnt;
+
+                for (int p = 0; p < patch_cnt; p++) {
+                    ssim_task task = { i, k, (ysz >> 1) + p * patch_height, (p != (patch_cnt - 1)) ? patch_height : i_height - p * patch_height, 0.0, 0.0, 0 };
+                    m_tasks.push_back(task);
+                }
+            }
+        }
+
+        int task_cnt = (int)m_tasks.size();
+#if defined(_OPENMP)
+        #pragma omp parallel for schedule(dynamic,1) num_threads(ctx_cnt)
+#endif
+        for (r = 0; r < task_cnt; r++) {
+            ssim_task &t = m_tasks[r];
+#if defined(_OPENMP)
+            ssim_context *pCtx = &m_ssim_ctx[omp_get_thread_num()];
+#else
+            ssim_context *pCtx = &m_ssim_ctx[0];
+#endif
+            IppiSize p_roi = { m_roi[t.plane].width >> t.scale, t.height };
+            int      step;
+            const void *pSrc1, *pSrc2;
+            ESSIMSource src = storeSource();
+
+            if (rawPlane(t.plane)) {
+                SImage i1_p, i2_p;
+
+                m_i1->GetFrame(t.plane, &i1_p); m_i2->GetFrame(t.plane, &i2_p);
+                pSrc1 = i1_p.data; pSrc2 = i2_p.data; step = i1_p.step;
+                src = (m_i1->GetBitDepth() == D008) ? SSIM_SRC_8U : SSIM_SRC_16U;
+            } else {
+                pSrc1 = m_store->GetLevel(t.plane, 0, t.scale, step); pSrc2 = m_store->GetLevel(t.plane, 1, t.scale, step);
+                if (!pSrc1 || !pSrc2) continue; // Reported by the store
+            }
+
+            getSSIMIndexes_32f_R(pSrc1, pSrc2, step, src, mc_ksz[m_xkidx[t.plane]] >> 1, t.y_offset, p_roi, pCtx,
+                mc_krn[m_xkidx[t.plane]], mc_ksz[m_xkidx[t.plane]], mc_krn[m_ykidx[t.plane]], mc_ksz[m_ykidx[t.plane]], m_ssim_c1, m_ssim_c2 + m_ssim_c1, t.mssim, t.mcs, t.artcnt);
+        }
+
+        // Reduce in task order to keep results independent of the thread count schedule
+        for (r = 0; r < task_cnt; ) {
+            i = m_tasks[r].plane;
+            for (k = 0; k < depth[i]; k++) {
+                double mssim_a = 0.0, mcs_a = 0.0, artcnt_a = 0.0;
+                if (!(scales[i] & (1 << k))) { mssim[k] = mcs[k] = artcnt[k] = 0.0; continue; }
+                int    i_width = (m_roi[i].width >> k) - mc_ksz[m_xkidx[i]] + 1;
+                int    i_height = (m_roi[i].height >> k) - mc_ksz[m_ykidx[i]] + 1;
+
+                for (; r < task_cnt && m_tasks[r].plane == i && m_tasks[r].scale == k; r++) {
+                    mssim_a += m_tasks[r].mssim; mcs_a += m_tasks[r].mcs; artcnt_a += m_tasks[r].artcnt;
+                }
+
+                mssim[k] = mssim_a/(double)(i_width * i_height);
+                mcs[k] = mcs_a/(double)(i_width * i_height);
+                artcnt[k] = artcnt_a/(double)(i_width * i_height);
+
+                if (mcs[k] < 0.0f) mcs[k] = 0.0f;
+                if (mssim[k] < 0.0f) mssim[k] = 0.0f;
+            }
+
+            if (c_mask[i] & MASK_MSSIM) {
+                double f_mssim = pow(mssim[mmsim_depth - 1], pwrs[mmsim_depth - 1]);
+                for (k = 0; k<mmsim_depth - 1; k++) f_mssim *= pow(mcs[k], pwrs[k]);
+
+                ms_idx[i] = f_mssim;
+            }
+            if (c_mask[i] & MASK_SSIM) ss_idx[i] = mssim[0];
+            if (c_mask[i] & MASK_ARTIFACTS) af_idx[i] = 0.5*(artcnt[3] + artcnt[4]);
+        }
+
+        for (i = 0; i<(int)m_num_planes; i++) {
+            if (c_mask[i] & MASK_MSSIM) {
+                val.push_back(ms_idx[i]); avg[j++] += ms_idx[i];
+            }
+        }
+
+        if (c_mask[m_num_planes] & MASK_MSSIM) {
+            switch (get_chromaclass(m_i1->GetSqType())) {
+            case C444:
+                ms_idx[m_num_planes] = (ms_idx[0] + ms_idx[1] + ms_idx[2] + ms_idx[3]) / (double)m_num_planes; break;
+            case C422:
+                ms_idx[3] = (2.0*ms_idx[0] + ms_idx[1] + ms_idx[2]) / 4.0; break;
+            case C420:
+            default:
+                ms_idx[3] = (4.0*ms_idx[0] + ms_idx[1] + ms_idx[2]) / 6.0; break;
+            }
+            val.push_back(ms_idx[m_num_planes]); avg[j++] += ms_idx[m_num_planes];
+        }
+
+        for (i = 0; i<(int)m_num_planes; i++) {
+            if (c_mask[i] & MASK_SSIM) {
+                val.push_back(ss_idx[i]); avg[j++] += ss_idx[i];
+            }
+        }
+        if (c_mask[m_num_planes] & MASK_SSIM) {
+            switch (get_chromaclass(m_i1->GetSqType())) {
+            case C444:
+                ss_idx[m_num_planes] = (ss_idx[0] + ss_idx[1] + ss_idx[2] + ss_idx[3]) / (double)m_num_planes; break;
+            case C422:
+                ss_idx[3] = (2.0*ss_idx[0] + ss_idx[1] + ss_idx[2]) / 4.0; break;
+            case C420:
+            default:
+                ss_idx[3] = (4.0*ss_idx[0] + ss_idx[1] + ss_idx[2]) / 6.0; break;
+            }
+            val.push_back(ss_idx[m_num_planes]); avg[j++] += ss_idx[m_num_planes];
+        }
+
+        for (i = 0; i<(int)m_num_planes; i++) {
+            if (c_mask[i] & MASK_ARTIFACTS) {
+                val.push_back(af_idx[i]); avg[j++] += af_idx[i];
+            }
+        }
+        if (c_mask[m_num_planes] & MASK_ARTIFACTS) {
+            switch (get_chromaclass(m_i1->GetSqType())) {
+            case C444:
+                af_idx[m_num_planes] = (af_idx[0] + af_idx[1] + af_idx[2] + af_idx[3]) / (double)m_num_planes; break;
+            case C422:
+                af_idx[3] = (2.0*af_idx[0] + af_idx[1] + af_idx[2]) / 4.0; break;
+            case C420:
+            default:
+                af_idx[3] = (4.0*af_idx[0] + af_idx[1] + af_idx[2]) / 6.0; break;
+            }
+            val.push_back(af_idx[m_num_planes]); avg[j++] += af_idx[m_num_planes];
+        }
+    }
+};
+
+class CMWDVQMEvaluator: public CMetricEvaluator {
+private:
+    float  impm[64];
+    ImageSize sz8x8;
+public:
+    CMWDVQMEvaluator() {
+        std::pair< std::string, std::pair<uint32_t, uint32_t> >   metric_pair;
+        metric_pair.first = "MWDVQM"; metric_pair.second.first = MASK_MWDVQM; metric_pair.second.second = MASK_MWDVQM; metrics.push_back(metric_pair);
+        sz8x8.width = sz8x8.height = 8;
+        for(int32_t i=0; i<64; i++) impm[i] = 1.0f/(float)mpegmatrix[i];
+    };
+    ~CMWDVQMEvaluator(void) {};
+    bool IsHeavy(void) const { return true; };
+    int32_t AllocateResourses(void) { return 0; };
+    void computePlane(uint32_t i, double &sum) {
+        SImage      i1_p, i2_p;
+        uint32_t    k, m;
+        float       fb1[64], fb2[64], max_bdif, avg_bdif, bmean, bmax;
+
+        if (m_store->IsIdentical(i)) { sum = 0.0; return; }
+        m_i1->GetFrame(i, &i1_p); m_i2->GetFrame(i, &i2_p);
+
+        double      s_mean, s_max;
+        int32_t     fstep, bpp = (m_i1->GetBitDepth() == D008) ? 1 : 2;
+        const float *pF1 = 0, *pF2 = 0;
+
+        bmean = 0; bmax = 0;
+        if (m_store->GetStat(i, CFrameStore::STAT_MWDVQM_MEAN, s_mean) && m_store->GetStat(i, CFrameStore::STAT_MWDVQM_MAX, s_max)) {
+            bmean = (float)s_mean; bmax = (float)s_max;
+        }
+        else {
+            if (m_store->HasFloat(i)) { // Reuse planes converted for other metrics
+                pF1 = m_store->GetFloat(i, 0, fstep); pF2 = m_store->GetFloat(i, 1, fstep);
+            }
+            for(m = 0; m < (uint32_t)(i1_p.roi.height>>3); m++) {
+                for(k = 0; k < (uint32_t)(i1_p.roi.width>>3); k++) {
+                    if (pF1) { // Same block origin as the byte based addressing below
+                        ippiCopy_32f_C1R((float*)((uint8_t*)pF1 + (m << 3) * fstep) + (k << 3) / bpp, fstep, fb1, 8 * sizeof(float), sz8x8);
+                        ippiCopy_32f_C1R((float*)((uint8_t*)pF2 + (m << 3) * fstep) + (k << 3) / bpp, fstep, fb2, 8 * sizeof(float), sz8x8);
+                    } else if (m_i1->GetBitDepth() == D008) {
+                        ippiConvert_8u32f_C1R((uint8_t*)(i1_p.data+((m*i1_p.step+k)<<3)), i1_p.step, fb1, 8*sizeof(float), sz8x8);
+                        ippiConvert_8u32f_C1R((uint8_t*)(i2_p.data+((m*i2_p.step+k)<<3)), i2_p.step, fb2, 8*sizeof(float), sz8x8);
+                    } else {
+                        ippiConvert_16u32f_C1R((uint16_t*)(i1_p.data+((m*i1_p.step+k)<<3)), i1_p.step, fb1, 8*sizeof(float), sz8x8);
+                        ippiConvert_16u32f_C1R((uint16_t*)(i2_p.data+((m*i2_p.step+k)<<3)), i2_p.step, fb2, 8*sizeof(float), sz8x8);
+                    }
+                    MWDVQMBlock(fb1, fb2, impm, avg_bdif, max_bdif);
+                    bmean += avg_bdif; bmax = std::max(bmax, max_bdif);
+                }
+            }
+            m_store->SetStat(i, CFrameStore::STAT_MWDVQM_MEAN, bmean);
+            m_store->SetStat(i, CFrameStore::STAT_MWDVQM_MAX, bmax);
+        }
+        sum = 50.0f * ((12800.0f * bmean / ((double)(i1_p.roi.height * i1_p.roi.width)))+ bmax);
+    }
+
+    void ComputeMetrics(std::vector< double > &val, std::vector< double > &avg) {
+        double      sum[5] = {0.0, 0.0, 0.0, 0.0, 0.0};
+        uint32_t    i, j = (int)val.size();
+        int32_t     p;
+
+#if defined(_OPENMP)
+        #pragma omp parallel for schedule(dynamic,1)
+#endif
+        for(p=0; p<(int32_t)m_num_planes; p++) {
+            if(c_mask[p]&MASK_MWDVQM) computePlane(p, sum[p]);
+        }
+
+        for(i=0; i<m_num_planes; i++) { if(c_mask[i]&MASK_MWDVQM) { val.push_back(sum[i]); avg[j++] += sum[i]; } }
+
+        switch(get_chromaclass(m_i1->GetSqType())) {
+            case C444:
+                sum[m_num_planes] = (sum[0]+sum[1]+sum[2]+sum[3])/(double)m_num_planes; break;
+            case C422:
+                sum[3] = (2.0*sum[0]+sum[1]+sum[2])/4.0; break;
+            case C420:
+            default:
+                sum[3] = (4.0*sum[0]+sum[1]+sum[2])/6.0; break;
+        }
+        if(c_mask[m_num_planes]&MASK_MWDVQM) { val.push_back(sum[m_num_planes]); avg[j++] += sum[m_num_planes]; }
+    };
+};
+
+class CUQIEvaluator : public CMetricEvaluator {
+private:
+    Ipp8u * pBuf[3];
+public:
+    CUQIEvaluator() {
+        std::pair< std::string, std::pair<unsigned int, unsigned int> >   metric_pair;
+        metric_pair.first = "UQI"; metric_pair.second.first = MASK_UQI; metric_pair.second.second = MASK_UQI; metrics.push_back(metric_pair);
+        pBuf[0] = pBuf[1] = pBuf[2] = 0;
+    };
+    ~CUQIEvaluator(void) { for (int i = 0; i < 3; i++) ippsFree(pBuf[i]); };
+    uint64_t EstimateMemory(int32_t /*band*/) {
+        SImage   i1_p;
+        int      bsize;
+        uint64_t size = 0;
+
+        for (int i = 0; i < 3; i++) {
+            if (!(c_mask[i] & MASK_UQI)) continue;
+
+            m_i1->GetFrame(i, &i1_p);
+            if (m_i1->GetBitDepth() == D008) ippiQualityIndexGetBufferSize(ipp8u, ippC1, i1_p.roi, &bsize);
+            else ippiQualityIndexGetBufferSize(ipp16u, ippC1, i1_p.roi, &bsize);
+            size += bsize;
+        }
+        return size;
+    };
+    bool IsHeavy(void) const { return true; };
+    int AllocateResourses(void) {
+        SImage  i1_p;
+        int     bsize;
+
+        for (int i = 0; i < 3; i++) {
+            if (!(c_mask[i] & MASK_UQI)) continue;
+
+            m_i1->GetFrame(i, &i1_p);
+
+            if (m_i1->GetBitDepth() == D008) ippiQualityIndexGetBufferSize(ipp8u, ippC1, i1_p.roi, &bsize);
+            else ippiQualityIndexGetBufferSize(ipp16u, ippC1, i1_p.roi, &bsize);
+
+            pBuf[i] = ippsMalloc_8u(bsize);
+            if (!pBuf[i]) return -2;
+        }
+
+        return 0;
+    };
+    void ComputeMetrics(std::vector< double > &val, std::vector< double > &avg) {
+        float   sum[5] = { 0.0, 0.0, 0.0, 0.0, 0.0 };
+        int     i, j = (int)val.size();
+
+#if defined(_OPENMP)
+        #pragma omp parallel for schedule(dynamic,1)
+#endif
+        for (i = 0; i<3; i++) {
+            if (c_mask[i] & MASK_UQI) {
+                SImage  i1_p, i2_p;
+
+                m_i1->GetFrame(i, &i1_p); m_i2->GetFrame(i, &i2_p);
+                if (m_i1->GetBitDepth() == D008) ippiQualityIndex_8u32f_C1R((Ipp8u*)i1_p.data, i1_p.step, (Ipp8u*)i2_p.data, i2_p.step, i1_p.roi, &(sum[i]), pBuf[i]);
+                else if (m_i1->GetBitDepth() == D010 || m_i1->GetBitDepth() == D012 || m_i1->GetBitDepth() == D016) ippiQualityIndex_16u32f_C1R((Ipp16u*)i1_p.data, i1_p.step, (Ipp16u*)i2_p.data, i2_p.step, i1_p.roi, &(sum[i]), pBuf[i]);
+            }
+        }
+
+        for (i = 0; i<3; i++) { if (c_mask[i] & MASK_UQI) { val.push_back((double)(sum[i])); avg[j++] += sum[i]; } }
+
+        switch (get_chromaclass(m_i1->GetSqType())) {
+        case C444:
+            sum[m_num_planes] = (sum[0] + sum[1] + sum[2] + sum[3]) / (float)m_num_planes; break;
+        case C422:
+            sum[3] = (2.0f*sum[0] + sum[1] + sum[2]) / 4.0f; break;
+        case C420:
+        default:
+            sum[3] = (4.0f*sum[0] + sum[1] + sum[2]) / 6.0f; break;
+        }
+        if (c_mask[m_num_planes] & MASK_UQI) { val.push_back((double)(sum[m_num_planes])); avg[j++] += sum[m_num_planes]; }
+    };
+};
+#endif
+
+const double stat_pi = 3.14159265358979323846;
+
+/* Merging t-digest: values are buffered and folded into centroids whose size is bounded by the arcsine scale, small
+   near both tails and large around the median. Memory is fixed by the compression, digests of shards merge into one */
+class CQuantileSketch {
+private:
+    struct SCentroid {
+        double mean, weight;
+        bool operator<(const SCentroid &c) const { return mean < c.mean; };
+    };
+
+    std::vector< SCentroid > m_merged, m_buffer;
+    double                   m_total, m_min, m_max;
+
+    static const int32_t compression = 200;
+    static const int32_t buffer_size = 500;
+
+    // Weight fraction a centroid starting at q may cover
+    static double limit(double q) {
+        double k = compression / (2.0 * stat_pi) * asin(2.0 * q - 1.0) + 1.0;
+
+        if (k >= compression / 4.0) return 1.0;
+        return (sin(k * 2.0 * stat_pi / compression) + 1.0) / 2.0;
+    };
+
+    void compress(void) {
+        double    so_far = 0.0, bound;
+        SCentroid cur;
+
+        if (m_buffer.empty()) return;
+
+        m_buffer.insert(m_buffer.end(), m_merged.begin(), m_merged.end());
+        std::sort(m_buffer.begin(), m_buffer.end());
+        m_merged.clear();
+
+        cur = m_buffer[0]; bound = m_total * limit(0.0);
+        for (size_t i = 1; i < m_buffer.size(); i++) {
+            const SCentroid &c = m_buffer[i];
+
+            if (so_far + cur.weight + c.weight <= bound) {
+                cur.weight += c.weight;
+                cur.mean += (c.mean - cur.mean) * c.weight / cur.weight;
+            } else {
+                so_far += cur.weight;
+                m_merged.push_back(cur);
+                bound = m_total * limit(so_far / m_total);
+                cur = c;
+            }
         }
+        m_merged.push_back(cur);
+        m_buffer.clear();
+    };
+
+public:
+    CQuantileSketch(void): m_total(0.0), m_min(0.0), m_max(0.0) {
+        m_merged.reserve(buffer_size + compression);
+        m_buffer.reserve(2 * (buffer_size + compression));
+    };
+
+    void Add(double value) {
+        SCentroid c = { value, 1.0 };
 
-        if(c_mask[m_num_planes]&MASK_SSIM) {
-            switch(get_chromaclass(m_i1->GetSqType())) {
-                case C444:
-                    idx[m_num_planes] = (idx[0]+idx[1]+idx[2]+idx[3])/(double)m_num_planes; break;
-                case C422:
-                    idx[3] = (2.0*idx[0]+idx[1]+idx[2])/4.0; break;
-                case C420:
-                default:
-                    idx[3] = (4.0*idx[0]+idx[1]+idx[2])/6.0; break;
+        if (m_total == 0.0 || value < m_min) m_min = value;
+        if (m_total == 0.0 || value > m_max) m_max = value;
+        m_total += 1.0;
+        m_buffer.push_back(c);
+        if ((int32_t)m_buffer.size() >= buffer_size) compress();
+    };
+
+    void Merge(const CQuantileSketch &s) {
+        if (s.m_total == 0.0) return;
+
+        if (m_total == 0.0 || s.m_min < m_min) m_min = s.m_min;
+        if (m_total == 0.0 || s.m_max > m_max) m_max = s.m_max;
+        m_total += s.m_total;
+        m_buffer.insert(m_buffer.end(), s.m_merged.begin(), s.m_merged.end());
+        m_buffer.insert(m_buffer.end(), s.m_buffer.begin(), s.m_buffer.end());
+        compress();
+    };
+
+    double GetCount(void) const { return m_total; };
+    double GetMin(void) const   { return m_min; };
+    double GetMax(void) const   { return m_max; };
+
+    /* Linear between centroid centres, the exact extremes close both ends */
+    double Quantile(double q) {
+        double target, cum = 0.0, prev_pos = 0.0, prev_val;
+
+        compress();
+        if (m_total == 0.0) return 0.0;
+
+        target = q * m_total; prev_val = m_min;
+        for (size_t i = 0; i < m_merged.size(); i++) {
+            double pos = cum + m_merged[i].weight / 2.0;
+
+            if (target < pos) {
+                if (pos <= prev_pos) return m_merged[i].mean;
+                return prev_val + (m_merged[i].mean - prev_val) * (target - prev_pos) / (pos - prev_pos);
             }
-            val.push_back(idx[m_num_planes]); avg[j++] += idx[m_num_planes];
+            cum += m_merged[i].weight;
+            prev_pos = pos; prev_val = m_merged[i].mean;
         }
+        if (m_total <= prev_pos) return m_max;
+        return prev_val + (m_max - prev_val) * (target - prev_pos) / (m_total - prev_pos);
     };
-};
 
-#if !defined(NO_IPP) && !defined(LEGACY_IPP)
-typedef struct {
-    Ipp32f **ppMu1;     // Placeholder for line buffer pointers for filtered Mu1 
-    Ipp32f **ppMu2;     // Placeholder for line buffer pointers for filtered Mu2
-    Ipp32f **ppMu1S;    // Placeholder for line buffer pointers for filtered Mu1*Mu1
-    Ipp32f **ppMu2S;    // Placeholder for line buffer pointers for filtered Mu2*Mu2
-    Ipp32f **ppMu12;    // Placeholder for line buffer pointers for filtered Mu1*Mu2
+    bool Save(FILE *f) {
+        uint64_t cnt;
 
-    Ipp32f **ppData;    // Line buffer pointers data (allocated for max filter size)
-    Ipp32f  *pData;     // Filtered data (allocated for max filter size)
-    Ipp32s   step;      // Filtered data step
+        compress();
+        cnt = m_merged.size();
+        return fwrite(&m_total, sizeof(double), 1, f) == 1 && fwrite(&m_min, sizeof(double), 1, f) == 1 && fwrite(&m_max, sizeof(double), 1, f) == 1 &&
+               fwrite(&cnt, sizeof(cnt), 1, f) == 1 && (!cnt || fwrite(&m_merged[0], sizeof(SCentroid), (size_t)cnt, f) == cnt);
+    };
 
-    Ipp8u   *pRowBuf;   // Buffer for filtering along the rows
-    Ipp8u   *pColBuf;   // Buffer for filtering along the columns
-} ssim_context;
+    bool Load(FILE *f) {
+        uint64_t cnt;
 
-const int mmsim_depth = 5;
-const int min_patch_height = 64;
-#if defined(_OPENMP)
-const int ssim_ctx_cnt = 8; // Support up to 8 threads if compiled with enabled OpenMP
-#else
-const int ssim_ctx_cnt = 1; // Default to sequential MS-SSIM evaluation
-#endif
-const float artifacts_threshold = 0.3f;
+        m_buffer.clear();
+        if (fread(&m_total, sizeof(double), 1, f) != 1 || fread(&m_min, sizeof(double), 1, f) != 1 || fread(&m_max, sizeof(double), 1, f) != 1 ||
+            fread(&cnt, sizeof(cnt), 1, f) != 1 || cnt > (uint64_t)m_merged.capacity()) return false;
+        m_merged.resize((size_t)cnt);
+        return !cnt || fread(&m_merged[0], sizeof(SCentroid), (size_t)cnt, f) == cnt;
+    };
+};
+
+/* Distribution of one per-frame metric: exact extremes, quantiles from the sketch and a histogram with fixed bins,
+   so counts of different runs add up. SSIM-like indexes are binned by quarter decades of 1 - value from 1 down to
+   1e-5, which spreads the usual 0.9 .. 0.999 range over a dozen bins, PSNR by 1 dB from 25 to 45 dB and everything
+   else by half decades from 1e-4 to 1e6. Values outside go to the first or last bin */
+class CMetricStats {
+public:
+    static const int32_t bins = 20;
 
-class CMSSIMEvaluator : public CMetricEvaluator {
 private:
-    Ipp32f * m_kernel_values;
-    ssim_context  m_ssim_ctx[ssim_ctx_cnt];
+    typedef enum { SCALE_UNIT, SCALE_DB, SCALE_LOG } EScale;
 
-    Ipp32f  *m_im1, *m_im2, *m_imt;
-    Ipp32f   m_ssim_c1, m_ssim_c2;
+    EScale          m_scale;
+    uint64_t        m_hist[bins];
+    CQuantileSketch m_sketch;
 
-    Ipp32s   mc_ksz[3], m_xkidx[4], m_ykidx[4], m_step;
-    Ipp32f  *mc_krn[3];
+    int32_t bin(double value) const {
+        double pos;
 
-    IppiResizeSpec_32f *m_pSpec;
-    Ipp8u *m_pBuffer;
+        switch (m_scale) {
+        case SCALE_UNIT: pos = (value < 1.0) ? -log10(1.0 - value) * 4.0 : bins; break;
+        case SCALE_DB:   pos = value - 25.0; break;
+        case SCALE_LOG:
+        default:         pos = (value > 0.0) ? (log10(value) + 4.0) * 2.0 : 0.0; break;
+        }
+        if (!(pos >= 0.0)) return 0;
+        return (pos >= bins) ? bins - 1 : (int32_t)pos;
+    };
 
-    int allocateSSIMContext(Ipp32s xs, Ipp32s ys, Ipp32s width, ssim_context* pCtx) {
-        IppiSize roi;
-        int      bsize, tsize = 5 * ys + 5;
+public:
+    CMetricStats(void): m_scale(SCALE_LOG) { for (int32_t b = 0; b < bins; b++) m_hist[b] = 0; };
 
-        pCtx->pData = ippiMalloc_32f_C1(width, tsize, &pCtx->step);
-        pCtx->ppData = (Ipp32f**)ippsMalloc_8s(sizeof(Ipp32f*) * 2 * tsize);
+    void Init(const std::string &name) {
+        if (name.find("PSNR") != std::string::npos)                                            m_scale = SCALE_DB;
+        else if (name.find("SSIM") != std::string::npos || name.find("UQI") != std::string::npos) m_scale = SCALE_UNIT;
+        else                                                                                    m_scale = SCALE_LOG;
+    };
 
-        roi.width = width; roi.height = ys;
-        ippiFilterRowBorderPipelineGetBufferSize_32f_C1R(roi, xs, &bsize);
-        pCtx->pRowBuf = ippsMalloc_8u(bsize);
+    void Add(double value) { m_hist[bin(value)]++; m_sketch.Add(value); };
 
-        roi.width = width; roi.height = 1;
-        ippiFilterColumnPipelineGetBufferSize_32f_C1R(roi, ys, &bsize);
-        pCtx->pColBuf = ippsMalloc_8u(bsize);
+    void Merge(const CMetricStats &s) {
+        for (int32_t b = 0; b < bins; b++) m_hist[b] += s.m_hist[b];
+        m_sketch.Merge(s.m_sketch);
+    };
 
-        return 0;
-    }
+    bool Save(FILE *f) { return fwrite(m_hist, sizeof(m_hist), 1, f) == 1 && m_sketch.Save(f); };
+    bool Load(FILE *f) { return fread(m_hist, sizeof(m_hist), 1, f) == 1 && m_sketch.Load(f); };
 
-    void freeSSIMContext(ssim_context* pCtx) {
-        ippsFree(pCtx->pRowBuf);
-        ippsFree(pCtx->pColBuf);
-        ippsFree(pCtx->ppData);
-        ippiFree(pCtx->pData);
-    }
+    void Print(const std::string &name) {
+        std::cout << "<stat_metric=" << name << ">" << std::setprecision(5) << std::setiosflags(std::ios::fixed);
+        std::cout << " " << (uint64_t)m_sketch.GetCount() << " " << m_sketch.GetMin() << " " << m_sketch.GetMax();
+        std::cout << " " << m_sketch.Quantile(0.01) << " " << m_sketch.Quantile(0.05) << " " << m_sketch.Quantile(0.5) << "</stat_metric>" << std::endl;
+        std::cout << "<hist_metric=" << name << ">";
+        for (int32_t b = 0; b < bins; b++) std::cout << " " << m_hist[b];
+        std::cout << "</hist_metric>" << std::endl;
+    };
+};
 
-    inline void getSSIMIndexes_32f_R(Ipp32f* pSrc1, Ipp32f* pSrc2, const int srcStep, const int x_offset, const int y_offset, const IppiSize ds_roi, ssim_context *pCtx,
-        const Ipp32f* xknl, const int xsz, const Ipp32f* yknl, const int ysz, const Ipp32f C1, const Ipp32f C2, double &mssim, double &mcs, int &artf)
-    {
-        int      i, j;
-        Ipp32f **pTmp;
-        IppiSize i_roi, o_roi;
-        IppStatus status;
-        const int tsize = 5 * ysz + 5;
+/* Statistics of earlier runs over other parts of the sequence, kept in a file, are merged in. Files of another
+   metric set or damaged ones are ignored and return false */
+bool LoadStats(const std::string &name, uint64_t config, std::vector< CMetricStats > &stats)
+{
+    const uint32_t magic = 0x3253434d; // "MCS2"
+    std::vector< CMetricStats > prev(stats.size());
+    FILE    *f;
+    uint32_t hdr[2];
+    uint64_t cfg;
+    bool     ok;
+
+    if (NULL == (f = fopen(name.c_str(), "rb"))) return true; // First shard
+
+    ok = fread(hdr, sizeof(hdr), 1, f) == 1 && fread(&cfg, sizeof(cfg), 1, f) == 1 && hdr[0] == magic && hdr[1] == stats.size() && cfg == config;
+    for (size_t k = 0; ok && k < prev.size(); k++) ok = prev[k].Load(f);
+    fclose(f);
+    if (!ok) return false;
+
+    for (size_t k = 0; k < stats.size(); k++) stats[k].Merge(prev[k]);
+    return true;
+}
 
-        /* Build-up filtering pipeline*/
-        pSrc1 = (Ipp32f*)((Ipp8u*)pSrc1 + (y_offset - (ysz >> 1))*srcStep);
-        pSrc2 = (Ipp32f*)((Ipp8u*)pSrc2 + (y_offset - (ysz >> 1))*srcStep);
+bool SaveStats(const std::string &name, uint64_t config, std::vector< CMetricStats > &stats)
+{
+    const uint32_t magic = 0x3253434d;
+    uint32_t hdr[2] = { magic, (uint32_t)stats.size() };
+    FILE    *f;
+    bool     ok;
 
-        for (int i = 0; i < tsize; i++)
-            pCtx->ppData[i + tsize] = pCtx->ppData[i] = (Ipp32f*)((Ipp8u*)pCtx->pData + i * pCtx->step);
+    if (NULL == (f = fopen(name.c_str(), "wb"))) return false;
 
-        pCtx->ppMu1 = pCtx->ppData;
-        pCtx->ppMu2 = pCtx->ppMu1 + ysz;
-        pCtx->ppMu1S = pCtx->ppMu2 + ysz;
-        pCtx->ppMu2S = pCtx->ppMu1S + ysz;
-        pCtx->ppMu12 = pCtx->ppMu2S + ysz;
-        pTmp = pCtx->ppMu12 + ysz;
+    ok = fwrite(hdr, sizeof(hdr), 1, f) == 1 && fwrite(&config, sizeof(config), 1, f) == 1;
+    for (size_t k = 0; ok && k < stats.size(); k++) ok = stats[k].Save(f);
+    if (fclose(f)) ok = false;
 
-        i_roi.width = ds_roi.width - xsz + 1; i_roi.height = ysz;
-        status = ippiFilterRowBorderPipeline_32f_C1R(pSrc1 + x_offset, srcStep, pCtx->ppMu1, i_roi, xknl, xsz, xsz >> 1, ippBorderInMem, 0.0f, pCtx->pRowBuf);
-        status = ippiFilterRowBorderPipeline_32f_C1R(pSrc2 + x_offset, srcStep, pCtx->ppMu2, i_roi, xknl, xsz, xsz >> 1, ippBorderInMem, 0.0f, pCtx->pRowBuf);
+    return ok;
+}
 
-        i_roi.width = ds_roi.width; i_roi.height = 1;
-        for (i = 0; i < ysz - 1; i++) {
-            status = ippsSqr_32f(pSrc1, *pTmp, ds_roi.width);
-            status = ippiFilterRowBorderPipeline_32f_C1R(*pTmp + x_offset, srcStep, pCtx->ppMu1S + i, i_roi, xknl, xsz, xsz >> 1, ippBorderInMem, 0.0f, pCtx->pRowBuf);
-            status = ippsSqr_32f(pSrc2, *pTmp, ds_roi.width);
-            status = ippiFilterRowBorderPipeline_32f_C1R(*pTmp + x_offset, srcStep, pCtx->ppMu2S + i, i_roi, xknl, xsz, xsz >> 1, ippBorderInMem, 0.0f, pCtx->pRowBuf);
-            status = ippsMul_32f(pSrc1, pSrc2, *pTmp, ds_roi.width);
-            status = ippiFilterRowBorderPipeline_32f_C1R(*pTmp + x_offset, srcStep, pCtx->ppMu12 + i, i_roi, xknl, xsz, xsz >> 1, ippBorderInMem, 0.0f, pCtx->pRowBuf);
+/* Screening proxies of a baseline run over the same frames. A missing file leaves base empty, a file of another
+   frame count or a damaged one returns false */
+bool LoadScreenBase(const std::string &name, int32_t frames, std::vector< double > &base)
+{
+    const uint32_t magic = 0x3142434d; // "MCB1"
+    uint32_t hdr[2];
+    FILE    *f;
+    bool     ok;
+
+    base.clear();
+    if (NULL == (f = fopen(name.c_str(), "rb"))) return true; // Baseline run
+
+    ok = fread(hdr, sizeof(hdr), 1, f) == 1 && hdr[0] == magic && hdr[1] == (uint32_t)frames;
+    if (ok) {
+        base.resize(frames);
+        ok = frames == 0 || fread(&base[0], sizeof(double), frames, f) == (size_t)frames;
+    }
+    fclose(f);
+    if (!ok) base.clear();
 
-            pSrc1 = (Ipp32f*)((Ipp8u*)pSrc1 + srcStep);
-            pSrc2 = (Ipp32f*)((Ipp8u*)pSrc2 + srcStep);
-        }
+    return ok;
+}
 
-        /* Process ROI */
-        o_roi.width = ds_roi.width - xsz + 1; o_roi.height = 1;
-        for (i = 0; i < ds_roi.height; i++) {
-            status = ippiFilterRowBorderPipeline_32f_C1R(pSrc1 + x_offset, srcStep, pCtx->ppMu1 + ysz - 1, i_roi, xknl, xsz, xsz >> 1, ippBorderInMem, 0.0f, pCtx->pRowBuf);
-            status = ippiFilterRowBorderPipeline_32f_C1R(pSrc2 + x_offset, srcStep, pCtx->ppMu2 + ysz - 1, i_roi, xknl, xsz, xsz >> 1, ippBorderInMem, 0.0f, pCtx->pRowBuf);
-            status = ippsSqr_32f(pSrc1, *pTmp, ds_roi.width);
-            status = ippiFilterRowBorderPipeline_32f_C1R(*pTmp + x_offset, srcStep, pCtx->ppMu1S + ysz - 1, i_roi, xknl, xsz, xsz >> 1, ippBorderInMem, 0.0f, pCtx->pRowBuf);
-            status = ippsSqr_32f(pSrc2, *pTmp, ds_roi.width);
-            status = ippiFilterRowBorderPipeline_32f_C1R(*pTmp + x_offset, srcStep, pCtx->ppMu2S + ysz - 1, i_roi, xknl, xsz, xsz >> 1, ippBorderInMem, 0.0f, pCtx->pRowBuf);
-            status = ippsMul_32f(pSrc1, pSrc2, *pTmp, ds_roi.width);
-            status = ippiFilterRowBorderPipeline_32f_C1R(*pTmp + x_offset, srcStep, pCtx->ppMu12 + ysz - 1, i_roi, xknl, xsz, xsz >> 1, ippBorderInMem, 0.0f, pCtx->pRowBuf);
-            status = ippiFilterColumnPipeline_32f_C1R((const Ipp32f**)pCtx->ppMu1, pTmp[0], srcStep, o_roi, yknl, ysz, pCtx->pColBuf);
-            status = ippiFilterColumnPipeline_32f_C1R((const Ipp32f**)pCtx->ppMu2, pTmp[1], srcStep, o_roi, yknl, ysz, pCtx->pColBuf);
-            status = ippiFilterColumnPipeline_32f_C1R((const Ipp32f**)pCtx->ppMu1S, pTmp[2], srcStep, o_roi, yknl, ysz, pCtx->pColBuf);
-            status = ippiFilterColumnPipeline_32f_C1R((const Ipp32f**)pCtx->ppMu2S, pTmp[3], srcStep, o_roi, yknl, ysz, pCtx->pColBuf);
-            status = ippiFilterColumnPipeline_32f_C1R((const Ipp32f**)pCtx->ppMu12, pTmp[4], srcStep, o_roi, yknl, ysz, pCtx->pColBuf);
+bool SaveScreenBase(const std::string &name, const std::vector< double > &proxy)
+{
+    const uint32_t magic = 0x3142434d;
+    uint32_t hdr[2] = { magic, (uint32_t)proxy.size() };
+    FILE    *f;
+    bool     ok;
 
-            Ipp32f  t1, t2, t3, t4, *pMx, *pMy, *pSx2, *pSy2, *pSxy;
-            Ipp64f  tmp;
-            pMx = pTmp[0]; pMy = pTmp[1]; pSx2 = pTmp[2]; pSy2 = pTmp[3]; pSxy = pTmp[4];
-            
-            for (j = 0; j<o_roi.width; j++) {
-                t1 = (*pMx)*(*pMy); t1 = t1 + t1 + C1;
-                t2 = (*pSxy) + (*pSxy) - t1 + C2;
-                t3 = (*pMx)*(*pMx) + (*pMy)*(*pMy) + C1;
-                t4 = (*pSx2) + (*pSy2) - t3 + C2;
+    if (NULL == (f = fopen(name.c_str(), "wb"))) return false;
 
-                mcs += t2 / (Ipp64f)t4;
-                tmp = (t1*t2) / (Ipp64f)(t3*t4);
-                mssim += tmp;
-                if (tmp < artifacts_threshold) (artf)++;
-                pMx++; pMy++; pSx2++; pSy2++; pSxy++;
-            }
-            
-            pSrc1 = (Ipp32f*)((Ipp8u*)pSrc1 + srcStep);
-            pSrc2 = (Ipp32f*)((Ipp8u*)pSrc2 + srcStep);
+    ok = fwrite(hdr, sizeof(hdr), 1, f) == 1 && (proxy.empty() || fwrite(&proxy[0], sizeof(double), proxy.size(), f) == proxy.size());
+    if (fclose(f)) ok = false;
 
-            if ((pCtx->ppMu1 - pCtx->ppData) == (tsize - 1)) {
-                pCtx->ppMu1 = pCtx->ppData;
-                pCtx->ppMu2 = pCtx->ppMu1 + ysz;
-                pCtx->ppMu1S = pCtx->ppMu2 + ysz;
-                pCtx->ppMu2S = pCtx->ppMu1S + ysz;
-                pCtx->ppMu12 = pCtx->ppMu2S + ysz;
-                pTmp = pCtx->ppMu12 + ysz;
-            }
-            else {
-                pCtx->ppMu1++; pCtx->ppMu2++; pCtx->ppMu1S++; pCtx->ppMu2S++; pCtx->ppMu12++; pTmp++;
-            }
-        }
-    }
+    return ok;
+}
+
+/* Per-frame results laid out metric by metric, sized once for the whole run. Tables above the spill size live in
+   a mapped temporary file, so memory does not grow with the sequence length and printing scans each metric linearly */
+class CResultTable {
+private:
+    double *m_data;
+    size_t  m_metrics, m_frames;
+    bool    m_mapped;
 
 public:
-    CMSSIMEvaluator() : m_ssim_c1(0), m_ssim_c2(0) {
-        std::pair< std::string, std::pair<unsigned int, unsigned int> >   metric_pair;
-        metric_pair.first = "MSSIM"; metric_pair.second.first = MASK_MSSIM; metric_pair.second.second = MASK_MSSIM; metrics.push_back(metric_pair);
-        metric_pair.first = "SSIM"; metric_pair.second.first = MASK_SSIM; metric_pair.second.second = MASK_SSIM; metrics.push_back(metric_pair);
-        metric_pair.first = "ARTIFACTS"; metric_pair.second.first = MASK_ARTIFACTS; metric_pair.second.second = MASK_ARTIFACTS; metrics.push_back(metric_pair);
+    CResultTable(void): m_data(0), m_metrics(0), m_frames(0), m_mapped(false) {};
+    ~CResultTable(void) {
+        if (m_mapped) mclUnmapTemp(m_data, m_metrics * m_frames * sizeof(double));
+        else          mclPoolFree(m_data);
+    };
 
-        m_xkidx[0] = m_xkidx[1] = m_xkidx[2] = m_xkidx[3] = m_ykidx[0] = m_ykidx[1] = m_ykidx[2] = m_ykidx[3] = 0;
+    int32_t Init(size_t metrics, size_t frames, uint64_t spill) {
+        size_t size = metrics * frames * sizeof(double);
 
-        m_pBuffer = 0; m_pSpec = 0;
+        m_metrics = metrics; m_frames = frames;
+        if (!size) return MCL_ERR_NONE;
+        if (size > spill) m_mapped = (NULL != (m_data = (double*)mclMapTemp(size)));
+        if (!m_data) m_data = (double*)mclPoolAlloc(size);
+
+        return m_data ? MCL_ERR_NONE : MCL_ERR_MEMORY_ALLOC;
     };
 
-    ~CMSSIMEvaluator(void) {
-        for (int i = 0; i < ssim_ctx_cnt; i++) freeSSIMContext(m_ssim_ctx + i);
-        ippsFree(m_kernel_values);
-        ippiFree(m_im1);
-        ippsFree(m_pBuffer);
-        ippsFree(m_pSpec);
+    void Store(int32_t frame, const std::vector< double > &val) {
+        if (!m_data) return; // Sized for no frames
+        for (size_t m = 0; m < m_metrics; m++) m_data[m * m_frames + frame] = val[m];
     };
 
-    int GetGaussianSize(Ipp32f sigma, Ipp32f accuracy, Ipp32f* p, int maxsz) {
-        const int MaxKernelSize = 1023;
-        Ipp32f filter_tmp[MaxKernelSize];
-        int    i, gfsz = 0;
-        Ipp32f *tp;
+    const double* GetMetric(size_t metric) const { return m_data + metric * m_frames; };
+    bool          IsMapped(void) const           { return m_mapped; };
+};
 
-        Ipp32f val, sum = 0.0f;
-        for (i = 0; i < MaxKernelSize; i++) {
-            val = (Ipp32f)(i - MaxKernelSize / 2);
-            filter_tmp[i] = (Ipp32f)exp(-(Ipp32f)(val * val) / (Ipp32f)(2.0f * sigma * sigma));
-            sum += filter_tmp[i];
-        }
-        accuracy *= sum; sum = 0.0f; tp = p;
-        for (i = 0; i < MaxKernelSize; i++) {
-            if (filter_tmp[i] > accuracy) {
-                if (maxsz--) {
-                    gfsz++; *tp++ = (Ipp32f)filter_tmp[i]; sum += filter_tmp[i];
-                } else {
-                    return -1;
-                }
-            }
-        }
-        for (i = 0; i < gfsz; i++) *p++ /= (Ipp32f)sum;
+/* Live export of per-frame results through a ring in POSIX shared memory, one writer and any number of readers.
+   The object starts with SHeader, the metric names follow as consecutive NUL terminated strings from names_offset
+   and 'slots' slots of slot_size bytes from ring_offset. A slot holds a sequence word, the frame numbers of both
+   inputs and one double per metric in metric_names order. The writer sets the sequence of result n to 2n+1, fills
+   the slot, sets it to 2n+2 and then advances head to n+1. Readers take result n from slot n % slots when its
+   sequence reads 2n+2 both before and after copying, so slow readers lose results instead of stalling the writer */
+class CResultRing {
+public:
+    struct SHeader {
+        uint32_t          magic, version, metrics, slots;
+        uint64_t          slot_size, names_offset, ring_offset, frames;
+        volatile uint64_t head;   // Results published
+        volatile uint64_t done;   // Non-zero once the last result is published
+    };
 
-        return gfsz;
-    }
+    static const uint32_t magic = 0x524c434d; // "MCLR"
+    static const uint32_t slots = 1024;
 
-    int AllocateResourses(void) {
-        SImage  ref;
-        int     asz = 0;
-        float   sigma = 1.5f;
+private:
+    uint8_t *m_base;
+    size_t   m_size;
+    SHeader *m_hdr;
 
-        m_i1->GetFrame(0, &ref);
+public:
+    CResultRing(void): m_base(0), m_size(0), m_hdr(0) {};
+    ~CResultRing(void) { if (m_base) { mclStoreRelease(&m_hdr->done, 1); mclShmClose(m_base, m_size); } };
 
-        m_kernel_values = ippsMalloc_32f(1024);
+    bool IsActive(void) const { return m_base != 0; };
 
-        mc_krn[0] = m_kernel_values;
-        mc_ksz[0] = GetGaussianSize(sigma, 0.0001f, mc_krn[0], 1024); asz += mc_ksz[0];
-        mc_krn[1] = m_kernel_values + asz;
-        mc_ksz[1] = GetGaussianSize(sigma / 2.0f, 0.0001f, mc_krn[1], 1024 - asz); asz += mc_ksz[1];
-        mc_krn[2] = m_kernel_values + asz;
-        mc_ksz[2] = GetGaussianSize(sigma / 4.0f, 0.0001f, mc_krn[2], 1024 - asz);
+    bool Create(const std::string &name, const std::vector< std::string > &names, uint64_t frames) {
+        size_t names_size = 0, names_offset = (sizeof(SHeader) + 63) & ~(size_t)63, ring_offset, slot_size;
 
-        for (int i = 0; i<(int)m_num_planes; i++) {
-            if (i != 0) {
-                switch (get_chromaclass(m_i1->GetSqType())) {
-                case C444:
-                    break;
-                case C422:
-                    m_xkidx[i]++; break;
-                case C420:
-                default:
-                    m_xkidx[i]++; m_ykidx[i]++; break;
-                }
-            }
-            if (m_i1->GetInterlaced()) m_ykidx[i]++;
-        }
+        for (size_t m = 0; m < names.size(); m++) names_size += names[m].size() + 1;
+        ring_offset = (names_offset + names_size + 63) & ~(size_t)63;
+        slot_size   = (3 * sizeof(uint64_t) + names.size() * sizeof(double) + 63) & ~(size_t)63;
+        m_size      = ring_offset + slots * slot_size;
 
-        for (int i = 0; i < ssim_ctx_cnt; i++)
-            allocateSSIMContext(mc_ksz[m_xkidx[0]], mc_ksz[m_ykidx[0]], ref.roi.width, m_ssim_ctx + i);
+        if (NULL == (m_base = (uint8_t*)mclShmCreate(name.c_str(), m_size))) return false;
 
-        m_im1 = ippiMalloc_32f_C1(ref.roi.width, 5 * ref.roi.height / 2, &m_step);
-        if (!m_im1)  return -2;
-        m_im2 = (Ipp32f*)((Ipp8s*)m_im1 + ref.roi.height*m_step);
-        m_imt = (Ipp32f*)((Ipp8s*)m_im2 + ref.roi.height*m_step);
+        m_hdr = (SHeader*)m_base;
+        m_hdr->metrics = (uint32_t)names.size(); m_hdr->slots = slots;
+        m_hdr->slot_size = slot_size; m_hdr->names_offset = names_offset; m_hdr->ring_offset = ring_offset; m_hdr->frames = frames;
+        m_hdr->head = 0; m_hdr->done = 0;
+        for (size_t m = 0, pos = names_offset; m < names.size(); pos += names[m].size() + 1, m++) memcpy(m_base + pos, names[m].c_str(), names[m].size() + 1);
+        mclStoreRelease((volatile uint64_t*)&m_hdr->magic, magic | ((uint64_t)1 << 32)); // Magic and version become visible last
 
-        float max_e = (float)MaxError(m_i1->GetBitDepth());
-        m_ssim_c1 = 0.0001f*max_e*max_e;
-        m_ssim_c2 = 0.0009f*max_e*max_e;
+        return true;
+    };
 
-        IppiSize sSize, dSize;
-        int specSize = 0, initSize = 0, bufSize = 0;
-        int specSizeMax = 0, bufSizeMax = 0;
+    void Publish(uint64_t n, int32_t frame1, int32_t frame2, const std::vector< double > &val) {
+        volatile uint64_t *slot = (volatile uint64_t*)(m_base + m_hdr->ring_offset + (n % slots) * m_hdr->slot_size);
 
-        // Minimal frame size requirements check
-        IppiSize mSize = { 176, 176 };
-        if ((c_mask[1] & (MASK_MSSIM | MASK_SSIM | MASK_ARTIFACTS)) || (c_mask[2] & (MASK_MSSIM | MASK_SSIM | MASK_ARTIFACTS))) {
-            if (get_chromaclass(m_i1->GetSqType()) == C422) {
-                mSize.width *= 2;
-            }
-            else if (get_chromaclass(m_i1->GetSqType()) == C444) {
-                mSize.width *= 2;
-                mSize.height *= 2;
-            }
-        }
-        if ((ref.roi.width < mSize.width || ref.roi.height < mSize.height)) return -3;
+        *slot = 2 * n + 1;
+        mclFence();
+        slot[1] = (uint64_t)frame1; slot[2] = (uint64_t)frame2;
+        if (!val.empty()) memcpy((void*)(slot + 3), &val[0], val.size() * sizeof(double));
+        mclStoreRelease(slot, 2 * n + 2);
+        mclStoreRelease(&m_hdr->head, n + 1);
+    };
+};
 
-        // Over-allocate temporary buffers for resize to cover both 420/422/444
-        sSize = ref.roi;
-        for (int l = 0; l<mmsim_depth; l++) {
-            dSize.width = sSize.width >> 1;
-            dSize.height = sSize.height >> 1;
-            ippiResizeGetSize_32f(sSize, dSize, ippSuper, 0, &specSize, &initSize);
-            if (specSize > specSizeMax) specSizeMax = specSize;
-            sSize = dSize;
-        }
-        m_pSpec = (IppiResizeSpec_32f*)ippsMalloc_8u(2 * specSizeMax);
-        if (!m_pSpec)  return -2;
+/* On-disk per-frame results keyed by the content of both frames. A cache file belongs to one metric configuration,
+   it starts over when the configuration changes. Entries hold the per-frame values and the contributions to the averages */
+class CResultCache {
+private:
+    typedef std::pair< uint64_t, uint64_t > Key;
 
-        sSize = ref.roi;
-        for (int l = 0; l<mmsim_depth; l++) {
-            dSize.width = sSize.width >> 1;
-            dSize.height = sSize.height >> 1;
-            ippiResizeSuperInit_32f(sSize, dSize, m_pSpec);
-            ippiResizeGetBufferSize_32f(m_pSpec, dSize, 1, &bufSize);
-            if (bufSize > bufSizeMax) bufSizeMax = bufSize;
-            sSize = dSize;
-        }
-        m_pBuffer = ippsMalloc_8u(2 * bufSizeMax);
-        if (!m_pBuffer)  return -2;
+    std::map< Key, std::vector< double > > m_entries;
+    std::string m_name;
+    uint64_t    m_config, m_hits;
+    uint32_t    m_nval, m_navg;
+
+    static const uint32_t magic = 0x3143434d; // "MCC1"
+
+public:
+    CResultCache(void): m_config(0), m_hits(0), m_nval(0), m_navg(0) {};
 
-        return 0;
-    };
+    bool IsActive(void) const { return !m_name.empty(); };
 
-    void ComputeMetrics(std::vector< double > &val, std::vector< double > &avg) {
-        const double pwrs[mmsim_depth] = { 0.0448, 0.2856, 0.3001, 0.2363, 0.1333 };
-        double      ms_idx[5] = { 0.0, 0.0, 0.0, 0.0, 0.0 };
-        double      ss_idx[5] = { 0.0, 0.0, 0.0, 0.0, 0.0 };
-        double      af_idx[5] = { 0.0, 0.0, 0.0, 0.0, 0.0 };
-        double      mssim[mmsim_depth], mcs[mmsim_depth], artcnt[mmsim_depth];
-        int         depth, r, k, i, j = (int)val.size();
-        SImage      i1_p, i2_p;
-        IppiSize    pr_roi, ds_roi;
-        IppiPoint   dstOffset = { 0, 0 };
-        Ipp32f     *pSrc1, *pSrc2, *pTmp, *pTmp1;
+    /* Returns false when an existing file can not be used, the cache is then rebuilt from scratch */
+    bool Load(const std::string &name, uint64_t config, uint32_t nval, uint32_t navg) {
+        FILE    *f;
+        uint32_t hdr[3];
+        uint64_t cfg, cnt, k;
+        bool     ok = true;
 
-        for (i = 0; i<(int)m_num_planes; i++) {
-            if (c_mask[i] & (MASK_MSSIM | MASK_SSIM | MASK_ARTIFACTS)) {
-                m_i1->GetFrame(i, &i1_p); m_i2->GetFrame(i, &i2_p);
-                pSrc1 = m_im1; pSrc2 = m_im2; pTmp = m_imt;
-                depth = (c_mask[i] & (MASK_MSSIM | MASK_ARTIFACTS)) ? mmsim_depth : 1;
-                for (k = 0; k<depth; k++) {
-                    if (k) {
-                        pr_roi = ds_roi; ds_roi.width = pr_roi.width >> 1; ds_roi.height = pr_roi.height >> 1;
-                        pr_roi.width &= ~0x1; pr_roi.height &= ~0x1; // Possibly discard last column/row to match reference MS-SSIM code
-                        ippiResizeSuperInit_32f(pr_roi, ds_roi, m_pSpec);
-                        ippiResizeSuper_32f_C1R(pSrc2, m_step, pTmp, m_step, dstOffset, ds_roi, m_pSpec, m_pBuffer);
-                        ippiResizeSuper_32f_C1R(pSrc1, m_step, pSrc2, m_step, dstOffset, ds_roi, m_pSpec, m_pBuffer);
-                        pTmp1 = pSrc1; pSrc1 = pSrc2; pSrc2 = pTmp; pTmp = pTmp1;
-                    }
-                    else {
-                        if (m_i1->GetBitDepth() == D008) {
-                            ippiConvert_8u32f_C1R((Ipp8u*)i1_p.data, i1_p.step, pSrc1, m_step, i1_p.roi);
-                            ippiConvert_8u32f_C1R((Ipp8u*)i2_p.data, i2_p.step, pSrc2, m_step, i2_p.roi);
-                        }
-                        else {
-                            ippiConvert_16u32f_C1R((Ipp16u*)i1_p.data, i1_p.step, pSrc1, m_step, i1_p.roi);
-                            ippiConvert_16u32f_C1R((Ipp16u*)i2_p.data, i2_p.step, pSrc2, m_step, i2_p.roi);
-                        }
-                        ds_roi = i1_p.roi;
-                    }
+        m_name = name; m_config = config; m_nval = nval; m_navg = navg;
+        if (NULL == (f = fopen(name.c_str(), "rb"))) return true; // First run
 
-                    int i_width = ds_roi.width - mc_ksz[m_xkidx[i]] + 1;
-                    int i_height = ds_roi.height - mc_ksz[m_ykidx[i]] + 1;
-                    int patch_cnt = i_height / min_patch_height;
+        if (fread(hdr, sizeof(hdr), 1, f) != 1 || fread(&cfg, sizeof(cfg), 1, f) != 1 || fread(&cnt, sizeof(cnt), 1, f) != 1) ok = false;
+        if (ok && (hdr[0] != magic || hdr[1] != nval || hdr[2] != navg || cfg != config)) { fclose(f); return true; } // Other configuration
 
-                    if (patch_cnt == 0) patch_cnt = 1;
-                    if (patch_cnt > ssim_ctx_cnt) patch_cnt = ssim_ctx_cnt;
-#if defined(_OPENMP)
-                    if (patch_cnt > omp_get_max_threads()) patch_cnt = omp_get_max_threads();
-#endif
-                    int patch_height = i_height / patch_cnt;
+        for (k = 0; ok && k < cnt; k++) {
+            Key key;
+            std::vector< double > v(nval + navg);
 
-                    double mssim_a = 0.0, mcs_a = 0.0, artcnt_a = 0.0;
-#if defined(_OPENMP)
-                    #pragma omp parallel for reduction( + : mssim_a, mcs_a, artcnt_a )
-#endif
-                    for (r = 0; r < patch_cnt; r++) {
-                        IppiSize p_roi = ds_roi;
-                        int x_offset = (mc_ksz[m_xkidx[i]] >> 1);
-                        int y_offset = (mc_ksz[m_ykidx[i]] >> 1) + r * patch_height;
-                        double mssim_l = 0.0, mcs_l = 0.0;
-                        int    artcnt_l = 0;
-
-                        p_roi.width = ds_roi.width;
-                        p_roi.height = (r != (patch_cnt - 1)) ? patch_height : ds_roi.height - mc_ksz[m_ykidx[i]] + 1 - r * patch_height;
-
-                        getSSIMIndexes_32f_R(pSrc1, pSrc2, m_step, x_offset, y_offset, p_roi, m_ssim_ctx + r, mc_krn[m_xkidx[i]], mc_ksz[m_xkidx[i]], mc_krn[m_ykidx[i]], mc_ksz[m_ykidx[i]], m_ssim_c1, m_ssim_c2 + m_ssim_c1, mssim_l, mcs_l, artcnt_l);
-                        mssim_a += mssim_l; mcs_a += mcs_l; artcnt_a += artcnt_l;
-                    }
+            if (fread(&key.first, sizeof(key.first), 1, f) != 1 || fread(&key.second, sizeof(key.second), 1, f) != 1 ||
+                (v.size() && fread(&v[0], sizeof(double), v.size(), f) != v.size())) ok = false;
+            else m_entries[key].swap(v);
+        }
+        fclose(f);
+        if (!ok) m_entries.clear();
 
-                    mssim[k] = mssim_a/(double)(i_width * i_height);
-                    mcs[k] = mcs_a/(double)(i_width * i_height);
-                    artcnt[k] = artcnt_a/(double)(i_width * i_height);
+        return ok;
+    };
 
-                    if (mcs[k] < 0.0f) mcs[k] = 0.0f;
-                    if (mssim[k] < 0.0f) mssim[k] = 0.0f;
-                }
+    bool Save(void) {
+        FILE    *f;
+        uint32_t hdr[3] = { magic, m_nval, m_navg };
+        uint64_t cnt = m_entries.size();
+        bool     ok;
 
-                if (c_mask[i] & MASK_MSSIM) {
-                    double f_mssim = pow(mssim[mmsim_depth - 1], pwrs[mmsim_depth - 1]);
-                    for (k = 0; k<mmsim_depth - 1; k++) f_mssim *= pow(mcs[k], pwrs[k]);
+        if (NULL == (f = fopen(m_name.c_str(), "wb"))) return false;
 
-                    ms_idx[i] = f_mssim;
-                }
-                if (c_mask[i] & MASK_SSIM) ss_idx[i] = mssim[0];
-                if (c_mask[i] & MASK_ARTIFACTS) af_idx[i] = 0.5*(artcnt[3] + artcnt[4]);
-            }
+        ok = fwrite(hdr, sizeof(hdr), 1, f) == 1 && fwrite(&m_config, sizeof(m_config), 1, f) == 1 && fwrite(&cnt, sizeof(cnt), 1, f) == 1;
+        for (std::map< Key, std::vector< double > >::const_iterator it = m_entries.begin(); ok && it != m_entries.end(); ++it) {
+            ok = fwrite(&it->first.first, sizeof(uint64_t), 1, f) == 1 && fwrite(&it->first.second, sizeof(uint64_t), 1, f) == 1 &&
+                 (!it->second.size() || fwrite(&it->second[0], sizeof(double), it->second.size(), f) == it->second.size());
         }
+        if (fclose(f)) ok = false;
 
-        for (i = 0; i<(int)m_num_planes; i++) {
-            if (c_mask[i] & MASK_MSSIM) {
-                val.push_back(ms_idx[i]); avg[j++] += ms_idx[i];
-            }
-        }
+        return ok;
+    };
 
-        if (c_mask[m_num_planes] & MASK_MSSIM) {
-            switch (get_chromaclass(m_i1->GetSqType())) {
-            case C444:
-                ms_idx[m_num_planes] = (ms_idx[0] + ms_idx[1] + ms_idx[2] + ms_idx[3]) / (double)m_num_planes; break;
-            case C422:
-                ms_idx[3] = (2.0*ms_idx[0] + ms_idx[1] + ms_idx[2]) / 4.0; break;
-            case C420:
-            default:
-                ms_idx[3] = (4.0*ms_idx[0] + ms_idx[1] + ms_idx[2]) / 6.0; break;
-            }
-            val.push_back(ms_idx[m_num_planes]); avg[j++] += ms_idx[m_num_planes];
-        }
+    /* Two independent 64 bit hashes over all compared planes of both frames */
+    Key FrameKey(CReader *i1, CReader *i2, uint32_t num_planes) const {
+        Key key(m_config, ~m_config);
 
-        for (i = 0; i<(int)m_num_planes; i++) {
-            if (c_mask[i] & MASK_SSIM) {
-                val.push_back(ss_idx[i]); avg[j++] += ss_idx[i];
-            }
-        }
-        if (c_mask[m_num_planes] & MASK_SSIM) {
-            switch (get_chromaclass(m_i1->GetSqType())) {
-            case C444:
-                ss_idx[m_num_planes] = (ss_idx[0] + ss_idx[1] + ss_idx[2] + ss_idx[3]) / (double)m_num_planes; break;
-            case C422:
-                ss_idx[3] = (2.0*ss_idx[0] + ss_idx[1] + ss_idx[2]) / 4.0; break;
-            case C420:
-            default:
-                ss_idx[3] = (4.0*ss_idx[0] + ss_idx[1] + ss_idx[2]) / 6.0; break;
-            }
-            val.push_back(ss_idx[m_num_planes]); avg[j++] += ss_idx[m_num_planes];
-        }
+        for (int32_t img = 0; img < 2; img++) {
+            for (uint32_t i = 0; i < num_planes; i++) {
+                SImage p;
 
-        for (i = 0; i<(int)m_num_planes; i++) {
-            if (c_mask[i] & MASK_ARTIFACTS) {
-                val.push_back(af_idx[i]); avg[j++] += af_idx[i];
+                (img ? i2 : i1)->GetFrame(i, &p);
+                key.first  = mclHash_C1R(p.data, p.step, p.roi, i1->GetBitDepth(), key.first);
+                key.second = mclHash_C1R(p.data, p.step, p.roi, i1->GetBitDepth(), key.second ^ 0x5851f42d4c957f2dull);
             }
         }
-        if (c_mask[m_num_planes] & MASK_ARTIFACTS) {
-            switch (get_chromaclass(m_i1->GetSqType())) {
-            case C444:
-                af_idx[m_num_planes] = (af_idx[0] + af_idx[1] + af_idx[2] + af_idx[3]) / (double)m_num_planes; break;
-            case C422:
-                af_idx[3] = (2.0*af_idx[0] + af_idx[1] + af_idx[2]) / 4.0; break;
-            case C420:
-            default:
-                af_idx[3] = (4.0*af_idx[0] + af_idx[1] + af_idx[2]) / 6.0; break;
-            }
-            val.push_back(af_idx[m_num_planes]); avg[j++] += af_idx[m_num_planes];
-        }
-    }
-};
+        return key;
+    };
 
-const short mpegmatrix [ 64 ] = {
-    8,  16, 19, 22, 26, 27, 29, 34,
-    16, 16, 22, 21, 27, 29, 34, 37,
-    19, 22, 26, 27, 29, 31, 34, 38,
-    22, 22, 26, 27, 29, 34, 37, 40,
-    22, 26, 27, 29, 32, 35, 40, 48,
-    26, 27, 29, 32, 35, 40, 48, 58,
-    26, 27, 29, 34, 38, 46, 56, 69,
-    27, 29, 35, 38, 46, 56, 69, 83 };
+    bool Find(const Key &key, std::vector< double > &val, std::vector< double > &avg) {
+        std::map< Key, std::vector< double > >::const_iterator it = m_entries.find(key);
 
-class CMWDVQMEvaluator: public CMetricEvaluator {
-private:
-    float  fb1[64], fb2[64], impm[64];
-    ImageSize sz8x8;
-public:
-    CMWDVQMEvaluator() {
-        std::pair< std::string, std::pair<uint32_t, uint32_t> >   metric_pair;
-        metric_pair.first = "MWDVQM"; metric_pair.second.first = MASK_MWDVQM; metric_pair.second.second = MASK_MWDVQM; metrics.push_back(metric_pair);
-        sz8x8.width = sz8x8.height = 8;
-        for(int32_t i=0; i<64; i++) impm[i] = 1.0f/(float)mpegmatrix[i];
+        if (it == m_entries.end()) return false;
+
+        val.assign(it->second.begin(), it->second.begin() + m_nval);
+        avg.assign(it->second.begin() + m_nval, it->second.end());
+        m_hits++;
+        return true;
     };
-    ~CMWDVQMEvaluator(void) {};
-    int32_t AllocateResourses(void) { return 0; };
-    void ComputeMetrics(std::vector< double > &val, std::vector< double > &avg) {
-        SImage      i1_p, i2_p;
-        double      sum[5] = {0.0, 0.0, 0.0, 0.0, 0.0};
-        uint32_t    i, j = (int)val.size(), k, m;
-        float       f1c, f2c, max_bdif, avg_bdif, bmean, bmax;
 
-        for(i=0; i<m_num_planes; i++) {
-            if(c_mask[i]&MASK_MWDVQM) {
-                m_i1->GetFrame(i, &i1_p); m_i2->GetFrame(i, &i2_p);
+    void Insert(const Key &key, const std::vector< double > &val, const std::vector< double > &avg) {
+        std::vector< double > &v = m_entries[key];
 
-                bmean = 0; bmax = 0;
-                for(m = 0; m < (uint32_t)(i1_p.roi.height>>3); m++) {
-                    for(k = 0; k < (uint32_t)(i1_p.roi.width>>3); k++) {
-                        if (m_i1->GetBitDepth() == D008) {
-                            ippiConvert_8u32f_C1R((uint8_t*)(i1_p.data+((m*i1_p.step+k)<<3)), i1_p.step, fb1, 8*sizeof(float), sz8x8);
-                            ippiConvert_8u32f_C1R((uint8_t*)(i2_p.data+((m*i2_p.step+k)<<3)), i2_p.step, fb2, 8*sizeof(float), sz8x8);
-                        } else {
-                            ippiConvert_16u32f_C1R((uint16_t*)(i1_p.data+((m*i1_p.step+k)<<3)), i1_p.step, fb1, 8*sizeof(float), sz8x8);
-                            ippiConvert_16u32f_C1R((uint16_t*)(i2_p.data+((m*i2_p.step+k)<<3)), i2_p.step, fb2, 8*sizeof(float), sz8x8);
-                        }
-                        ippiDCT8x8Fwd_32f_C1I(fb1); ippiDCT8x8Fwd_32f_C1I(fb2);
-                        f1c = (fb1[0]>0.0f) ? powf((fb1[0] / 1024.0f), 0.65f) / fb1[0] : 1.0f;
-                        f2c = (fb2[0]>0.0f) ? powf((fb2[0] / 1024.0f), 0.65f) / fb2[0] : 1.0f;
-                        ippsMulC_32f_I(f1c,fb1,64); ippsMulC_32f_I(f2c,fb2,64); ippsSub_32f_I(fb2,fb1,64); ippsMul_32f_I(impm,fb1,64); ippsAbs_32f_I(fb1,64);
-                        ippsMax_32f(fb1,64,&max_bdif); ippsMean_32f(fb1,64,&avg_bdif,ippAlgHintAccurate);
-                        bmean += avg_bdif; bmax = std::max(bmax, max_bdif);
-                    }
-                }
-                sum[i] = 50.0f * ((12800.0f * bmean / ((double)(i1_p.roi.height * i1_p.roi.width)))+ bmax);
-                val.push_back(sum[i]); avg[j++] += sum[i];
-            }
-        }
-        switch(get_chromaclass(m_i1->GetSqType())) {
-            case C444:
-                sum[m_num_planes] = (sum[0]+sum[1]+sum[2]+sum[3])/(double)m_num_planes; break;
-            case C422:
-                sum[3] = (2.0*sum[0]+sum[1]+sum[2])/4.0; break;
-            case C420:
-            default:
-                sum[3] = (4.0*sum[0]+sum[1]+sum[2])/6.0; break;
-        }
-        if(c_mask[m_num_planes]&MASK_MWDVQM) { val.push_back(sum[m_num_planes]); avg[j++] += sum[m_num_planes]; }
+        v.assign(val.begin(), val.end());
+        v.insert(v.end(), avg.begin(), avg.end());
     };
+
+    uint64_t GetHits(void) const { return m_hits; };
 };
 
-class CUQIEvaluator : public CMetricEvaluator {
+/* Frame pairing of two streams that drifted apart: dropped, duplicated, inserted or offset frames. Luma thumbnails
+   of both streams are built in one pass, then a dynamic programming search within +/-range frames pairs frames of the
+   2nd stream with frames of the 1st one in order. Every break of the one to one order costs a penalty derived from the typical
+   thumbnail difference of the best pairs, unpaired frames of the 2nd stream cost twice as much */
+class CTemporalAligner {
 private:
-    Ipp8u * pBuf;
-public:
-    CUQIEvaluator() {
-        std::pair< std::string, std::pair<unsigned int, unsigned int> >   metric_pair;
-        metric_pair.first = "UQI"; metric_pair.second.first = MASK_UQI; metric_pair.second.second = MASK_UQI; metrics.push_back(metric_pair);
-        pBuf = 0;
-    };
-    ~CUQIEvaluator(void) { ippsFree(pBuf); };
-    int AllocateResourses(void) {
-        SImage  i1_p;
-        int     bsize;
+    std::vector< float > m_thumbs[2];
+    int32_t   m_count[2];
+    ImageSize m_size;
+    int32_t   m_range;
+    double    m_scale; // Thumbnail MSE to 8 bit units
+
+    static const int32_t thumb_width = 64;
+    static const int32_t max_skip    = 4;  // Consecutive unpaired frames of the 2nd input within the sequence
 
-        m_i1->GetFrame(0, &i1_p);
+    double Cost(int32_t i1, int32_t i2) const {
+        const float *t1 = &m_thumbs[0][(size_t)i1 * m_size.width * m_size.height], *t2 = &m_thumbs[1][(size_t)i2 * m_size.width * m_size.height];
+        double       mse = 0.0;
 
-        if (m_i1->GetBitDepth() == D008) ippiQualityIndexGetBufferSize(ipp8u, ippC1, i1_p.roi, &bsize);
-        else ippiQualityIndexGetBufferSize(ipp16u, ippC1, i1_p.roi, &bsize);
+        for (int32_t k = 0; k < m_size.width * m_size.height; k++) mse += (double)(t1[k] - t2[k]) * (t1[k] - t2[k]);
+        return mse * m_scale / (m_size.width * m_size.height);
+    };
 
-        pBuf = ippsMalloc_8u(bsize);
+public:
+    CTemporalAligner(void): m_range(0), m_scale(1.0) { m_count[0] = m_count[1] = 0; m_size.width = m_size.height = 0; };
+
+    /* Streaming pass over all frames of one input */
+    EErrorStatus Build(CReader *reader, int32_t idx, int32_t range) {
+        SImage plane;
+        size_t tsize;
+
+        m_range = range;
+        m_count[idx] = reader->GetFramesCount();
+        reader->ReadRawFrame(0);
+        reader->GetFrame(0, &plane);
+        if (!idx) {
+            m_size.width  = (std::min)(plane.roi.width, (int32_t)thumb_width);
+            m_size.height = (std::max)((int32_t)((int64_t)plane.roi.height * m_size.width / plane.roi.width), 1);
+            m_scale = 255.0 / MaxError(reader->GetBitDepth()); m_scale *= m_scale;
+        }
+        tsize = (size_t)m_size.width * m_size.height;
+        m_thumbs[idx].resize(tsize * m_count[idx]);
 
-        return 0;
+        for (int32_t f = 0; f < m_count[idx]; f++) {
+            EErrorStatus sts;
+
+            reader->ReadRawFrame(f);
+            reader->GetFrame(0, &plane);
+            sts = mclThumbnail__u32f_C1R(plane.data, plane.step, plane.roi, &m_thumbs[idx][tsize * f], m_size, reader->GetBitDepth());
+            if (sts != MCL_ERR_NONE) return sts;
+        }
+        return MCL_ERR_NONE;
     };
-    void ComputeMetrics(std::vector< double > &val, std::vector< double > &avg) {
-        SImage  i1_p, i2_p;
-        float   sum[5] = { 0.0, 0.0, 0.0, 0.0, 0.0 };
-        int     i, j = (int)val.size();
 
-        for (i = 0; i<3; i++) {
-            if (c_mask[i] & MASK_UQI) {
-                m_i1->GetFrame(i, &i1_p); m_i2->GetFrame(i, &i2_p);
-                if (m_i1->GetBitDepth() == D008) ippiQualityIndex_8u32f_C1R((Ipp8u*)i1_p.data, i1_p.step, (Ipp8u*)i2_p.data, i2_p.step, i1_p.roi, &(sum[i]), pBuf);
-                else if (m_i1->GetBitDepth() == D010 || m_i1->GetBitDepth() == D012 || m_i1->GetBitDepth() == D016) ippiQualityIndex_16u32f_C1R((Ipp16u*)i1_p.data, i1_p.step, (Ipp16u*)i2_p.data, i2_p.step, i1_p.roi, &(sum[i]), pBuf);
-                val.push_back((double)(sum[i])); avg[j++] += sum[i];
+    /* Pairs of frame indexes of the 1st and the 2nd input in the order of the 2nd one */
+    void Align(std::vector< std::pair< int32_t, int32_t > > &pairs, int32_t &dropped, int32_t &duplicated) {
+        const int32_t n1 = m_count[0], n2 = m_count[1], band = 2 * m_range + 1;
+        const double  inf = DBL_MAX;
+        std::vector< double >  cost((size_t)n2 * band, inf), best((size_t)n2 * band, inf), typical;
+        std::vector< int32_t > from((size_t)n2 * band, -1), skip((size_t)n2 * band, 0);
+        double  penalty, end = inf;
+        int32_t i, j, k, ei = -1, ej = -1;
+
+        pairs.clear(); dropped = duplicated = 0;
+        if (!n1 || !n2) return;
+
+        // Cell (j, k) pairs frame j of the 2nd input with frame j + k - range of the 1st one
+        for (j = 0; j < n2; j++) {
+            double m = inf;
+            for (k = 0; k < band; k++) {
+                i = j + k - m_range;
+                if (i < 0 || i >= n1) continue;
+                cost[(size_t)j * band + k] = Cost(i, j);
+                m = (std::min)(m, cost[(size_t)j * band + k]);
+            }
+            if (m < inf) typical.push_back(m);
+        }
+        if (typical.empty()) return;
+        std::nth_element(typical.begin(), typical.begin() + typical.size() / 2, typical.end());
+        penalty = 4.0 * typical[typical.size() / 2] + 0.01;
+
+        for (j = 0; j < n2; j++) {
+            for (k = 0; k < band; k++) {
+                double c = cost[(size_t)j * band + k], &b = best[(size_t)j * band + k];
+
+                if (c == inf) continue;
+                b = 2.0 * penalty * j + c; // Leading frames of the 2nd input are skipped
+                // The previous paired frame q = j - 1 - s of the 2nd input went with frame p <= i of the 1st one
+                for (int32_t s = 0; s <= (std::min)((int32_t)max_skip, m_range) && j - 1 - s >= 0; s++) {
+                    for (int32_t pk = 0; pk < band && pk <= k + 1 + s; pk++) {
+                        double prev = best[(size_t)(j - 1 - s) * band + pk], step;
+                        int32_t gap = (k + 1 + s) - pk; // i - p
+
+                        if (prev == inf) continue;
+                        step = 2.0 * penalty * s + ((gap == 1) ? 0.0 : (gap == 0) ? penalty : penalty * (gap - 1));
+                        if (prev + step + c < b) { b = prev + step + c; from[(size_t)j * band + k] = pk; skip[(size_t)j * band + k] = s; }
+                    }
+                }
+                // Trailing frames of the 2nd input are skipped
+                if (b + 2.0 * penalty * (n2 - 1 - j) < end) { end = b + 2.0 * penalty * (n2 - 1 - j); ei = k; ej = j; }
             }
         }
 
-        switch (get_chromaclass(m_i1->GetSqType())) {
-        case C444:
-            sum[m_num_planes] = (sum[0] + sum[1] + sum[2] + sum[3]) / (float)m_num_planes; break;
-        case C422:
-            sum[3] = (2.0f*sum[0] + sum[1] + sum[2]) / 4.0f; break;
-        case C420:
-        default:
-            sum[3] = (4.0f*sum[0] + sum[1] + sum[2]) / 6.0f; break;
+        for (j = ej, k = ei; j >= 0 && k >= 0; ) {
+            size_t cell = (size_t)j * band + k;
+
+            pairs.push_back(std::make_pair(j + k - m_range, j));
+            if (from[cell] < 0) break;
+            k = from[cell]; j -= 1 + skip[cell];
+        }
+        std::reverse(pairs.begin(), pairs.end());
+        for (i = 1; i < (int32_t)pairs.size(); i++) {
+            if (pairs[i].first == pairs[i - 1].first)   duplicated++;
+            else                                        dropped += pairs[i].first - pairs[i - 1].first - 1;
         }
-        if (c_mask[m_num_planes] & MASK_UQI) { val.push_back((double)(sum[m_num_planes])); avg[j++] += sum[m_num_planes]; }
     };
 };
-#endif
 
 static const char *errors_table[] = {
     "ERROR: Unable to parse input metric specifications!",
@@ -1270,19 +3161,107 @@ static const char *errors_table[] = {
     "ERROR: Unable to use parameters \"fs\" and \"numseekframe\" together!",
     "WARNING: Wrong seek ranges!",
     "ERROR: Failed to allocate memory!",
-    "ERROR: Unsupported bit depth!"
+    "ERROR: Unsupported bit depth!",
+    "ERROR: Planes are too small for the selected metrics!",
+    "ERROR: Unsupported half precision format, FP16 can not hold 16 bits samples!",
+    "ERROR: Selected metrics do not fit into the memory budget!",
+    "WARNING: CPU topology is not available, worker threads are not pinned!",
+    "ERROR: Wrong huge pages mode!",
+    "ERROR: Unknown CPU level!",
+    "WARNING: Requested CPU level is not supported, the highest available one is used!",
+    "WARNING: Result cache is damaged, it is rebuilt!",
+    "WARNING: Result cache can not be written!",
+    "ERROR: Unable to use parameter \"align\" together with \"fs\" or \"numseekframe\"!",
+    "ERROR: Unknown scaler!",
+    "WARNING: Statistics file is damaged or belongs to other metrics, it is started over!",
+    "WARNING: Statistics file can not be written!",
+    "WARNING: Shared memory ring can not be created, results are not published!",
+    "WARNING: Screening baseline belongs to another sequence, all frames are scored!",
+    "WARNING: Screening baseline can not be written!",
+    "WARNING: Temporal metrics, screening and sampling do not support \"reuse\" and \"cache\", they are turned off!",
+    "ERROR: Unknown half precision format!",
+    "ERROR: Memory sizes must be given as a whole number of megabytes!"
+};
+
+const int32_t min_band_height = 16;
+
+const int32_t max_shift_samples = 4;    // Frame pairs in the shift detection
+const int32_t max_shift_size    = 256;  // Side of the correlated square
+const double  min_shift_peak    = 0.05; // Weaker correlation peaks keep the inputs unshifted
+
+uint64_t EstimateMemory(std::vector< CMetricEvaluator* > &mevs, CReader *i1, CReader *i2, int32_t band)
+{
+    uint64_t size = i1->GetMemorySize() + i2->GetMemorySize();
+
+    for (size_t i = 0; i < mevs.size(); i++) size += mevs[i]->EstimateMemory(band);
+    return size;
+}
+
+/* Band height keeping readers and evaluators within the budget: 0 if whole planes fit, -1 if nothing does */
+int32_t FitBandHeight(std::vector< CMetricEvaluator* > &mevs, CReader *i1, CReader *i2, uint64_t budget)
+{
+    SImage  plane;
+    int32_t lo = min_band_height, hi;
+
+    if (EstimateMemory(mevs, i1, i2, 0) <= budget)  return 0;
+    if (EstimateMemory(mevs, i1, i2, lo) > budget)  return -1;
+
+    i1->GetFrame(0, &plane);
+    hi = plane.roi.height;
+    while (lo < hi) { // Largest band within the budget
+        int32_t mid = (lo + hi + 1) >> 1;
+        if (EstimateMemory(mevs, i1, i2, mid) <= budget) lo = mid; else hi = mid - 1;
+    }
+    return lo;
+}
+
+/* Size option in megabytes, false unless the whole argument is a number of megabytes that fits in 64 bits */
+bool ParseMegabytes(const char *arg, uint64_t &bytes)
+{
+    char              *end = NULL;
+    unsigned long long mb;
+
+    if (!isdigit((unsigned char)arg[0])) return false;
+    mb = strtoull(arg, &end, 10);
+    if (*end || mb > (~0ULL >> 20)) return false;
+
+    bytes = (uint64_t)mb << 20;
+    return true;
+}
+
+/* Frames a metric group is computed on: every frame, every <every>th frame or <random> frames picked at random */
+struct SSampling {
+    uint32_t mask, planes; // Metrics and planes (bit per component) of the group
+    int32_t  every, random;
 };
 
+/* Marks the frames of the policy in due, which holds one entry per frame of the run. Random picks are uniform
+   over the run and the same for every run of the same length */
+void SampleFrames(const SSampling &smp, std::vector< bool > &due)
+{
+    int32_t  i, frames = (int32_t)due.size(), left = smp.random;
+    uint64_t state = 0x9e3779b97f4a7c15ULL;
+
+    for (i = 0; i < frames; i++) {
+        if (!smp.random) { due[i] = due[i] || i % smp.every == 0; continue; }
+        state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+        if ((double)(state >> 11) * (1.0 / 9007199254740992.0) * (frames - i) < left) { due[i] = true; left--; }
+    }
+}
+
 int32_t usage(void)
 {
     std::cout << "Usage:" << std::endl;
-    std::cout << "metrics_calc_lite.exe <Options> <metric1> ... [<metricN>]... <plane1> ...[<planeN>] ..." << std::endl;
+    std::cout << "metrics_calc_lite.exe <Options> <metric1> ... [<metricN>]... <plane1> ...[<planeN>] [<sampling>] ..." << std::endl;
 #if defined(NO_IPP) || defined(LEGACY_IPP)
-    std::cout << "Possible metrics are: psnr, apsnr, ssim" << std::endl;
+    std::cout << "Possible metrics are: psnr, apsnr, ssim, ssim_fast, ssim_box, tpsnr, tflicker" << std::endl;
 #else
-    std::cout << "Possible metrics are: psnr, apsnr, ssim, mssim, artifacts, mwdvqm, uqi" << std::endl;
+    std::cout << "Possible metrics are: psnr, apsnr, ssim, ssim_fast, ssim_box, tpsnr, tflicker, mssim, artifacts, mwdvqm, uqi" << std::endl;
 #endif
     std::cout << "Possible planes are: y, u, v, overall, all" << std::endl;
+    std::cout << "Possible sampling is: every <n> (every n-th frame), sample <n> (n frames picked at random), all frames by default" << std::endl;
+    std::cout << "                      a metric asked for by several groups is reported on the frames of all of them, tpsnr and tflicker" << std::endl;
+    std::cout << "                      are always computed on all frames" << std::endl;
     std::cout << "Required options are:" << std::endl;
     std::cout << "    -i1 <filename> - name of first file to compare" << std::endl;
     std::cout << "    -i2 <filename> - name of second file to compare" << std::endl;
@@ -1295,12 +3274,27 @@ int32_t usage(void)
     std::cout << "    -alpha              - calculate metrics for RGB alpha channel" << std::endl;
     std::cout << "    -numseekframe1 <from> <to> <num> - performs seeks to particular position in 1st file. FROM - position FROM, TO - seek position, NUM - number of iterations" << std::endl;
     std::cout << "    -numseekframe2 <from> <to> <num> - performs seeks to particular position in 2nd file. FROM - position FROM, TO - seek position, NUM - number of iterations" << std::endl;
+    std::cout << "    -align <integer>    - pair frames of both files within +/-<integer> frames, for dropped, duplicated or offset frames" << std::endl;
+    std::cout << "    -autoshift          - detect a spatial shift of the 2nd file by phase correlation and compare the overlapping areas" << std::endl;
+    std::cout << "    -readcache <integer> - keep up to <integer> decoded frames per input for revisits (default: 0)" << std::endl;
     std::cout << "    -nopfm              - suppress per-frame metrics output" << std::endl;
+    std::cout << "    -stats              - print count, min, max, 1st, 5th and 50th percentiles and a 20 bin histogram of every per-frame metric" << std::endl;
+    std::cout << "    -statsfile <file>   - same as -stats, merged with the statistics of earlier runs kept in the file, which then holds the total" << std::endl;
+    std::cout << "    -shm <name>         - publish the results of every frame to a ring in POSIX shared memory <name> (e.g. /mcl) for live readers" << std::endl;
+    std::cout << "    -screen <dB>        - screen all frames by luma PSNR of 4x4 block means first, SSIM, MS-SSIM, MWDVQM and UQI" << std::endl;
+    std::cout << "                          are only computed on frames screened below <dB>, other frames report nan for them" << std::endl;
+    std::cout << "    -screenbase <file> <dB> - also score frames screened more than <dB> below the same frame of a baseline run," << std::endl;
+    std::cout << "                          the file is written by the first run" << std::endl;
+    std::cout << "    -screenwin <n>      - score <n> frames before and after every frame picked by screening as well" << std::endl;
     std::cout << "    -st type1 [type2]   - input sequences type (type1 for both sequences, type2 override type for second sequence)" << std::endl;
     std::cout << "                          4:2:0 types: i420p (default), i420i, yv12p, nv12p, yv12i, nv12i" << std::endl;
     std::cout << "                          4:2:2 types: yuy2p, yuy2i, nv16p, nv16i, i422p, i422i" << std::endl;
     std::cout << "                          4:4:4 types: ayuvp, ayuvi, y410p, y410i, y416p, y416i, i444p, i444i, i410p, i410i" << std::endl;
     std::cout << "                          RGB types  : rgb32p, rgb32i, rgbpp, rgbpi, a2rgb10p, a2rgb10i, argb16p" << std::endl;
+    std::cout << "    -w2 <integer>       - width of the 2nd sequence when it differs, it is resized to the 1st one" << std::endl;
+    std::cout << "    -h2 <integer>       - height of the 2nd sequence when it differs" << std::endl;
+    std::cout << "    -scaler <filter>    - resize filter for the 2nd sequence (default: bicubic)" << std::endl;
+    std::cout << "                          Possible values: bilinear, bicubic, lanczos" << std::endl;
     std::cout << "    -bd <integer>       - bit depth of sequences pixels" << std::endl;
     std::cout << "                          Possible values: 8, 10, 12, 16" << std::endl;
     std::cout << "    -rshift1 <integer>  - shift pixel values for <integer> bits to the right in first file" << std::endl;
@@ -1308,6 +3302,24 @@ int32_t usage(void)
     std::cout << "    -btm_first          - bottom field first for interlaced sources" << std::endl;
     std::cout << "    -btm_first1         - bottom field first for the 1st source" << std::endl;
     std::cout << "    -btm_first2         - bottom field first for the 2nd source" << std::endl;
+    std::cout << "    -densefields        - split interlaced frames into contiguous field buffers instead of strided views" << std::endl;
+    std::cout << "    -threads <integer>  - number of worker threads (default: number of processors)" << std::endl;
+    std::cout << "    -max-mem <integer>  - memory budget in megabytes, SSIM is computed in bands of rows when whole planes do not fit" << std::endl;
+    std::cout << "    -spill <integer>    - per-frame results above this many megabytes are kept in a mapped temporary file (default 256)" << std::endl;
+    std::cout << "    -affinity           - pin worker threads over NUMA nodes and physical cores, buffers are placed next to their workers" << std::endl;
+    std::cout << "    -hugepages <mode>   - back large buffers with huge pages" << std::endl;
+    std::cout << "                          Possible values: thp (transparent), explicit (reserved, falls back to thp)" << std::endl;
+    std::cout << "    -prefault           - fault in new buffers at allocation instead of during the first frame" << std::endl;
+    std::cout << "    -reuse              - repeat the results of the previous frame when both inputs repeat it" << std::endl;
+    std::cout << "    -cache <filename>   - keep per-frame results in a file keyed by frame content, unchanged frames are not evaluated again" << std::endl;
+    std::cout << "    -cpu <level>        - highest instruction set used by the kernels (default: best supported by the processor)" << std::endl;
+    std::cout << "                          Possible values: scalar, sse42, avx2, avx512" << std::endl;
+    std::cout << "    -perf               - print the CPU level and buffer allocation counters for setup, first frame and the following frames" << std::endl;
+    std::cout << "    -explain            - print the intermediates the metrics are computed from, their order and estimated cost, then exit" << std::endl;
+#if !defined(NO_IPP) && !defined(LEGACY_IPP)
+    std::cout << "    -half <format>      - keep MS-SSIM planes and pyramid in half precision to save memory on very large frames" << std::endl;
+    std::cout << "                          Possible values: fp16 (up to 12 bits), bf16" << std::endl;
+#endif
     std::cout << "NOTES:    1. Different chromaticity representations can be compared on Y channel only." << std::endl;
     std::cout << "          2. In case of 10 bits non-zero values must be located from bit #0 to bit #9." << std::endl;
     std::cout << "             If such bits are located from bit #6 to bit #15 use parameters \"-rshift1 6 -rshift2 6\"" << std::endl;
@@ -1320,10 +3332,11 @@ int32_t usage(void)
     return -1;
 }
 
-int32_t parse_metrics(Component &cmps, int32_t argc, char** argv, int32_t curc)
+int32_t parse_metrics(Component &cmps, std::vector< SSampling > &sampling, int32_t argc, char** argv, int32_t curc)
 {
     uint32_t cm;
     bool         not_metric, not_plane;
+    SSampling    smp;
 
     while ( curc < argc ) {
         cm = 0; not_metric = true;
@@ -1331,6 +3344,10 @@ int32_t parse_metrics(Component &cmps, int32_t argc, char** argv, int32_t curc)
             if      ( strcmp( argv[curc], "psnr" ) == 0      && curc + 1 < argc ) { cm |= MASK_PSNR; cm |= MASK_MSE; curc++; not_metric = false; }
             else if ( strcmp( argv[curc], "apsnr" ) == 0     && curc + 1 < argc ) { cm |= MASK_APSNR; cm |= MASK_MSE; curc++; not_metric = false; }
             else if ( strcmp( argv[curc], "ssim" ) == 0      && curc + 1 < argc ) { cm |= MASK_SSIM; curc++; not_metric = false; }
+            else if ( strcmp( argv[curc], "ssim_fast" ) == 0 && curc + 1 < argc ) { cm |= MASK_SSIM_FAST; curc++; not_metric = false; }
+            else if ( strcmp( argv[curc], "ssim_box" ) == 0  && curc + 1 < argc ) { cm |= MASK_SSIM_BOX; curc++; not_metric = false; }
+            else if ( strcmp( argv[curc], "tpsnr" ) == 0     && curc + 1 < argc ) { cm |= MASK_TPSNR; curc++; not_metric = false; }
+            else if ( strcmp( argv[curc], "tflicker" ) == 0  && curc + 1 < argc ) { cm |= MASK_TFLICKER; curc++; not_metric = false; }
 #if !defined(NO_IPP) && !defined(LEGACY_IPP)
             else if ( strcmp( argv[curc], "artifacts" ) == 0 && curc + 1 < argc ) { cm |= MASK_ARTIFACTS; curc++; not_metric = false; }
             else if ( strcmp( argv[curc], "mwdvqm" ) == 0    && curc + 1 < argc ) { cm |= MASK_MWDVQM; curc++; not_metric = false; }
@@ -1341,16 +3358,22 @@ int32_t parse_metrics(Component &cmps, int32_t argc, char** argv, int32_t curc)
         }
         if (not_metric) return -1;
 
-        not_plane = true;
+        not_plane = true; smp.planes = 0;
         while ( curc < argc ) {
-            if      ( *argv[curc] == tolower(cmps[0].first) ) { cmps[0].second |= cm; curc++; not_plane = false;}
-            else if ( *argv[curc] == tolower(cmps[1].first) ) { cmps[1].second |= cm; curc++; not_plane = false;}
-            else if ( *argv[curc] == tolower(cmps[2].first) ) { cmps[2].second |= cm; curc++; not_plane = false;}
-            else if ( strcmp( argv[curc], "overall" ) == 0  ) { cmps[cmps.size()-1].second |= cm; curc++; not_plane = false;}
-            else if ( strcmp( argv[curc], "all" ) == 0 ) { for(size_t i = 0; i < cmps.size(); i++) cmps[i].second |= cm; curc++; not_plane = false;}
+            if      ( *argv[curc] == tolower(cmps[0].first) ) { cmps[0].second |= cm; smp.planes |= 1; curc++; not_plane = false;}
+            else if ( *argv[curc] == tolower(cmps[1].first) ) { cmps[1].second |= cm; smp.planes |= 2; curc++; not_plane = false;}
+            else if ( *argv[curc] == tolower(cmps[2].first) ) { cmps[2].second |= cm; smp.planes |= 4; curc++; not_plane = false;}
+            else if ( strcmp( argv[curc], "overall" ) == 0  ) { cmps[cmps.size()-1].second |= cm; smp.planes |= 1 << (cmps.size()-1); curc++; not_plane = false;}
+            else if ( strcmp( argv[curc], "all" ) == 0 ) { for(size_t i = 0; i < cmps.size(); i++) cmps[i].second |= cm; smp.planes |= (1 << cmps.size()) - 1; curc++; not_plane = false;}
             else break;
         }
         if (not_plane) return -1;
+
+        smp.mask = cm; smp.every = 1; smp.random = 0;
+        if      ( curc + 1 < argc && strcmp( argv[curc], "every" ) == 0  ) { smp.every = atoi(argv[curc + 1]); curc += 2; if (smp.every < 1) return -1; }
+        else if ( curc + 1 < argc && strcmp( argv[curc], "sample" ) == 0 ) { smp.random = atoi(argv[curc + 1]); curc += 2; if (smp.random < 1) return -1; }
+        if ((smp.every > 1 || smp.random) && (cm & (MASK_TPSNR | MASK_TFLICKER))) return -1;
+        sampling.push_back(smp);
     }
 
     return 0;
@@ -1393,26 +3416,34 @@ void parse_fourcc(char* str, ESequenceType& sq_type, EBitDepth& bd)
 int32_t main(int32_t argc, char** argv)
 {
     Component     cmps; // Y,U,V,Overall or B,G,R,A,Overall
-    int32_t       cur_param, w, h, i, j, order1, order2;
+    int32_t       cur_param, w, h, w2, h2, i, j, order1, order2;
     int32_t       fm1_cntr, fm1_frst, fm1_step,
                   fm2_cntr, fm2_frst, fm2_step,
                   seek_from1, seek_to1, seek_num1,
-                  seek_from2, seek_to2, seek_num2;
-    std::string   input_name1, input_name2;
+                  seek_from2, seek_to2, seek_num2, align;
+    std::string   input_name1, input_name2, cache_name, stats_name, shm_name, screen_name;
     bool          no_pfm, alpha_channel;
     ESequenceType sq1_type, sq2_type;
     EBitDepth     bd;
-    uint32_t      rshift1, rshift2;
+    EFloatFormat  ff;
+    EResizeFilter scaler;
+    uint32_t      rshift1, rshift2, read_cache;
+    uint64_t      max_mem, spill;
+    double        screen_psnr, screen_drop;
+    int32_t       screen_win;
+    bool          affinity, prefault, perf, reuse, auto_shift, dense_fields, explain, print_stats;
+    EHugePages    hugepages;
 
     bool is_fs_set = false;
     bool is_fs1_set = false;
     bool is_fs2_set = false;
 
-    cur_param = 1; w = h = 0; sq1_type = sq2_type = I420P; bd = D008; no_pfm = false; alpha_channel = false; order1 = 0; order2 = 0; rshift1 = 0; rshift2 = 0;
+    cur_param = 1; w = h = w2 = h2 = 0; scaler = RS_BICUBIC; sq1_type = sq2_type = I420P; bd = D008; ff = FP32; max_mem = 0; spill = (uint64_t)256 << 20; screen_psnr = screen_drop = 0.0; screen_win = 0; affinity = false; prefault = false; perf = false; reuse = false; auto_shift = false; dense_fields = false; explain = false; print_stats = false; hugepages = HP_NONE; no_pfm = false; alpha_channel = false; order1 = 0; order2 = 0; rshift1 = 0; rshift2 = 0; read_cache = 0;
     fm1_cntr = -1; fm1_frst = 0; fm1_step = 1;
     fm2_cntr = -1; fm2_frst = 0; fm2_step = 1;
     seek_num1 = 0; seek_from1 = -1; seek_to1 = -1;
     seek_num2 = 0; seek_from2 = -1; seek_to2 = -1;
+    align = -1;
     while ( cur_param < argc ) {
         if ( strcmp( argv[cur_param], "-i1" ) == 0 && cur_param + 1 < argc ) {
             input_name1 = argv[ cur_param + 1 ]; cur_param += 2;
@@ -1450,6 +3481,18 @@ int32_t main(int32_t argc, char** argv)
             cur_param += 4;
         } else if ( strcmp( argv[cur_param], "-nopfm" ) == 0 ) {
             no_pfm = true; cur_param += 1;
+        } else if ( strcmp( argv[cur_param], "-stats" ) == 0 ) {
+            print_stats = true; cur_param += 1;
+        } else if ( strcmp( argv[cur_param], "-statsfile" ) == 0 && cur_param + 1 < argc ) {
+            print_stats = true; stats_name = argv[ cur_param + 1 ]; cur_param += 2;
+        } else if ( strcmp( argv[cur_param], "-shm" ) == 0 && cur_param + 1 < argc ) {
+            shm_name = argv[ cur_param + 1 ]; cur_param += 2;
+        } else if ( strcmp( argv[cur_param], "-screen" ) == 0 && cur_param + 1 < argc ) {
+            screen_psnr = atof(argv[ cur_param + 1 ]); cur_param += 2;
+        } else if ( strcmp( argv[cur_param], "-screenbase" ) == 0 && cur_param + 2 < argc ) {
+            screen_name = argv[ cur_param + 1 ]; screen_drop = atof(argv[ cur_param + 2 ]); cur_param += 3;
+        } else if ( strcmp( argv[cur_param], "-screenwin" ) == 0 && cur_param + 1 < argc ) {
+            screen_win = (std::max)(atoi(argv[ cur_param + 1 ]), 0); cur_param += 2;
         } else if ( strcmp( argv[cur_param], "-alpha" ) == 0 ) {
             alpha_channel = true; cur_param += 1;
         } else if ( strcmp( argv[cur_param], "-btm_first" ) == 0 ) {
@@ -1458,6 +3501,8 @@ int32_t main(int32_t argc, char** argv)
             order1 = 1; cur_param += 1;
         } else if ( strcmp( argv[cur_param], "-btm_first2" ) == 0 ) {
             order2 = 1; cur_param += 1;
+        } else if ( strcmp( argv[cur_param], "-densefields" ) == 0 ) {
+            dense_fields = true; cur_param += 1;
         } else if ( strcmp( argv[cur_param], "-numseekframe1" ) == 0 ) {
             if (!is_fs_set && !is_fs1_set && !is_fs2_set) {
                 seek_from1 = atoi(argv[ cur_param + 1 ]);
@@ -1475,6 +3520,57 @@ int32_t main(int32_t argc, char** argv)
                 cur_param += 4;
             } else {
                 std::cout << errors_table[11] << std::endl; return -11; }
+        } else if ( strcmp( argv[cur_param], "-align" ) == 0 && cur_param + 1 < argc ) {
+            align = (std::max)(atoi(argv[ cur_param + 1 ]), 0); cur_param += 2;
+        } else if ( strcmp( argv[cur_param], "-autoshift" ) == 0 ) {
+            auto_shift = true; cur_param += 1;
+        } else if ( strcmp( argv[cur_param], "-explain" ) == 0 ) {
+            explain = true; cur_param += 1;
+        } else if ( strcmp( argv[cur_param], "-readcache" ) == 0 && cur_param + 1 < argc ) {
+            read_cache = (uint32_t)strtoul(argv[ cur_param + 1 ], NULL, 10); cur_param += 2;
+        } else if ( strcmp( argv[cur_param], "-threads" ) == 0 && cur_param + 1 < argc ) {
+            mclSetNumThreads(atoi(argv[ cur_param + 1 ])); cur_param += 2;
+        } else if ( strcmp( argv[cur_param], "-affinity" ) == 0 ) {
+            affinity = true; cur_param += 1;
+        } else if ( strcmp( argv[cur_param], "-prefault" ) == 0 ) {
+            prefault = true; cur_param += 1;
+        } else if ( strcmp( argv[cur_param], "-cache" ) == 0 && cur_param + 1 < argc ) {
+            cache_name = argv[ cur_param + 1 ]; cur_param += 2;
+        } else if ( strcmp( argv[cur_param], "-reuse" ) == 0 ) {
+            reuse = true; cur_param += 1;
+        } else if ( strcmp( argv[cur_param], "-perf" ) == 0 ) {
+            perf = true; cur_param += 1;
+        } else if ( strcmp( argv[cur_param], "-cpu" ) == 0 && cur_param + 1 < argc ) {
+            int32_t l;
+            for (l = CPU_AVX512; l >= CPU_SCALAR; l--) if (strcmp(argv[cur_param + 1], mclGetCpuLevelName((ECpuLevel)l)) == 0) break;
+            if (l < CPU_SCALAR) { std::cout << errors_table[20] << std::endl; return -20; }
+            if (!mclSetCpuLevel((ECpuLevel)l)) { std::cout << errors_table[21] << std::endl; }
+            cur_param += 2;
+        } else if ( strcmp( argv[cur_param], "-hugepages" ) == 0 && cur_param + 1 < argc ) {
+            if( strcmp( argv[cur_param + 1], "thp" ) == 0 )           { hugepages = HP_TRANSPARENT; cur_param += 2; }
+            else if( strcmp( argv[cur_param + 1], "explicit" ) == 0 ) { hugepages = HP_EXPLICIT; cur_param += 2; }
+            else { std::cout << errors_table[19] << std::endl; return -19;}
+        } else if ( strcmp( argv[cur_param], "-max-mem" ) == 0 && cur_param + 1 < argc ) {
+            if (!ParseMegabytes(argv[ cur_param + 1 ], max_mem)) { std::cout << errors_table[33] << std::endl; return -33; }
+            cur_param += 2;
+        } else if ( strcmp( argv[cur_param], "-spill" ) == 0 && cur_param + 1 < argc ) {
+            if (!ParseMegabytes(argv[ cur_param + 1 ], spill)) { std::cout << errors_table[33] << std::endl; return -33; }
+            cur_param += 2;
+#if !defined(NO_IPP) && !defined(LEGACY_IPP)
+        } else if ( strcmp( argv[cur_param], "-half" ) == 0 && cur_param + 1 < argc ) {
+            if( strcmp( argv[cur_param + 1], "fp16" ) == 0 )      { ff = FP16; cur_param += 2; }
+            else if( strcmp( argv[cur_param + 1], "bf16" ) == 0 ) { ff = BF16; cur_param += 2; }
+            else { std::cout << errors_table[32] << std::endl; return -32;}
+#endif
+        } else if ( strcmp( argv[cur_param], "-w2" ) == 0 && cur_param + 1 < argc ) {
+            w2 = atoi(argv[ cur_param + 1 ]); cur_param += 2;
+        } else if ( strcmp( argv[cur_param], "-h2" ) == 0 && cur_param + 1 < argc ) {
+            h2 = atoi(argv[ cur_param + 1 ]); cur_param += 2;
+        } else if ( strcmp( argv[cur_param], "-scaler" ) == 0 && cur_param + 1 < argc ) {
+            if( strcmp( argv[cur_param + 1], "bilinear" ) == 0 )     { scaler = RS_BILINEAR; cur_param += 2; }
+            else if( strcmp( argv[cur_param + 1], "bicubic" ) == 0 ) { scaler = RS_BICUBIC; cur_param += 2; }
+            else if( strcmp( argv[cur_param + 1], "lanczos" ) == 0 ) { scaler = RS_LANCZOS; cur_param += 2; }
+            else { std::cout << errors_table[25] << std::endl; return -25;}
         } else if ( strcmp( argv[cur_param], "-bd" ) == 0 && cur_param + 1 < argc ) {
             if( strcmp( argv[cur_param + 1], "8" ) == 0 )       { bd = D008; cur_param += 2; }
             else if( strcmp( argv[cur_param + 1], "10" ) == 0 ) { bd = D010; cur_param += 2; }
@@ -1499,6 +3595,9 @@ int32_t main(int32_t argc, char** argv)
     if( is_rgb(sq1_type) != is_rgb(sq2_type) ) {
         std::cout << errors_table[10] << std::endl; return -10;
     }
+    if( ff == FP16 && bd == D016 ) { std::cout << errors_table[16] << std::endl; return -16; }
+    if( affinity && !mclSetAffinity(true) ) { std::cout << errors_table[18] << std::endl; }
+    mclSetPoolOptions(hugepages, prefault);
 
     CReader *reader1 = 0, *reader2 = 0;
 
@@ -1511,13 +3610,16 @@ int32_t main(int32_t argc, char** argv)
         reader2 = new CYUVReader();
         INIT_YUV(cmps);
     }
+    reader1->SetCacheSize(read_cache); reader2->SetCacheSize(read_cache);
+    reader1->SetDenseFields(dense_fields); reader2->SetDenseFields(dense_fields);
 
     if ( input_name1.empty() || input_name2.empty() || w <= 0 || h <= 0 ) { return usage(); }
 
-    int32_t err = parse_metrics(cmps, argc, argv, cur_param);
+    std::vector< SSampling > sampling;
+    int32_t err = parse_metrics(cmps, sampling, argc, argv, cur_param);
     if ( err == -1 ) { std::cout << errors_table[0] << std::endl; return -1; }
 
-    char all_metrics_mask = 0;
+    uint32_t all_metrics_mask = 0;
     for (size_t i = 0; i < cmps.size(); i++) all_metrics_mask |= cmps[i].second;
     if ( !all_metrics_mask ) { std::cout << errors_table[1] << std::endl; return -2; };
 
@@ -1528,7 +3630,17 @@ int32_t main(int32_t argc, char** argv)
     if ( err == MCL_ERR_INVALID_PARAM ) { std::cout << errors_table[2] << std::endl; return -3; }
     if ( err == MCL_ERR_MEMORY_ALLOC )  { std::cout << errors_table[13] << std::endl; return -13; }
 
-    err = reader2->OpenReadFile( input_name2.c_str(), w, h, sq2_type, order2, bd, rshift2);
+    /* The 2nd input is resized to the plane sizes of the 1st one */
+    if (w2 <= 0) w2 = w;
+    if (h2 <= 0) h2 = h;
+    if (w2 != w || h2 != h) {
+        ImageSize size[4];
+
+        for (i = 0; i < 4; i++) { SImage plane; reader1->GetFrame(i, &plane); size[i] = plane.roi; }
+        reader2 = new CScaledReader(reader2, size, scaler);
+    }
+
+    err = reader2->OpenReadFile( input_name2.c_str(), w2, h2, sq2_type, order2, bd, rshift2);
     if ( err == MCL_ERR_INVALID_PARAM ) { std::cout << errors_table[3] << std::endl; return -4; }
     if ( err == MCL_ERR_MEMORY_ALLOC )  { std::cout << errors_table[13] << std::endl; return -13; }
 
@@ -1582,8 +3694,55 @@ int32_t main(int32_t argc, char** argv)
         }
     }
 
+    /* Aligned pairs replace the frame selection */
+    std::vector< std::pair< int32_t, int32_t > > pairs;
+    int32_t dropped = 0, duplicated = 0;
+    if (align >= 0) {
+        CTemporalAligner aligner;
+
+        if (is_fs_set || is_fs1_set || is_fs2_set || seek_num1 > 0 || seek_num2 > 0) { std::cout << errors_table[24] << std::endl; return -24; }
+        if (aligner.Build(reader1, 0, align) != MCL_ERR_NONE || aligner.Build(reader2, 1, align) != MCL_ERR_NONE) { std::cout << errors_table[13] << std::endl; return -13; }
+        aligner.Align(pairs, dropped, duplicated);
+        if (pairs.empty()) { std::cout << errors_table[5] << std::endl; return -6; }
+        fm1_cntr = fm2_cntr = (int32_t)pairs.size();
+    }
+
     const int32_t fm_count = std::min(fm1_cntr, fm2_cntr);
 
+    /* Shift of the 2nd input from the average phase correlation of a few luma pairs, both inputs are then
+       compared over their overlapping area */
+    double  shift_dx = 0.0, shift_dy = 0.0, shift_peak = 0.0;
+    int32_t shift_x = 0, shift_y = 0;
+    if (auto_shift) {
+        SImage  p1, p2;
+        int32_t order = 0, samples = (std::min)(fm_count, max_shift_samples), count = 0;
+
+        reader1->ReadRawFrame(pairs.empty() ? fm1_frst : pairs[0].first);
+        reader1->GetFrame(0, &p1);
+        while ((2 << order) <= (std::min)((std::min)(p1.roi.width, p1.roi.height), max_shift_size)) order++;
+
+        std::vector< double > acc((size_t)2 << (2 * order), 0.0);
+        for (i = 0; i < samples && order >= 3; i++) {
+            int32_t f = (int32_t)((int64_t)i * fm_count / samples);
+            int32_t f1 = pairs.empty() ? fm1_frst + f * fm1_step : pairs[f].first, f2 = pairs.empty() ? fm2_frst + f * fm2_step : pairs[f].second;
+
+            if (f1 >= frames1 || f2 >= frames2) continue;
+            reader1->ReadRawFrame(f1); reader2->ReadRawFrame(f2);
+            reader1->GetFrame(0, &p1); reader2->GetFrame(0, &p2);
+            if (mclCrossPower_C1R(p1.data, p1.step, p2.data, p2.step, p1.roi, order, &acc[0], bd) == MCL_ERR_NONE) count++;
+        }
+        if (count && mclPhaseCorrelationPeak(&acc[0], order, count, shift_dx, shift_dy, shift_peak) == MCL_ERR_NONE && shift_peak >= min_shift_peak) {
+            ImagePoint org1, org2;
+            ImageSize  size;
+
+            shift_x = (int32_t)floor(shift_dx + 0.5); shift_y = (int32_t)floor(shift_dy + 0.5);
+            org1.x = (std::max)(-shift_x, 0); org1.y = (std::max)(-shift_y, 0);
+            org2.x = (std::max)(shift_x, 0);  org2.y = (std::max)(shift_y, 0);
+            size.width = p1.roi.width - abs(shift_x); size.height = p1.roi.height - abs(shift_y);
+            reader1->SetWindow(org1, size); reader2->SetWindow(org2, size);
+        }
+    }
+
 #if !defined(NO_IPP)
     ippInit();
 #endif
@@ -1591,43 +3750,249 @@ int32_t main(int32_t argc, char** argv)
     std::vector < std::string >            metric_names;            // metric names
     std::vector < bool >                   out_flags;
     std::vector < double >                 avg_values;              // average per-sequence metric data
-    std::vector < std::vector < double > > all_values ( fm_count ); // perframe metric data
-    uint32_t                               all_metrics;
+    CResultTable                           all_values;              // perframe metric data
     double                                 norm;
 
     std::vector< CMetricEvaluator* > mevs;
 
-    all_metrics = cmps[0].second | cmps[1].second | cmps[2].second | cmps[3].second;
+    CMetricPlan plan;
+    plan.Build(cmps, reader1);
+    if (explain) {
+        plan.Print(cmps, fm_count);
+        delete reader1;
+        delete reader2;
+        return 0;
+    }
 
-    if (all_metrics & (MASK_PSNR|MASK_APSNR))
+    if (plan.Needs(CMetricPlan::NODE_SSE))
         mevs.push_back( new CPSNREvaluator() );
 
 #if defined(NO_IPP) || defined(LEGACY_IPP)
-    if (all_metrics & (MASK_SSIM))
+    if (plan.Needs(CMetricPlan::NODE_SSIM))
         mevs.push_back( new CSSIMEvaluator() );
 #else
-    if (all_metrics & (MASK_SSIM | MASK_MSSIM | MASK_ARTIFACTS))
+    if (plan.Needs(CMetricPlan::NODE_SSIM))
         mevs.push_back(new CMSSIMEvaluator());
 
-    if (all_metrics & MASK_MWDVQM)
+    if (plan.Needs(CMetricPlan::NODE_MWDVQM))
         mevs.push_back( new CMWDVQMEvaluator() );
 
-    if (all_metrics & MASK_UQI)
+    if (plan.Needs(CMetricPlan::NODE_UQI))
         mevs.push_back( new CUQIEvaluator() );
 #endif
 
+    if (plan.Needs(CMetricPlan::NODE_SSIM_FAST) || plan.Needs(CMetricPlan::NODE_SSIM_BOX))
+        mevs.push_back( new CSSIMBlockEvaluator() );
+
+    if (plan.Needs(CMetricPlan::NODE_TEMPORAL))
+        mevs.push_back( new CTemporalEvaluator() );
+
+    /* Temporal scores depend on the previous picture, and cached and repeated results do not record which
+       evaluators a frame was left out of, so pictures are never taken from repeats or the result cache then */
+    const bool screening = screen_psnr > 0.0 || !screen_name.empty();
+    bool       sparse = false;
+    for (i = 0; i < (int)sampling.size(); i++) sparse = sparse || sampling[i].every > 1 || sampling[i].random;
+    if ( (plan.Needs(CMetricPlan::NODE_TEMPORAL) || screening || sparse) && (reuse || !cache_name.empty()) ) {
+        std::cout << errors_table[31] << std::endl;
+        reuse = false; cache_name.clear();
+    }
+
+    CFrameStore store;
+    CFusedPass  fused;
+    store.InitFrameParams(reader1, reader2);
+#if !defined(NO_IPP) && !defined(LEGACY_IPP)
+    store.SetFloatFormat(ff);
+#endif
+    std::vector< int32_t > metric_first(1, 0);                // Evaluator i adds metrics metric_first[i]..metric_first[i+1]-1
     for (i = 0; i < (int)mevs.size(); i++) {
-        mevs[i]->InitFrameParams(reader1, reader2);
+        mevs[i]->InitFrameParams(reader1, reader2, &store);
+        mevs[i]->SetPlan(&plan);
         mevs[i]->InitComputationParams(cmps, metric_names, out_flags, avg_values);
+        metric_first.push_back((int32_t)metric_names.size());
+    }
+    if ( max_mem ) {
+        int32_t band = FitBandHeight(mevs, reader1, reader2, max_mem);
+        if ( band < 0 ) { std::cout << errors_table[17] << std::endl; return -17; }
+        store.SetBandHeight(band);
+    }
+    if ( fused.Init(reader1, reader2, &store, cmps) != MCL_ERR_NONE ) { std::cout << errors_table[13] << std::endl; return -13; }
+    if ( reuse && store.ReserveRepeatCheck((uint32_t)cmps.size() - 1) != MCL_ERR_NONE ) { std::cout << errors_table[13] << std::endl; return -13; }
+
+    for (i = 0; i < (int)mevs.size(); i++) {
         err = mevs[i]->AllocateResourses();
-        if ( err == -2 ) { std::cout << errors_table[13] << std::endl; return -13; }
+        if ( err == -2 || err == MCL_ERR_MEMORY_ALLOC ) { std::cout << errors_table[13] << std::endl; return -13; }
+        if ( err == MCL_ERR_INVALID_PARAM ) { std::cout << errors_table[15] << std::endl; return -15; }
+        if ( err != MCL_ERR_NONE ) { std::cout << errors_table[4] << std::endl; return -5; }
+    }
+
+    /* Per-frame storage is reserved up front, so the frame loop allocates only through the buffer pool */
+    if ( all_values.Init(metric_names.size(), no_pfm ? 0 : fm_count, spill) != MCL_ERR_NONE ) { std::cout << errors_table[13] << std::endl; return -13; }
+    std::vector < double > frame_val;                         // Values of one frame in metric order
+    frame_val.reserve(metric_names.size());
+
+    /* Distribution of every printed per-frame metric, updated as frames complete */
+    std::vector < int32_t >      stats_idx;
+    std::vector < CMetricStats > stats;
+    if ( print_stats ) {
+        for (i = 0; i < (int)metric_names.size(); i++) {
+            if (out_flags[i] && metric_names[i].find("MSE") == std::string::npos && metric_names[i].find("APSNR") == std::string::npos) stats_idx.push_back(i);
+        }
+        stats.resize(stats_idx.size());
+        for (i = 0; i < (int)stats.size(); i++) stats[i].Init(metric_names[stats_idx[i]]);
+    }
+    CResultRing ring;
+    if ( !shm_name.empty() && !ring.Create(shm_name, metric_names, fm_count) ) std::cout << errors_table[28] << std::endl;
+    std::vector < double > frame_avg ( avg_values.size() ); // Contributions of one frame, added again for repeats
+
+    /* Everything the results depend on besides the frame content */
+    CResultCache cache;
+    if ( !cache_name.empty() ) {
+        std::ostringstream config;
+        ImageSize          csz;
+
+#if defined(NO_IPP)
+        config << "c";
+#elif defined(LEGACY_IPP)
+        config << "ippl";
+#else
+        config << "ipp";
+#endif
+        config << " " << w << "x" << h << " " << sq1_type << " " << sq2_type << " " << bd << " " << rshift1 << " " << rshift2 << " " << order1 << " " << order2;
+        config << " " << ff << " " << store.GetBandHeight() << " " << shift_x << " " << shift_y << " " << w2 << "x" << h2 << " " << scaler;
+        for (i = 0; i < (int)metric_names.size(); i++) config << " " << metric_names[i];
+        csz.width = (int32_t)config.str().size(); csz.height = 1;
+        if ( !cache.Load(cache_name, mclHash_C1R((const uint8_t*)config.str().c_str(), csz.width, csz, D008, 0), (uint32_t)metric_names.size(), (uint32_t)avg_values.size()) )
+            std::cout << errors_table[22] << std::endl;
+    }
+
+    /* Screening pass: every frame gets a cheap luma proxy, the heavy evaluators then run only on frames below the
+       threshold or below their baseline and on the frames around them */
+    std::vector< double > proxy, screen_base;
+    std::vector< bool >   scored(fm_count, true);
+    if ( screening ) {
+        std::vector< bool > picked(fm_count, false);
+        int32_t f1 = fm1_frst, f2 = fm2_frst;
+        bool    all = false;
+
+        proxy.resize(fm_count);
+        for (i = 0; i < fm_count; i++, f1 += fm1_step, f2 += fm2_step) {
+            SImage p1, p2;
+            double mse = 0.0;
+
+            if(!pairs.empty()) { f1 = pairs[i].first; f2 = pairs[i].second; }
+            if(f1 == seek_from1) { f1 = seek_to1; }
+            if(f2 == seek_from2) { f2 = seek_to2; }
+            reader1->ReadRawFrame(f1); reader2->ReadRawFrame(f2);
+            reader1->GetFrame(0, &p1); reader2->GetFrame(0, &p2);
+            mclBlockMeanMSE_C1R(p1.data, p1.step, p2.data, p2.step, p1.roi, screen_block, mse, reader1->GetBitDepth());
+            proxy[i] = MSEToPSNR(mse, MaxError(reader1->GetBitDepth()));
+        }
+        if ( !screen_name.empty() ) {
+            if ( !LoadScreenBase(screen_name, fm_count, screen_base) ) std::cout << errors_table[29] << std::endl;
+            else if ( screen_base.empty() && !SaveScreenBase(screen_name, proxy) ) std::cout << errors_table[30] << std::endl;
+            all = screen_base.empty();
+        }
+        for (i = 0; i < fm_count; i++) {
+            picked[i] = all || (screen_psnr > 0.0 && proxy[i] < screen_psnr) || (!screen_base.empty() && proxy[i] < screen_base[i] - screen_drop);
+        }
+        for (i = 0; i < fm_count; i++) {
+            scored[i] = false;
+            for (j = (std::max)(i - screen_win, 0); j <= (std::min)(i + screen_win, fm_count - 1) && !scored[i]; j++) scored[i] = picked[j];
+        }
     }
+    /* Frames every metric is sampled on, the union of the groups asking for it on its plane. Evaluators run on the
+       union of their metrics, metrics no group asks for (e.g. MSE of PSNR, planes of overall) follow their evaluator */
+    std::vector< std::vector< bool > > sampled(mevs.size(), std::vector< bool >(sparse ? fm_count : 0, false));
+    std::vector< std::vector< bool > > msampled(metric_names.size(), std::vector< bool >(sparse ? fm_count : 0, false));
+    for (i = 0; sparse && i < (int)mevs.size(); i++) {
+        const std::vector< std::pair< uint32_t, uint32_t > > &outs = mevs[i]->GetOutputs();
+        std::vector< bool > asked(outs.size(), false);
+        bool                any = false;
+
+        for (size_t k = 0; k < outs.size(); k++) {
+            for (j = 0; j < (int)sampling.size(); j++) {
+                if (!(sampling[j].mask & outs[k].first) || !(sampling[j].planes & (1 << outs[k].second))) continue;
+                SampleFrames(sampling[j], msampled[metric_first[i] + k]);
+                asked[k] = any = true;
+            }
+            for (int32_t f = 0; asked[k] && f < fm_count; f++) sampled[i][f] = sampled[i][f] || msampled[metric_first[i] + k][f];
+        }
+        if (!any) sampled[i].assign(fm_count, true);
+        for (size_t k = 0; k < outs.size(); k++) {
+            if (!asked[k]) msampled[metric_first[i] + k] = sampled[i];
+        }
+    }
+    std::vector< bool >    due(mevs.size(), true);              // Evaluators run on the current frame, kept for repeats
+    std::vector< int32_t > covered(metric_names.size(), 0);     // Frames every metric was computed on
+    const double           skipped = std::numeric_limits< double >::quiet_NaN();
+
+    uint64_t pool_req[3], pool_alloc[3], pool_bytes;
+    mclGetPoolStats(pool_req[0], pool_alloc[0], pool_bytes);
+    pool_req[1] = pool_req[0]; pool_alloc[1] = pool_alloc[0];
 
     for (i = 0; i < fm_count; i++, fm1_frst+=fm1_step, fm2_frst+=fm2_step) {
+        if(i == 1) mclGetPoolStats(pool_req[1], pool_alloc[1], pool_bytes);
+        if(!pairs.empty()) { fm1_frst = pairs[i].first; fm2_frst = pairs[i].second; }
         if(fm1_frst == seek_from1) { fm1_frst = seek_to1; }
         if(fm2_frst == seek_from2) { fm2_frst = seek_to2; }
         reader1->ReadRawFrame(fm1_frst); reader2->ReadRawFrame(fm2_frst);
-        for (j = 0; j < (int)mevs.size(); j++) mevs[j]->ComputeMetrics(all_values[i],avg_values);
+        if (store.CheckRepeat()) {
+            all_values.Store(i, frame_val);
+        } else if (cache.IsActive()) {
+            std::pair< uint64_t, uint64_t > key = cache.FrameKey(reader1, reader2, (uint32_t)cmps.size() - 1);
+
+            if (!cache.Find(key, frame_val, frame_avg)) {
+                frame_val.clear();
+                std::fill(frame_avg.begin(), frame_avg.end(), 0.0);
+                if (fused.IsActive()) fused.Run();
+                for (j = 0; j < (int)mevs.size(); j++) mevs[j]->ComputeMetrics(frame_val,frame_avg);
+                store.Retire();
+                cache.Insert(key, frame_val, frame_avg);
+            }
+            all_values.Store(i, frame_val);
+        } else {
+            frame_val.clear();
+            std::fill(frame_avg.begin(), frame_avg.end(), 0.0);
+            bool all_due = true;
+            for (j = 0; j < (int)mevs.size(); j++) {
+                due[j] = (scored[i] || !mevs[j]->IsHeavy()) && (!sparse || sampled[j][i]);
+                all_due = all_due && due[j];
+            }
+            /* Evaluators build what they need on their own when the fused pass is left out */
+            if (fused.IsActive() && all_due) fused.Run();
+            for (j = 0; j < (int)mevs.size(); j++) {
+                if (due[j]) mevs[j]->ComputeMetrics(frame_val,frame_avg);
+                else        frame_val.resize(metric_first[j + 1], skipped);
+            }
+            /* Metrics of an evaluator run for other groups stay out of the frames their own group leaves out */
+            for (j = 0; sparse && j < (int)metric_names.size(); j++) {
+                if (!msampled[j][i]) { frame_val[j] = skipped; frame_avg[j] = 0.0; }
+            }
+            store.Retire();
+            all_values.Store(i, frame_val);
+        }
+        if (store.Failed()) { std::cout << errors_table[13] << std::endl; return -13; }
+        for (j = 0; j < (int)avg_values.size(); j++) avg_values[j] += frame_avg[j];
+        for (j = 0; j < (int)mevs.size(); j++) {
+            for (int32_t m = metric_first[j]; due[j] && m < metric_first[j + 1]; m++) covered[m] += ((!sparse || msampled[m][i]) && frame_val[m] == frame_val[m]) ? 1 : 0;
+        }
+        for (j = 0; j < (int)stats.size(); j++) {
+            if (frame_val[stats_idx[j]] == frame_val[stats_idx[j]]) stats[j].Add(frame_val[stats_idx[j]]);
+        }
+        if (ring.IsActive()) ring.Publish(i, fm1_frst, fm2_frst, frame_val);
+    }
+    mclGetPoolStats(pool_req[2], pool_alloc[2], pool_bytes);
+    uint64_t read_hits = reader1->GetCacheHits() + reader2->GetCacheHits(), read_misses = reader1->GetCacheMisses() + reader2->GetCacheMisses();
+    if ( cache.IsActive() && !cache.Save() ) { std::cout << errors_table[23] << std::endl; }
+    if ( !stats_name.empty() ) {
+        std::string names;
+        ImageSize   nsz;
+
+        for (i = 0; i < (int)stats_idx.size(); i++) names += metric_names[stats_idx[i]] + " ";
+        nsz.width = (int32_t)names.size(); nsz.height = 1;
+        uint64_t config = nsz.width ? mclHash_C1R((const uint8_t*)names.c_str(), nsz.width, nsz, D008, 0) : 0;
+        if ( !LoadStats(stats_name, config, stats) ) std::cout << errors_table[26] << std::endl;
+        if ( !SaveStats(stats_name, config, stats) ) std::cout << errors_table[27] << std::endl;
     }
 
     for (i = 0; i < (int)mevs.size(); i++) delete mevs[i];
@@ -1640,21 +4005,60 @@ int32_t main(int32_t argc, char** argv)
         }
     }
 
-    /* Output metrics to stdout */
+    /* Output frame pairing and metrics to stdout */
+    if(auto_shift) {
+        std::cout << "<align_metric=SHIFT> " << shift_x << " " << shift_y << "</align_metric>" << std::endl;
+        std::cout << "<align_metric=SHIFT_ESTIMATE> " << std::setprecision(2) << std::setiosflags(std::ios::fixed) << shift_dx << " " << shift_dy << " " << shift_peak << "</align_metric>" << std::endl;
+    }
+    if(align >= 0) {
+        std::cout << "<align_metric=DROPPED> " << dropped << "</align_metric>" << std::endl;
+        std::cout << "<align_metric=DUPLICATED> " << duplicated << "</align_metric>" << std::endl;
+        std::cout << "<align_metric=UNPAIRED> " << frames2 - fm_count << "</align_metric>" << std::endl;
+        if(!no_pfm) {
+            std::cout << "<align_metric=FRAME1>";
+            for (j = 0; j < fm_count; j++) std::cout << " " << pairs[j].first;
+            std::cout << "</align_metric>" << std::endl;
+            std::cout << "<align_metric=FRAME2>";
+            for (j = 0; j < fm_count; j++) std::cout << " " << pairs[j].second;
+            std::cout << "</align_metric>" << std::endl;
+        }
+    }
     if(!no_pfm) {
         for (i = 0; i < (int)metric_names.size(); i++) {
             if(!out_flags[i] || metric_names[i].find("APSNR")!=std::string::npos) continue;
+            const double *values = all_values.GetMetric(i);
+
             std::cout << "<pfr_metric=" << metric_names[i] << ">" << std::flush;
             for (j = 0; j < fm_count; j++) {
-                std::cout << " " << std::setw(8) << std::setprecision(5) << std::setiosflags(std::ios::fixed) << all_values[j][i];
+                std::cout << " " << std::setw(8) << std::setprecision(5) << std::setiosflags(std::ios::fixed) << values[j];
             }
             std::cout << "</pfr_metric>"<< std::endl;
         }
     }
 
-    /* Update average metric values and output metrics to stdout */
-    norm = 1.0 / fm_count;
+    for (i = 0; i < (int)metric_names.size(); i++) {
+        if(!out_flags[i] || covered[i] == fm_count) continue;
+        std::cout << "<cover_metric=" << metric_names[i] << "> " << covered[i] << "</cover_metric>" << std::endl;
+    }
+    if(screening) {
+        int32_t count = 0;
+
+        if(!no_pfm) {
+            std::cout << "<screen_metric=PROXY>";
+            for (j = 0; j < fm_count; j++) std::cout << " " << std::setw(8) << std::setprecision(5) << std::setiosflags(std::ios::fixed) << proxy[j];
+            std::cout << "</screen_metric>" << std::endl;
+            std::cout << "<screen_metric=SCORED>";
+            for (j = 0; j < fm_count; j++) std::cout << " " << (scored[j] ? 1 : 0);
+            std::cout << "</screen_metric>" << std::endl;
+        }
+        for (j = 0; j < fm_count; j++) count += scored[j] ? 1 : 0;
+        std::cout << "<screen_metric=SCORED_FRAMES> " << count << "</screen_metric>" << std::endl;
+    }
+
+    /* Update average metric values and output metrics to stdout, metrics left out of some frames by screening,
+       sampling or a missing previous picture average over the frames they were computed on */
     for (i = 0; i < (int32_t)avg_values.size(); i++) {
+        norm = covered[i] ? 1.0 / covered[i] : skipped;
         avg_values[i] *= norm;
         if(metric_names[i].find("PSNR")!=std::string::npos && metric_names[i].find("APSNR")==std::string::npos) avg_values[i] = MSEToPSNR(avg_values[i], MaxError(bd));
     }
@@ -1665,5 +4069,19 @@ int32_t main(int32_t argc, char** argv)
         std::cout << " " << std::setw(8) << std::setprecision(5) << std::setiosflags(std::ios::fixed) << avg_values[i];
         std::cout << "</avg_metric>"<< std::endl;
     }
+    for (i = 0; i < (int32_t)stats.size(); i++) stats[i].Print(metric_names[stats_idx[i]]);
+
+    if(perf) {
+        std::cout << "<perf_metric=CPU_LEVEL> " << mclGetCpuLevelName(mclGetCpuLevel()) << "</perf_metric>" << std::endl;
+        std::cout << "<perf_metric=POOL_SETUP> " << pool_req[0] << " requests, " << pool_alloc[0] << " allocations</perf_metric>" << std::endl;
+        std::cout << "<perf_metric=POOL_FIRST_FRAME> " << pool_req[1] - pool_req[0] << " requests, " << pool_alloc[1] - pool_alloc[0] << " allocations</perf_metric>" << std::endl;
+        std::cout << "<perf_metric=POOL_STEADY> " << pool_req[2] - pool_req[1] << " requests, " << pool_alloc[2] - pool_alloc[1] << " allocations</perf_metric>" << std::endl;
+        std::cout << "<perf_metric=POOL_BYTES> " << pool_bytes << "</perf_metric>" << std::endl;
+        std::cout << "<perf_metric=IDENTICAL_PLANES> " << store.GetIdenticalCount() << "</perf_metric>" << std::endl;
+        std::cout << "<perf_metric=REPEATED_FRAMES> " << store.GetRepeatCount() << "</perf_metric>" << std::endl;
+        std::cout << "<perf_metric=CACHED_FRAMES> " << cache.GetHits() << "</perf_metric>" << std::endl;
+        std::cout << "<perf_metric=READ_CACHE> " << read_hits << " hits, " << read_misses << " misses</perf_metric>" << std::endl;
+        std::cout << "<perf_metric=RESULT_TABLE> " << (uint64_t)metric_names.size() * fm_count * sizeof(double) << " bytes" << (all_values.IsMapped() ? ", mapped" : "") << "</perf_metric>" << std::endl;
+    }
     return 0;
 }
@@ -18,8 +18,41 @@
 // OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
 // SOFTWARE.
 
+#if defined(_OPENMP)
+#include <omp.h>
+#endif
+
 #include "metrics_calc_lite_utils.h"
 
+#if defined(__linux__)
+#include <sched.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define MCL_SSE2
+#endif
+
+/* Run-time dispatch: SIMD kernels are compiled for their instruction set whatever the build flags are,
+   and are only called when CPUID reports it */
+#if (defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))) || (defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86)))
+#define MCL_DISPATCH
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define MCL_TARGET(isa)
+#else
+#include <cpuid.h>
+#define MCL_TARGET(isa) __attribute__((target(isa)))
+#endif
+#if (defined(__clang__) && __clang_major__ >= 9) || (!defined(__clang__) && defined(__GNUC__) && __GNUC__ >= 10)
+#define MCL_AVX512BF16 // Compiler knows the BF16 conversion instructions
+#endif
+#endif
+
 #if !defined(NO_IPP)
 EErrorStatus stsIPPtoMCL(IppStatus sts)
 {
@@ -101,6 +134,193 @@ EChromaType get_chromaclass(ESequenceType st) {
     }
 }
 
+static int32_t mcl_num_threads = 0;
+
+void mclSetNumThreads(int32_t num)
+{
+    mcl_num_threads = (num > 0) ? num : 0;
+#if defined(_OPENMP)
+    if (mcl_num_threads) omp_set_num_threads(mcl_num_threads);
+#endif
+}
+
+int32_t mclGetNumThreads(void)
+{
+#if defined(_OPENMP)
+    return mcl_num_threads ? mcl_num_threads : omp_get_max_threads();
+#else
+    return 1; // Sequential build
+#endif
+}
+
+static bool mcl_cpu_bf16 = false;
+
+static ECpuLevel mcl_detect_cpu(void)
+{
+    ECpuLevel level = CPU_SCALAR;
+#if defined(MCL_DISPATCH)
+    uint32_t r1[4] = { 0, 0, 0, 0 }, r7[4] = { 0, 0, 0, 0 }, r71[4] = { 0, 0, 0, 0 }, max_leaf, xcr0 = 0;
+
+#if defined(_MSC_VER)
+    int32_t r[4];
+    __cpuid(r, 0); max_leaf = (uint32_t)r[0];
+    if (max_leaf >= 1) { __cpuidex(r, 1, 0); memcpy(r1, r, sizeof(r1)); }
+    if (max_leaf >= 7) { __cpuidex(r, 7, 0); memcpy(r7, r, sizeof(r7)); __cpuidex(r, 7, 1); memcpy(r71, r, sizeof(r71)); }
+    if (r1[2] & (1u << 27)) xcr0 = (uint32_t)_xgetbv(0);
+#else
+    max_leaf = __get_cpuid_max(0, 0);
+    if (max_leaf >= 1) __cpuid_count(1, 0, r1[0], r1[1], r1[2], r1[3]);
+    if (max_leaf >= 7) { __cpuid_count(7, 0, r7[0], r7[1], r7[2], r7[3]); __cpuid_count(7, 1, r71[0], r71[1], r71[2], r71[3]); }
+    if (r1[2] & (1u << 27)) { uint32_t edx; __asm__ __volatile__("xgetbv" : "=a"(xcr0), "=d"(edx) : "c"(0)); }
+#endif
+
+    // SSE4.1 + SSE4.2; AVX2 + F16C with YMM state enabled; AVX-512 F/BW/VL with ZMM state enabled
+    if ((r1[2] & (1u << 19)) && (r1[2] & (1u << 20))) level = CPU_SSE42;
+    if (level == CPU_SSE42 && (r1[2] & (1u << 28)) && (r1[2] & (1u << 29)) && (r7[1] & (1u << 5)) && (xcr0 & 0x6) == 0x6) level = CPU_AVX2;
+    if (level == CPU_AVX2 && (r7[1] & (1u << 16)) && (r7[1] & (1u << 30)) && (r7[1] & (1u << 31)) && (xcr0 & 0xe6) == 0xe6) level = CPU_AVX512;
+    mcl_cpu_bf16 = (level == CPU_AVX512) && (r71[0] & (1u << 5));
+#endif
+    return level;
+}
+
+static ECpuLevel mcl_cpu_detected = mcl_detect_cpu();
+static ECpuLevel mcl_cpu_level    = mcl_cpu_detected;
+
+bool mclSetCpuLevel(ECpuLevel level)
+{
+    mcl_cpu_level = std::min(level, mcl_cpu_detected);
+    return level <= mcl_cpu_detected;
+}
+
+ECpuLevel mclGetCpuLevel(void)
+{
+    return mcl_cpu_level;
+}
+
+const char* mclGetCpuLevelName(ECpuLevel level)
+{
+    static const char *names[] = { "scalar", "sse42", "avx2", "avx512" };
+    return names[level];
+}
+
+static std::vector<int32_t> mcl_cpu_order; // CPU of every worker, empty when workers are not pinned
+static int32_t              mcl_num_nodes = 1;
+
+#if defined(__linux__)
+/* Parse sysfs CPU list like "0-3,8-11" */
+static bool mcl_read_cpulist(const char *path, std::vector<int32_t> &cpus)
+{
+    FILE *fd = fopen(path, "r");
+    char  buf[4096];
+
+    cpus.clear();
+    if (!fd) return false;
+    if (!fgets(buf, sizeof(buf), fd)) { fclose(fd); return false; }
+    fclose(fd);
+
+    for (char *p = buf; *p && *p != '\n'; ) {
+        int32_t first = (int32_t)strtol(p, &p, 10), last = first;
+        if (*p == '-') last = (int32_t)strtol(p + 1, &p, 10);
+        for (int32_t c = first; c <= last; c++) cpus.push_back(c);
+        if (*p == ',') p++;
+        else if (*p && *p != '\n') return false;
+    }
+    return !cpus.empty();
+}
+#endif
+
+bool mclSetAffinity(bool enable)
+{
+    mcl_cpu_order.clear(); mcl_num_nodes = 1;
+    if (!enable) return true;
+
+#if defined(__linux__)
+    std::vector< std::vector<int32_t> > nodes;
+    std::vector<int32_t> cpus, siblings;
+    cpu_set_t allowed;
+    char      path[128];
+
+    if (sched_getaffinity(0, sizeof(allowed), &allowed)) return false;
+
+    // Node ids may have gaps, kernels without NUMA support have no node directories at all
+    for (int32_t n = 0; n < 1024; n++) {
+        snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", n);
+        if (!access(path, R_OK) && mcl_read_cpulist(path, cpus)) nodes.push_back(cpus);
+    }
+    if (nodes.empty()) {
+        if (!mcl_read_cpulist("/sys/devices/system/cpu/online", cpus)) return false;
+        nodes.push_back(cpus);
+    }
+
+    // Per node: one hardware thread of every physical core first, SMT siblings after them
+    std::vector< std::vector<int32_t> > order(nodes.size());
+    for (size_t n = 0; n < nodes.size(); n++) {
+        std::vector<int32_t> secondary;
+        for (size_t c = 0; c < nodes[n].size(); c++) {
+            int32_t cpu = nodes[n][c];
+            if (!CPU_ISSET(cpu, &allowed)) continue;
+            snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/thread_siblings_list", cpu);
+            if (mcl_read_cpulist(path, siblings) && siblings[0] != cpu) secondary.push_back(cpu);
+            else order[n].push_back(cpu);
+        }
+        order[n].insert(order[n].end(), secondary.begin(), secondary.end());
+    }
+
+    // Workers go round robin over the nodes
+    int32_t workers = mclGetNumThreads(), nodes_used = 0;
+    for (size_t n = 0; n < order.size(); n++) if (order[n].size()) nodes_used++;
+    if (!nodes_used) return false;
+    std::vector<size_t> next(order.size(), 0);
+    for (int32_t w = 0, n = 0; w < workers; n = (n + 1) % (int32_t)order.size()) {
+        if (!order[n].size()) continue;
+        mcl_cpu_order.push_back(order[n][next[n]++ % order[n].size()]);
+        w++;
+    }
+    mcl_num_nodes = nodes_used;
+
+    // Workers of the pool keep their ids between parallel regions of the same size
+#if defined(_OPENMP)
+    #pragma omp parallel num_threads(workers)
+    {
+        cpu_set_t set;
+        CPU_ZERO(&set); CPU_SET(mcl_cpu_order[omp_get_thread_num()], &set);
+        sched_setaffinity(0, sizeof(set), &set);
+    }
+#else
+    CPU_ZERO(&allowed); CPU_SET(mcl_cpu_order[0], &allowed);
+    sched_setaffinity(0, sizeof(allowed), &allowed);
+#endif
+    return true;
+#else
+    return false;
+#endif
+}
+
+int32_t mclGetNumNodes(void)
+{
+    return mcl_num_nodes;
+}
+
+static EHugePages mcl_hugepages = HP_NONE;
+static bool       mcl_prefault  = false;
+
+void mclFirstTouch(void* ptr, size_t size)
+{
+    if (!ptr || (mcl_num_nodes < 2 && !mcl_prefault)) return;
+
+    // Equal contiguous parts per worker, so rows of a frame land on the nodes of the workers processing them
+    int32_t workers = std::max((int32_t)mcl_cpu_order.size(), 1), w;
+    size_t  part = (size + workers - 1) / workers;
+
+#if defined(_OPENMP)
+    #pragma omp parallel for schedule(static,1) num_threads(workers)
+#endif
+    for (w = 0; w < workers; w++) {
+        size_t offset = (size_t)w * part;
+        if (offset < size) memset((uint8_t*)ptr + offset, 0, std::min(part, size - offset));
+    }
+}
+
 uint64_t _file_fseek(FILE *fd, int64_t position, int32_t mode)
 {
 #if defined(WIN32) || defined(WIN64)
@@ -123,25 +343,205 @@ uint64_t _file_ftell(FILE *fd)
 #endif
 }
 
-uint8_t* mclMalloc(uint32_t size, EBitDepth bd)
+/* Buffer pool: blocks go back to the pool on mclFree and are handed out again for requests of a similar
+   size, so reopening readers and reallocating evaluators does not hit the heap in steady state */
+typedef struct {
+    size_t size;   // Usable bytes
+    bool   mapped; // Explicit huge pages from mmap, otherwise aligned heap block
+} mcl_block;
+
+static const size_t mcl_align      = 64;
+static const size_t mcl_huge_size  = 2 * 1024 * 1024;
+
+static std::map<void*, mcl_block>   mcl_blocks; // Every block owned by the pool
+static std::multimap<size_t, void*> mcl_idle;   // Blocks available for reuse by size
+static uint64_t mcl_requests = 0, mcl_allocations = 0, mcl_pool_bytes = 0;
+
+static void* mcl_backend_alloc(size_t &size, bool &mapped)
 {
-#if defined(NO_IPP)
-    if      (bd == D008) return (uint8_t*)new uint8_t[size];
-    else if (bd == D010 || bd == D012 || bd == D016) return (uint8_t*)new uint16_t[size];
+    void *ptr = NULL;
+    bool  huge = (mcl_hugepages != HP_NONE) && (size >= mcl_huge_size);
+
+    mapped = false;
+#if defined(WIN32) || defined(WIN64)
+    ptr = _aligned_malloc(size, mcl_align);
+#else
+    if (huge) size = (size + mcl_huge_size - 1) & ~(mcl_huge_size - 1);
+#if defined(__linux__)
+    if (huge && mcl_hugepages == HP_EXPLICIT) {
+        ptr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (ptr != MAP_FAILED) { mapped = true; return ptr; }
+        ptr = NULL; // No huge pages reserved in the system, transparent ones are the next best thing
+    }
+#endif
+    if (posix_memalign(&ptr, huge ? mcl_huge_size : mcl_align, size)) return NULL;
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+    if (huge) madvise(ptr, size, MADV_HUGEPAGE);
+#endif
+#endif
+    return ptr;
+}
+
+static void mcl_backend_free(void *ptr, const mcl_block &block)
+{
+#if defined(WIN32) || defined(WIN64)
+    _aligned_free(ptr);
 #else
-    if      (bd == D008) return (uint8_t*)ippsMalloc_8u(size);
-    else if (bd == D010 || bd == D012 || bd == D016) return (uint8_t*)ippsMalloc_16u(size);
+#if defined(__linux__)
+    if (block.mapped) { munmap(ptr, block.size); return; }
+#endif
+    free(ptr);
+#endif
+}
+
+static struct mcl_pool_release {
+    ~mcl_pool_release() {
+        for (std::map<void*, mcl_block>::iterator it = mcl_blocks.begin(); it != mcl_blocks.end(); ++it) mcl_backend_free(it->first, it->second);
+    }
+} mcl_pool_release_at_exit;
+
+void mclSetPoolOptions(EHugePages hp, bool prefault)
+{
+    mcl_hugepages = hp; mcl_prefault = prefault;
+}
+
+void mclGetPoolStats(uint64_t &requests, uint64_t &allocations, uint64_t &bytes)
+{
+    requests = mcl_requests; allocations = mcl_allocations; bytes = mcl_pool_bytes;
+}
+
+void* mclPoolAlloc(size_t size)
+{
+    void *ptr = NULL;
+    bool  fresh = false;
+
+    size = (std::max(size, (size_t)1) + mcl_align - 1) & ~(mcl_align - 1);
+
+#if defined(_OPENMP)
+    #pragma omp critical(mcl_pool)
+#endif
+    {
+        std::multimap<size_t, void*>::iterator it = mcl_idle.lower_bound(size);
+
+        mcl_requests++;
+        if (it != mcl_idle.end() && it->first <= 2 * size) { // Do not waste more than the request itself
+            ptr = it->second;
+            mcl_idle.erase(it);
+        } else {
+            mcl_block block;
+            ptr = mcl_backend_alloc(size, block.mapped);
+            if (ptr) {
+                block.size = size;
+                mcl_blocks[ptr] = block;
+                mcl_allocations++; mcl_pool_bytes += size;
+                fresh = true;
+            }
+        }
+    }
+    if (fresh) mclFirstTouch(ptr, size);
+
+    return ptr;
+}
+
+void mclPoolFree(void* ptr)
+{
+    if (!ptr) return;
+
+#if defined(_OPENMP)
+    #pragma omp critical(mcl_pool)
 #endif
-    return NULL;
+    {
+        std::map<void*, mcl_block>::iterator it = mcl_blocks.find(ptr);
+        if (it != mcl_blocks.end()) mcl_idle.insert(std::make_pair(it->second.size, ptr));
+    }
+}
+
+uint8_t* mclMalloc(size_t size, EBitDepth bd)
+{
+    if (bd != D008 && bd != D010 && bd != D012 && bd != D016) return NULL;
+
+    return (uint8_t*)mclPoolAlloc((bd == D008) ? size : 2 * size);
 }
 
 float* mclMalloc_32f_C1(int32_t widthPixels, int32_t heightPixels, int32_t* pStepBytes)
 {
-#if defined(NO_IPP)
-    *pStepBytes = widthPixels << 2;
-    return new float[widthPixels * heightPixels];
+    int32_t step = (int32_t)((widthPixels * sizeof(float) + mcl_align - 1) & ~(mcl_align - 1));
+
+    if (!(step & 4095)) step += (int32_t)mcl_align; // Rows 4K apart alias in L1 and store forwarding
+    *pStepBytes = step;
+
+    return (float*)mclPoolAlloc((size_t)step * heightPixels);
+}
+
+void* mclMapTemp(size_t size)
+{
+    void *ptr = NULL;
+
+#if defined(__linux__)
+    const char *dir = getenv("TMPDIR"); // Spill where the user keeps large scratch files
+    std::string path = std::string(dir && *dir ? dir : "/tmp") + "/mcl_spill_XXXXXX";
+    std::vector<char> name(path.begin(), path.end());
+    int fd;
+
+    name.push_back('\0');
+    fd = mkstemp(&name[0]);
+    if (fd < 0) return NULL;
+    unlink(&name[0]); // The mapping keeps the file alive
+    if (!ftruncate(fd, (off_t)size)) {
+        ptr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (ptr == MAP_FAILED) ptr = NULL;
+    }
+    close(fd);
+#endif
+    return ptr;
+}
+
+void mclUnmapTemp(void* ptr, size_t size)
+{
+#if defined(__linux__)
+    if (ptr) munmap(ptr, size);
+#endif
+}
+
+void* mclShmCreate(const char* name, size_t size)
+{
+    void *ptr = NULL;
+
+#if defined(__linux__)
+    int fd = shm_open(name, O_CREAT | O_TRUNC | O_RDWR, 0644);
+
+    if (fd < 0) return NULL;
+    if (!ftruncate(fd, (off_t)size)) {
+        ptr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (ptr == MAP_FAILED) ptr = NULL;
+    }
+    close(fd);
+#endif
+    return ptr;
+}
+
+void mclShmClose(void* ptr, size_t size)
+{
+#if defined(__linux__)
+    if (ptr) munmap(ptr, size); // The object stays for late readers, they unlink it
+#endif
+}
+
+void mclStoreRelease(volatile uint64_t* ptr, uint64_t value)
+{
+#if defined(__GNUC__)
+    __atomic_store_n(ptr, value, __ATOMIC_RELEASE);
 #else
-    return ippiMalloc_32f_C1(widthPixels, heightPixels, pStepBytes);
+    *ptr = value; // x86 does not reorder stores
+#endif
+}
+
+void mclFence(void)
+{
+#if defined(__GNUC__)
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+#elif defined(_MSC_VER) && defined(MCL_DISPATCH)
+    _ReadWriteBarrier(); // Only x86 targets, stores are not reordered there
 #endif
 }
 
@@ -682,169 +1082,622 @@ EErrorStatus mclRShiftC_C1IR(uint32_t value, uint8_t* pSrcDst, int32_t srcDstSte
     return MCL_ERR_INVALID_PARAM;
 }
 
-EErrorStatus mclNormDiff_L2_8u_C1R(const uint8_t* pSrc1, int32_t src1Step, const uint8_t* pSrc2, int32_t src2Step, ImageSize roiSize, double* pValue)
+template< typename T >
+static EErrorStatus mcl_RShiftC_C1R(uint32_t value, const uint8_t* pSrc, int32_t srcStep, uint8_t* pDst, int32_t dstStep, ImageSize roiSize)
 {
-    if (!pSrc1 || !pSrc2 || !pValue)             return MCL_ERR_NULL_PTR;
+    if (!pSrc || !pDst)                          return MCL_ERR_NULL_PTR;
+    if (value >= 8 * sizeof(T))                  return MCL_ERR_INVALID_PARAM;
     if (roiSize.width < 1 || roiSize.height < 1) return MCL_ERR_INVALID_PARAM;
 
-    uint8_t *src1, *src2;
-
-    *pValue = 0.0;
-
-    for(int32_t h = 0; h < roiSize.height; h++)
-    {
-        src1 = (uint8_t*)pSrc1 + h * src1Step;
-        src2 = (uint8_t*)pSrc2 + h * src2Step;
+    for (int32_t h = 0; h < roiSize.height; h++) {
+        const T *src = (const T*)(pSrc + (size_t)h * srcStep);
+        T       *dst = (T*)(pDst + (size_t)h * dstStep);
 
-        for(int32_t w = 0; w < roiSize.width; w++)
-        {
-            *pValue += (src1[w] - src2[w]) * (src1[w] - src2[w]);
-        }
+        if (!value) { memcpy(dst, src, (size_t)roiSize.width * sizeof(T)); continue; }
+        for (int32_t w = 0; w < roiSize.width; w++) dst[w] = (T)(src[w] >> value);
     }
-
-    *pValue = sqrt(*pValue);
-
     return MCL_ERR_NONE;
 }
 
-EErrorStatus mclNormDiff_L2_16u_C1R(const uint16_t* pSrc1, int32_t src1Step, const uint16_t* pSrc2, int32_t src2Step, ImageSize roiSize, double* pValue)
+EErrorStatus mclRShiftC_C1R(uint32_t value, const uint8_t* pSrc, int32_t srcStep, uint8_t* pDst, int32_t dstStep, ImageSize roiSize, EBitDepth bd)
 {
-    if (!pSrc1 || !pSrc2 || !pValue)             return MCL_ERR_NULL_PTR;
-    if (roiSize.width < 1 || roiSize.height < 1) return MCL_ERR_INVALID_PARAM;
+#if defined(NO_IPP)
+    if      (D008 == bd) return mcl_RShiftC_C1R< uint8_t >(value, pSrc, srcStep, pDst, dstStep, roiSize);
+    else if (D010 == bd || D012 == bd || D016 == bd) return mcl_RShiftC_C1R< uint16_t >(value, pSrc, srcStep, pDst, dstStep, roiSize);
+#else
+    if      (D008 == bd) return stsIPPtoMCL(value ? ippiRShiftC_8u_C1R(pSrc, srcStep, value, pDst, dstStep, roiSize) : ippiCopy_8u_C1R(pSrc, srcStep, pDst, dstStep, roiSize));
+    else if (D010 == bd || D012 == bd || D016 == bd) return stsIPPtoMCL(value ? ippiRShiftC_16u_C1R((const uint16_t*)pSrc, srcStep, value, (uint16_t*)pDst, dstStep, roiSize) : ippiCopy_16u_C1R((const uint16_t*)pSrc, srcStep, (uint16_t*)pDst, dstStep, roiSize));
+#endif
+    return MCL_ERR_INVALID_PARAM;
+}
 
-    src1Step = src1Step >> 1;
-    src2Step = src2Step >> 1;
+bool mclIsEqual_C1R(const uint8_t* pSrc1, int32_t src1Step, const uint8_t* pSrc2, int32_t src2Step, ImageSize roiSize, EBitDepth bd)
+{
+    size_t row = (size_t)roiSize.width * ((bd == D008) ? 1 : 2);
 
-    uint16_t *src1, *src2;
+    if (!pSrc1 || !pSrc2 || roiSize.width < 1 || roiSize.height < 1) return false;
+    if (pSrc1 == pSrc2 && src1Step == src2Step) return true;
 
-    *pValue = 0.0;
+    // Contiguous planes in one call
+    if (src1Step == src2Step && (size_t)src1Step == row) return !memcmp(pSrc1, pSrc2, row * roiSize.height);
 
-    for(int32_t h = 0; h < roiSize.height; h++)
-    {
-        src1 = (uint16_t*)pSrc1 + h * src1Step;
-        src2 = (uint16_t*)pSrc2 + h * src2Step;
+    for (int32_t h = 0; h < roiSize.height; h++) {
+        if (memcmp(pSrc1 + (size_t)h * src1Step, pSrc2 + (size_t)h * src2Step, row)) return false;
+    }
+    return true;
+}
 
-        for(int32_t w = 0; w < roiSize.width; w++)
-        {
-            *pValue += (src1[w] - src2[w]) * (src1[w] - src2[w]);
+template< typename T >
+static void mcl_BlockMeanMSE_C1R(const uint8_t* pSrc1, int32_t src1Step, const uint8_t* pSrc2, int32_t src2Step, ImageSize roiSize, int32_t block, double& value)
+{
+    int32_t bw = roiSize.width / block, bh = roiSize.height / block;
+    double  sse = 0.0, norm = 1.0 / ((double)block * block);
+    std::vector< int64_t > diff(bw);
+
+    for (int32_t by = 0; by < bh; by++) {
+        std::fill(diff.begin(), diff.end(), 0);
+        for (int32_t y = by * block; y < (by + 1) * block; y++) {
+            const T *src1 = (const T*)(pSrc1 + (size_t)y * src1Step), *src2 = (const T*)(pSrc2 + (size_t)y * src2Step);
+
+            for (int32_t bx = 0, x = 0; bx < bw; bx++) {
+                int32_t d = 0;
+                for (int32_t k = 0; k < block; k++, x++) d += (int32_t)src1[x] - (int32_t)src2[x];
+                diff[bx] += d;
+            }
+        }
+        for (int32_t bx = 0; bx < bw; bx++) {
+            double d = (double)diff[bx] * norm;
+            sse += d * d;
         }
     }
+    value = sse / ((double)bw * bh);
+}
+
+EErrorStatus mclBlockMeanMSE_C1R(const uint8_t* pSrc1, int32_t src1Step, const uint8_t* pSrc2, int32_t src2Step, ImageSize roiSize, int32_t block, double& value, EBitDepth bd)
+{
+    if (!pSrc1 || !pSrc2)                                                 return MCL_ERR_NULL_PTR;
+    if (block < 1 || roiSize.width < block || roiSize.height < block)    return MCL_ERR_INVALID_PARAM;
 
-    *pValue = sqrt(*pValue);
+    if (bd == D008) mcl_BlockMeanMSE_C1R<uint8_t>(pSrc1, src1Step, pSrc2, src2Step, roiSize, block, value);
+    else            mcl_BlockMeanMSE_C1R<uint16_t>(pSrc1, src1Step, pSrc2, src2Step, roiSize, block, value);
 
     return MCL_ERR_NONE;
 }
 
-EErrorStatus mclNormDiff_L2_C1R(const uint8_t* pSrc1, int32_t src1Step, const uint8_t* pSrc2, int32_t src2Step, ImageSize roiSize, double& value, EBitDepth bd)
+template< typename T >
+static void mcl_Thumbnail_C1R(const uint8_t* pSrc, int32_t srcStep, ImageSize roiSize, float* pDst, ImageSize dstSize)
 {
-#if defined(NO_IPP)
-    if      (D008 == bd) return mclNormDiff_L2_8u_C1R( (uint8_t*) pSrc1, src1Step, (uint8_t*) pSrc2, src2Step, roiSize, &value);
-    else if (D010 == bd || D012 == bd || D016 == bd) return mclNormDiff_L2_16u_C1R((uint16_t*)pSrc1, src1Step, (uint16_t*)pSrc2, src2Step, roiSize, &value);
-#else
-    if      (D008 == bd) return stsIPPtoMCL(ippiNormDiff_L2_8u_C1R( (uint8_t*) pSrc1, src1Step, (uint8_t*) pSrc2, src2Step, roiSize, &value));
-    else if (D010 == bd || D012 == bd || D016 == bd) return stsIPPtoMCL(ippiNormDiff_L2_16u_C1R((uint16_t*)pSrc1, src1Step, (uint16_t*)pSrc2, src2Step, roiSize, &value));
-#endif
-    return MCL_ERR_INVALID_PARAM;
-}
+    std::vector< double > acc(dstSize.width);
 
-EErrorStatus mclConvert_8u32f_C1R(const uint8_t* pSrc, int32_t srcStep, float* pDst, int32_t dstStep, ImageSize roiSize)
-{
-    if (!pSrc || !pDst)                          return MCL_ERR_NULL_PTR;
-    if (roiSize.width < 1 || roiSize.height < 1) return MCL_ERR_INVALID_PARAM;
+    for (int32_t ty = 0; ty < dstSize.height; ty++) {
+        int32_t y0 = (int32_t)((int64_t)ty * roiSize.height / dstSize.height), y1 = (int32_t)((int64_t)(ty + 1) * roiSize.height / dstSize.height);
 
-    dstStep = dstStep >> 2;
+        std::fill(acc.begin(), acc.end(), 0.0);
+        for (int32_t y = y0; y < y1; y++) {
+            const T *src = (const T*)(pSrc + (size_t)y * srcStep);
 
-    uint8_t *src;
-    float   *dst;
+            for (int32_t tx = 0; tx < dstSize.width; tx++) {
+                int32_t x0 = (int32_t)((int64_t)tx * roiSize.width / dstSize.width), x1 = (int32_t)((int64_t)(tx + 1) * roiSize.width / dstSize.width);
+                uint32_t sum = 0;
 
-    for(int32_t h = 0; h < roiSize.height; h++)
-    {
-        src = (uint8_t*)pSrc + h * srcStep;
-        dst = (float*  )pDst + h * dstStep;
+                for (int32_t x = x0; x < x1; x++) sum += src[x];
+                acc[tx] += sum;
+            }
+        }
+        for (int32_t tx = 0; tx < dstSize.width; tx++) {
+            int32_t x0 = (int32_t)((int64_t)tx * roiSize.width / dstSize.width), x1 = (int32_t)((int64_t)(tx + 1) * roiSize.width / dstSize.width);
 
-        for(int32_t w = 0; w < roiSize.width; w++)
-        {
-            dst[w] = (float)src[w];
+            pDst[(size_t)ty * dstSize.width + tx] = (float)(acc[tx] / ((double)(x1 - x0) * (y1 - y0)));
         }
     }
-
-    return MCL_ERR_NONE;
 }
 
-EErrorStatus mclConvert_16u32f_C1R(const uint16_t* pSrc, int32_t srcStep, float* pDst, int32_t dstStep, ImageSize roiSize)
+EErrorStatus mclThumbnail__u32f_C1R(const uint8_t* pSrc, int32_t srcStep, ImageSize roiSize, float* pDst, ImageSize dstSize, EBitDepth bd)
 {
-    if (!pSrc || !pDst)                          return MCL_ERR_NULL_PTR;
-    if (roiSize.width < 1 || roiSize.height < 1) return MCL_ERR_INVALID_PARAM;
+    if (!pSrc || !pDst) return MCL_ERR_NULL_PTR;
+    if (dstSize.width < 1 || dstSize.height < 1 || dstSize.width > roiSize.width || dstSize.height > roiSize.height) return MCL_ERR_INVALID_PARAM;
 
-    srcStep = srcStep >> 1;
-    dstStep = dstStep >> 2;
+    if (bd == D008) mcl_Thumbnail_C1R< uint8_t  >(pSrc, srcStep, roiSize, pDst, dstSize);
+    else            mcl_Thumbnail_C1R< uint16_t >(pSrc, srcStep, roiSize, pDst, dstSize);
 
-    uint16_t *src;
-    float    *dst;
+    return MCL_ERR_NONE;
+}
 
-    for(int32_t h = 0; h < roiSize.height; h++)
-    {
-        src = (uint16_t*)pSrc + h * srcStep;
-        dst = (float*   )pDst + h * dstStep;
+static const double mcl_pi = 3.14159265358979323846;
 
-        for(int32_t w = 0; w < roiSize.width; w++)
-        {
-            dst[w] = (float)src[w];
+/* In place radix-2 FFT of n = 2^k interleaved complex values spaced by stride */
+static void mcl_FFT(double* pData, int32_t n, int32_t stride, bool inverse)
+{
+    int32_t i, j, len;
+
+    for (i = 1, j = 0; i < n; i++) {
+        int32_t bit = n >> 1;
+        for (; j & bit; bit >>= 1) j ^= bit;
+        j ^= bit;
+        if (i < j) {
+            std::swap(pData[2 * i * stride], pData[2 * j * stride]);
+            std::swap(pData[2 * i * stride + 1], pData[2 * j * stride + 1]);
         }
     }
+    for (len = 2; len <= n; len <<= 1) {
+        double ang = 2.0 * mcl_pi / len * (inverse ? 1.0 : -1.0), wr = cos(ang), wi = sin(ang);
 
-    return MCL_ERR_NONE;
+        for (i = 0; i < n; i += len) {
+            double cr = 1.0, ci = 0.0, t;
+            for (j = 0; j < len / 2; j++) {
+                double *a = pData + 2 * (i + j) * stride, *b = pData + 2 * (i + j + len / 2) * stride;
+                double  br = b[0] * cr - b[1] * ci, bi = b[0] * ci + b[1] * cr;
+
+                b[0] = a[0] - br; b[1] = a[1] - bi; a[0] += br; a[1] += bi;
+                t = cr * wr - ci * wi; ci = cr * wi + ci * wr; cr = t;
+            }
+        }
+    }
 }
 
-EErrorStatus mclConvert__u32f_C1R(const uint8_t* pSrc, int32_t srcStep, float* pDst, int32_t dstStep, ImageSize roiSize, EBitDepth bd)
+static void mcl_FFT2D(double* pData, int32_t n, bool inverse)
 {
-#if defined(NO_IPP)
-    if      (D008 == bd) return mclConvert_8u32f_C1R( (uint8_t*) pSrc, srcStep, pDst, dstStep, roiSize);
-    else if (D010 == bd || D012 == bd || D016 == bd) return mclConvert_16u32f_C1R((uint16_t*)pSrc, srcStep, pDst, dstStep, roiSize);
-#else
-    if      (D008 == bd) return stsIPPtoMCL(ippiConvert_8u32f_C1R( (uint8_t*) pSrc, srcStep, pDst, dstStep, roiSize));
-    else if (D010 == bd || D012 == bd || D016 == bd) return stsIPPtoMCL(ippiConvert_16u32f_C1R((uint16_t*)pSrc, srcStep, pDst, dstStep, roiSize));
-#endif
-    return MCL_ERR_INVALID_PARAM;
+    for (int32_t y = 0; y < n; y++) mcl_FFT(pData + 2 * (size_t)y * n, n, 1, inverse);
+    for (int32_t x = 0; x < n; x++) mcl_FFT(pData + 2 * x, n, n, inverse);
 }
 
-EErrorStatus mclSqr_32f_C1R(const float* pSrc, int srcStep, float* pDst, int dstStep, ImageSize roiSize)
+/* Centred square of a plane as complex values without the mean and with a Hann window against edge effects */
+template< typename T >
+static void mcl_LoadWindowed(const uint8_t* pSrc, int32_t srcStep, ImageSize roiSize, int32_t n, double* pDst)
 {
-#if defined(NO_IPP)
-    if (!pSrc || !pDst)                          return MCL_ERR_NULL_PTR;
-    if (roiSize.width < 1 || roiSize.height < 1) return MCL_ERR_INVALID_PARAM;
+    int32_t x0 = (roiSize.width - n) / 2, y0 = (roiSize.height - n) / 2, x, y;
+    double  mean = 0.0;
 
-    srcStep = srcStep >> 2;
-    dstStep = dstStep >> 2;
+    for (y = 0; y < n; y++) {
+        const T *src = (const T*)(pSrc + (size_t)(y0 + y) * srcStep) + x0;
+        for (x = 0; x < n; x++) mean += src[x];
+    }
+    mean /= (double)n * n;
+    for (y = 0; y < n; y++) {
+        const T *src = (const T*)(pSrc + (size_t)(y0 + y) * srcStep) + x0;
+        double   wy  = 0.5 - 0.5 * cos(2.0 * mcl_pi * y / n);
+
+        for (x = 0; x < n; x++) {
+            pDst[2 * ((size_t)y * n + x)]     = (src[x] - mean) * wy * (0.5 - 0.5 * cos(2.0 * mcl_pi * x / n));
+            pDst[2 * ((size_t)y * n + x) + 1] = 0.0;
+        }
+    }
+}
 
-    float *src, *dst;
+EErrorStatus mclCrossPower_C1R(const uint8_t* pSrc1, int32_t src1Step, const uint8_t* pSrc2, int32_t src2Step, ImageSize roiSize, int32_t order, double* pAcc, EBitDepth bd)
+{
+    int32_t n = 1 << order;
 
-    for(int32_t h = 0; h < roiSize.height; h++)
-    {
-        src = (float*)pSrc + h * srcStep;
-        dst = (float*)pDst + h * dstStep;
+    if (!pSrc1 || !pSrc2 || !pAcc)                                  return MCL_ERR_NULL_PTR;
+    if (order < 1 || n > roiSize.width || n > roiSize.height)       return MCL_ERR_INVALID_PARAM;
 
-        for(int32_t w = 0; w < roiSize.width; w++)
-        {
-            dst[w] = src[w] * src[w];
-        }
-    }
+    std::vector< double > f1(2 * (size_t)n * n), f2(2 * (size_t)n * n);
+
+    if (bd == D008) { mcl_LoadWindowed< uint8_t  >(pSrc1, src1Step, roiSize, n, &f1[0]); mcl_LoadWindowed< uint8_t  >(pSrc2, src2Step, roiSize, n, &f2[0]); }
+    else            { mcl_LoadWindowed< uint16_t >(pSrc1, src1Step, roiSize, n, &f1[0]); mcl_LoadWindowed< uint16_t >(pSrc2, src2Step, roiSize, n, &f2[0]); }
+    mcl_FFT2D(&f1[0], n, false);
+    mcl_FFT2D(&f2[0], n, false);
 
+    // F2 * conj(F1) / |F2 * conj(F1)|
+    for (size_t k = 0; k < (size_t)n * n; k++) {
+        double re = f2[2 * k] * f1[2 * k] + f2[2 * k + 1] * f1[2 * k + 1];
+        double im = f2[2 * k + 1] * f1[2 * k] - f2[2 * k] * f1[2 * k + 1];
+        double mg = sqrt(re * re + im * im);
+
+        if (mg > 1e-12) { pAcc[2 * k] += re / mg; pAcc[2 * k + 1] += im / mg; }
+    }
     return MCL_ERR_NONE;
-#else
-    return stsIPPtoMCL(ippiSqr_32f_C1R(pSrc, srcStep, pDst, dstStep, roiSize));
-#endif
 }
 
-EErrorStatus mclMul_32f_C1R(const float* pSrc1, int srcStep1, const float* pSrc2, int srcStep2, float* pDst, int dstStep, ImageSize roiSize)
+EErrorStatus mclPhaseCorrelationPeak(const double* pAcc, int32_t order, int32_t count, double& dx, double& dy, double& peak)
 {
-#if defined(NO_IPP)
-    if (!pSrc1 || !pSrc2 || !pDst)               return MCL_ERR_NULL_PTR;
-    if (roiSize.width < 1 || roiSize.height < 1) return MCL_ERR_INVALID_PARAM;
+    int32_t n = 1 << order, px = 0, py = 0, x, y;
 
-    srcStep1 = srcStep1 >> 2;
-    srcStep2 = srcStep2 >> 2;
-    dstStep  = dstStep  >> 2;
+    if (!pAcc)                  return MCL_ERR_NULL_PTR;
+    if (order < 1 || count < 1) return MCL_ERR_INVALID_PARAM;
+
+    std::vector< double > c(pAcc, pAcc + 2 * (size_t)n * n);
+    mcl_FFT2D(&c[0], n, true);
+
+    for (y = 0; y < n; y++) {
+        for (x = 0; x < n; x++) {
+            if (c[2 * ((size_t)y * n + x)] > c[2 * ((size_t)py * n + px)]) { px = x; py = y; }
+        }
+    }
+
+    // Parabola through the peak and its neighbours, the surface wraps around
+    double c0 = c[2 * ((size_t)py * n + px)];
+    double xl = c[2 * ((size_t)py * n + ((px + n - 1) & (n - 1)))], xr = c[2 * ((size_t)py * n + ((px + 1) & (n - 1)))];
+    double yu = c[2 * ((size_t)((py + n - 1) & (n - 1)) * n + px)], yd = c[2 * ((size_t)((py + 1) & (n - 1)) * n + px)];
+    double den;
+
+    dx = (px < n / 2) ? px : px - n;
+    dy = (py < n / 2) ? py : py - n;
+    if ((den = xl - 2.0 * c0 + xr) < 0.0) dx += 0.5 * (xl - xr) / den;
+    if ((den = yu - 2.0 * c0 + yd) < 0.0) dy += 0.5 * (yu - yd) / den;
+    peak = c0 / ((double)n * n * count);
+
+    return MCL_ERR_NONE;
+}
+
+uint64_t mclHash_C1R(const uint8_t* pSrc, int32_t srcStep, ImageSize roiSize, EBitDepth bd, uint64_t seed)
+{
+    const uint64_t k1 = 0x9e3779b97f4a7c15ull, k2 = 0xbf58476d1ce4e5b9ull, k3 = 0x94d049bb133111ebull;
+    size_t   row = (size_t)std::max(roiSize.width, 0) * ((bd == D008) ? 1 : 2), x;
+    uint64_t h[4], v;
+    int32_t  k;
+
+    for (k = 0; k < 4; k++) h[k] = seed + (uint64_t)(k + 1) * k1;
+    if (!pSrc) return h[0];
+
+    // Four independent lanes over 32 byte chunks, the tail of a row goes into lane 0
+    for (int32_t y = 0; y < roiSize.height; y++) {
+        const uint8_t *p = pSrc + (size_t)y * srcStep;
+
+        for (x = 0; x + 32 <= row; x += 32) {
+            for (k = 0; k < 4; k++) {
+                memcpy(&v, p + x + 8 * k, 8);
+                h[k] ^= v * k1; h[k] = ((h[k] << 31) | (h[k] >> 33)) * k2;
+            }
+        }
+        for (; x < row; x += 8) {
+            v = 0; memcpy(&v, p + x, std::min((size_t)8, row - x));
+            h[0] ^= v * k1; h[0] = ((h[0] << 31) | (h[0] >> 33)) * k2;
+        }
+    }
+
+    v = h[0] ^ ((h[1] << 17) | (h[1] >> 47)) ^ ((h[2] << 34) | (h[2] >> 30)) ^ ((h[3] << 51) | (h[3] >> 13)) ^ ((uint64_t)row * roiSize.height);
+    v ^= v >> 30; v *= k2; v ^= v >> 27; v *= k3; v ^= v >> 31;
+
+    return v;
+}
+
+/* Row kernels: the scalar reference and one instance per instruction set. Every instance gives the same
+   result, filters accumulate taps in double in kernel order with separate multiply and add */
+template <typename T>
+static int64_t mcl_c_ssdRow(const T* src1, const T* src2, int32_t n)
+{
+    int64_t row = 0;
+    for (int32_t w = 0; w < n; w++) row += (src1[w] - src2[w]) * (src1[w] - src2[w]);
+    return row;
+}
+
+template <typename T>
+static void mcl_c_convertRow(const T* src, float* dst, int32_t n)
+{
+    for (int32_t w = 0; w < n; w++) dst[w] = (float)src[w];
+}
+
+// Taps of output w are src[w + i * tapStep], K = 0 takes the tap count at run time
+template <int32_t K>
+static void mcl_c_filterRow(const float* src, int32_t tapStep, float* dst, int32_t n, const float* pKernel, int32_t kernelSize)
+{
+    double value;
+
+    for (int32_t w = 0; w < n; w++) {
+        value = 0.0;
+        for (int32_t i = 0; i < (K ? K : kernelSize); i++) value += (double)pKernel[i] * (double)src[w + i * tapStep];
+        dst[w] = (float)value;
+    }
+}
+
+#if defined(MCL_DISPATCH)
+#if defined(__GNUC__) && !defined(__clang__)
+// GCC 12 headers widen AVX-512 conversions from _mm512_undefined_*(), which -Wmaybe-uninitialized reports once inlined
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+MCL_TARGET("sse4.2") static inline __m128i mcl_sse42_load_epi32(const uint8_t* p)  { int32_t v; memcpy(&v, p, 4); return _mm_cvtepu8_epi32(_mm_cvtsi32_si128(v)); }
+MCL_TARGET("sse4.2") static inline __m128i mcl_sse42_load_epi32(const uint16_t* p) { return _mm_cvtepu16_epi32(_mm_loadl_epi64((const __m128i*)p)); }
+MCL_TARGET("avx2")   static inline __m256i mcl_avx2_load_epi32(const uint8_t* p)   { return _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)p)); }
+MCL_TARGET("avx2")   static inline __m256i mcl_avx2_load_epi32(const uint16_t* p)  { return _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)p)); }
+MCL_TARGET("avx512f,avx512bw,avx512vl") static inline __m512i mcl_avx512_load_epi32(const uint8_t* p)  { return _mm512_cvtepu8_epi32(_mm_loadu_si128((const __m128i*)p)); }
+MCL_TARGET("avx512f,avx512bw,avx512vl") static inline __m512i mcl_avx512_load_epi32(const uint16_t* p) { return _mm512_cvtepu16_epi32(_mm256_loadu_si256((const __m256i*)p)); }
+
+// Squares are formed in 32 bits like the scalar code and summed in 64 bits
+template <typename T>
+MCL_TARGET("sse4.2") static int64_t mcl_sse42_ssdRow(const T* src1, const T* src2, int32_t n)
+{
+    __m128i acc = _mm_setzero_si128(), d;
+    int64_t sum[2];
+    int32_t w = 0;
+
+    for (; w + 4 <= n; w += 4) {
+        d   = _mm_sub_epi32(mcl_sse42_load_epi32(src1 + w), mcl_sse42_load_epi32(src2 + w));
+        d   = _mm_mullo_epi32(d, d);
+        acc = _mm_add_epi64(acc, _mm_add_epi64(_mm_cvtepi32_epi64(d), _mm_cvtepi32_epi64(_mm_srli_si128(d, 8))));
+    }
+    _mm_storeu_si128((__m128i*)sum, acc);
+    return sum[0] + sum[1] + mcl_c_ssdRow(src1 + w, src2 + w, n - w);
+}
+
+template <typename T>
+MCL_TARGET("avx2") static int64_t mcl_avx2_ssdRow(const T* src1, const T* src2, int32_t n)
+{
+    __m256i acc = _mm256_setzero_si256(), d;
+    int64_t sum[4];
+    int32_t w = 0;
+
+    for (; w + 8 <= n; w += 8) {
+        d   = _mm256_sub_epi32(mcl_avx2_load_epi32(src1 + w), mcl_avx2_load_epi32(src2 + w));
+        d   = _mm256_mullo_epi32(d, d);
+        acc = _mm256_add_epi64(acc, _mm256_add_epi64(_mm256_cvtepi32_epi64(_mm256_castsi256_si128(d)), _mm256_cvtepi32_epi64(_mm256_extracti128_si256(d, 1))));
+    }
+    _mm256_storeu_si256((__m256i*)sum, acc);
+    return sum[0] + sum[1] + sum[2] + sum[3] + mcl_c_ssdRow(src1 + w, src2 + w, n - w);
+}
+
+template <typename T>
+MCL_TARGET("avx512f,avx512bw,avx512vl") static int64_t mcl_avx512_ssdRow(const T* src1, const T* src2, int32_t n)
+{
+    __m512i acc = _mm512_setzero_si512(), d;
+    int64_t sum[8];
+    int32_t w = 0;
+
+    for (; w + 16 <= n; w += 16) {
+        d   = _mm512_sub_epi32(mcl_avx512_load_epi32(src1 + w), mcl_avx512_load_epi32(src2 + w));
+        d   = _mm512_mullo_epi32(d, d);
+        acc = _mm512_add_epi64(acc, _mm512_add_epi64(_mm512_cvtepi32_epi64(_mm512_castsi512_si256(d)), _mm512_cvtepi32_epi64(_mm512_extracti64x4_epi64(d, 1))));
+    }
+    _mm512_storeu_si512((void*)sum, acc);
+    return sum[0] + sum[1] + sum[2] + sum[3] + sum[4] + sum[5] + sum[6] + sum[7] + mcl_c_ssdRow(src1 + w, src2 + w, n - w);
+}
+
+template <typename T>
+MCL_TARGET("sse4.2") static void mcl_sse42_convertRow(const T* src, float* dst, int32_t n)
+{
+    int32_t w = 0;
+    for (; w + 4 <= n; w += 4) _mm_storeu_ps(dst + w, _mm_cvtepi32_ps(mcl_sse42_load_epi32(src + w)));
+    mcl_c_convertRow(src + w, dst + w, n - w);
+}
+
+template <typename T>
+MCL_TARGET("avx2") static void mcl_avx2_convertRow(const T* src, float* dst, int32_t n)
+{
+    int32_t w = 0;
+    for (; w + 8 <= n; w += 8) _mm256_storeu_ps(dst + w, _mm256_cvtepi32_ps(mcl_avx2_load_epi32(src + w)));
+    mcl_c_convertRow(src + w, dst + w, n - w);
+}
+
+template <typename T>
+MCL_TARGET("avx512f,avx512bw,avx512vl") static void mcl_avx512_convertRow(const T* src, float* dst, int32_t n)
+{
+    int32_t w = 0;
+    for (; w + 16 <= n; w += 16) _mm512_storeu_ps(dst + w, _mm512_cvtepi32_ps(mcl_avx512_load_epi32(src + w)));
+    mcl_c_convertRow(src + w, dst + w, n - w);
+}
+
+template <int32_t K>
+MCL_TARGET("sse4.2") static void mcl_sse42_filterRow(const float* src, int32_t tapStep, float* dst, int32_t n, const float* pKernel, int32_t kernelSize)
+{
+    int32_t w = 0;
+
+    for (; w + 2 <= n; w += 2) {
+        __m128d acc = _mm_setzero_pd();
+        for (int32_t i = 0; i < K; i++)
+            acc = _mm_add_pd(acc, _mm_mul_pd(_mm_set1_pd((double)pKernel[i]), _mm_cvtps_pd(_mm_castsi128_ps(_mm_loadl_epi64((const __m128i*)(src + w + i * tapStep))))));
+        _mm_storel_epi64((__m128i*)(dst + w), _mm_castps_si128(_mm_cvtpd_ps(acc)));
+    }
+    mcl_c_filterRow<K>(src + w, tapStep, dst + w, n - w, pKernel, kernelSize);
+}
+
+template <int32_t K>
+MCL_TARGET("avx2") static void mcl_avx2_filterRow(const float* src, int32_t tapStep, float* dst, int32_t n, const float* pKernel, int32_t kernelSize)
+{
+    int32_t w = 0;
+
+    for (; w + 4 <= n; w += 4) {
+        __m256d acc = _mm256_setzero_pd();
+        for (int32_t i = 0; i < K; i++)
+            acc = _mm256_add_pd(acc, _mm256_mul_pd(_mm256_set1_pd((double)pKernel[i]), _mm256_cvtps_pd(_mm_loadu_ps(src + w + i * tapStep))));
+        _mm_storeu_ps(dst + w, _mm256_cvtpd_ps(acc));
+    }
+    mcl_c_filterRow<K>(src + w, tapStep, dst + w, n - w, pKernel, kernelSize);
+}
+
+template <int32_t K>
+MCL_TARGET("avx512f,avx512bw,avx512vl") static void mcl_avx512_filterRow(const float* src, int32_t tapStep, float* dst, int32_t n, const float* pKernel, int32_t kernelSize)
+{
+    int32_t w = 0;
+
+    for (; w + 8 <= n; w += 8) {
+        __m512d acc = _mm512_setzero_pd();
+        for (int32_t i = 0; i < K; i++)
+            acc = _mm512_add_pd(acc, _mm512_mul_pd(_mm512_set1_pd((double)pKernel[i]), _mm512_cvtps_pd(_mm256_loadu_ps(src + w + i * tapStep))));
+        _mm256_storeu_ps(dst + w, _mm512_cvtpd_ps(acc));
+    }
+    mcl_c_filterRow<K>(src + w, tapStep, dst + w, n - w, pKernel, kernelSize);
+}
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+#endif
+
+/* Pixel kernels are templates over the sample type and its row kernel, so every instance has fixed element
+   size and conversion */
+template <typename T, int64_t (*SSD)(const T*, const T*, int32_t)>
+static EErrorStatus mcl_NormDiff_L2_C1R(const uint8_t* pSrc1, int32_t src1Step, const uint8_t* pSrc2, int32_t src2Step, ImageSize roiSize, double& value)
+{
+    if (!pSrc1 || !pSrc2)                        return MCL_ERR_NULL_PTR;
+    if (roiSize.width < 1 || roiSize.height < 1) return MCL_ERR_INVALID_PARAM;
+
+    value = 0.0;
+
+    // Integer row sums are exact, the double total is the same as summing every square into it
+    for(int32_t h = 0; h < roiSize.height; h++)
+    {
+        value += (double)SSD((const T*)(pSrc1 + h * src1Step), (const T*)(pSrc2 + h * src2Step), roiSize.width);
+    }
+
+    value = sqrt(value);
+
+    return MCL_ERR_NONE;
+}
+
+template <typename T, void (*CVT)(const T*, float*, int32_t)>
+static EErrorStatus mcl_Convert_32f_C1R(const uint8_t* pSrc, int32_t srcStep, float* pDst, int32_t dstStep, ImageSize roiSize)
+{
+    if (!pSrc || !pDst)                          return MCL_ERR_NULL_PTR;
+    if (roiSize.width < 1 || roiSize.height < 1) return MCL_ERR_INVALID_PARAM;
+
+    for(int32_t h = 0; h < roiSize.height; h++)
+    {
+        CVT((const T*)(pSrc + h * srcStep), (float*)((uint8_t*)pDst + h * dstStep), roiSize.width);
+    }
+
+    return MCL_ERR_NONE;
+}
+
+#if !defined(NO_IPP)
+static EErrorStatus mcl_NormDiff_L2_8u_C1R(const uint8_t* pSrc1, int32_t src1Step, const uint8_t* pSrc2, int32_t src2Step, ImageSize roiSize, double& value)
+{
+    return stsIPPtoMCL(ippiNormDiff_L2_8u_C1R(pSrc1, src1Step, pSrc2, src2Step, roiSize, &value));
+}
+
+static EErrorStatus mcl_NormDiff_L2_16u_C1R(const uint8_t* pSrc1, int32_t src1Step, const uint8_t* pSrc2, int32_t src2Step, ImageSize roiSize, double& value)
+{
+    return stsIPPtoMCL(ippiNormDiff_L2_16u_C1R((const uint16_t*)pSrc1, src1Step, (const uint16_t*)pSrc2, src2Step, roiSize, &value));
+}
+
+static EErrorStatus mcl_Convert_8u32f_C1R(const uint8_t* pSrc, int32_t srcStep, float* pDst, int32_t dstStep, ImageSize roiSize)
+{
+    return stsIPPtoMCL(ippiConvert_8u32f_C1R(pSrc, srcStep, pDst, dstStep, roiSize));
+}
+
+static EErrorStatus mcl_Convert_16u32f_C1R(const uint8_t* pSrc, int32_t srcStep, float* pDst, int32_t dstStep, ImageSize roiSize)
+{
+    return stsIPPtoMCL(ippiConvert_16u32f_C1R((const uint16_t*)pSrc, srcStep, pDst, dstStep, roiSize));
+}
+#else
+template <typename T, int64_t (*SSD)(const T*, const T*, int32_t), void (*CVT)(const T*, float*, int32_t)>
+static void mcl_set_pixel_kernels(SPixelKernels &kernels)
+{
+    kernels.normDiff_L2 = mcl_NormDiff_L2_C1R<T, SSD>;
+    kernels.convert_32f = mcl_Convert_32f_C1R<T, CVT>;
+}
+
+template <typename T>
+static void mcl_set_pixel_kernels(SPixelKernels &kernels, ECpuLevel level)
+{
+    switch (level) {
+#if defined(MCL_DISPATCH)
+    case CPU_AVX512: mcl_set_pixel_kernels<T, mcl_avx512_ssdRow<T>, mcl_avx512_convertRow<T> >(kernels); break;
+    case CPU_AVX2:   mcl_set_pixel_kernels<T, mcl_avx2_ssdRow<T>,   mcl_avx2_convertRow<T>   >(kernels); break;
+    case CPU_SSE42:  mcl_set_pixel_kernels<T, mcl_sse42_ssdRow<T>,  mcl_sse42_convertRow<T>  >(kernels); break;
+#endif
+    default:         mcl_set_pixel_kernels<T, mcl_c_ssdRow<T>,      mcl_c_convertRow<T>      >(kernels); break;
+    }
+}
+#endif
+
+EErrorStatus mclGetPixelKernels(EBitDepth bd, SPixelKernels &kernels)
+{
+#if defined(NO_IPP)
+    if (D008 == bd) {
+        mcl_set_pixel_kernels<uint8_t>(kernels, mcl_cpu_level);
+        return MCL_ERR_NONE;
+    } else if (D010 == bd || D012 == bd || D016 == bd) {
+        mcl_set_pixel_kernels<uint16_t>(kernels, mcl_cpu_level);
+        return MCL_ERR_NONE;
+    }
+#else
+    if (D008 == bd) {
+        kernels.normDiff_L2 = mcl_NormDiff_L2_8u_C1R;  kernels.convert_32f = mcl_Convert_8u32f_C1R;
+        return MCL_ERR_NONE;
+    } else if (D010 == bd || D012 == bd || D016 == bd) {
+        kernels.normDiff_L2 = mcl_NormDiff_L2_16u_C1R; kernels.convert_32f = mcl_Convert_16u32f_C1R;
+        return MCL_ERR_NONE;
+    }
+#endif
+    return MCL_ERR_INVALID_PARAM;
+}
+
+EErrorStatus mclNormDiff_L2_C1R(const uint8_t* pSrc1, int32_t src1Step, const uint8_t* pSrc2, int32_t src2Step, ImageSize roiSize, double& value, EBitDepth bd)
+{
+    SPixelKernels kernels;
+
+    if (mclGetPixelKernels(bd, kernels) != MCL_ERR_NONE) return MCL_ERR_INVALID_PARAM;
+    return kernels.normDiff_L2(pSrc1, src1Step, pSrc2, src2Step, roiSize, value);
+}
+
+template< typename T >
+static void mcl_TemporalDiff_C1R(const uint8_t* pSrc1, int32_t src1Step, const uint8_t* pSrc2, int32_t src2Step, int32_t* pPrev, ImageSize roiSize, bool reset, double& sse, double& sum1, double& sum2)
+{
+    sse = sum1 = sum2 = 0.0;
+
+    for (int32_t y = 0; y < roiSize.height; y++) {
+        const T *src1 = (const T*)(pSrc1 + (size_t)y * src1Step), *src2 = (const T*)(pSrc2 + (size_t)y * src2Step);
+        int32_t *prev = pPrev + (size_t)y * roiSize.width;
+        int64_t  r_sse = 0, r_sum1 = 0, r_sum2 = 0;
+
+        for (int32_t x = 0; x < roiSize.width; x++) {
+            int32_t diff = (int32_t)src1[x] - (int32_t)src2[x];
+            int64_t delta = (int64_t)diff - prev[x];
+
+            r_sse += delta * delta; r_sum1 += src1[x]; r_sum2 += src2[x];
+            prev[x] = diff;
+        }
+        if (!reset) sse += (double)r_sse;
+        sum1 += (double)r_sum1; sum2 += (double)r_sum2;
+    }
+}
+
+EErrorStatus mclTemporalDiff_C1R(const uint8_t* pSrc1, int32_t src1Step, const uint8_t* pSrc2, int32_t src2Step, int32_t* pPrev, ImageSize roiSize, bool reset, double& sse, double& sum1, double& sum2, EBitDepth bd)
+{
+    if (!pSrc1 || !pSrc2 || !pPrev)               return MCL_ERR_NULL_PTR;
+    if (roiSize.width < 1 || roiSize.height < 1) return MCL_ERR_INVALID_PARAM;
+
+    if (bd == D008) mcl_TemporalDiff_C1R<uint8_t>(pSrc1, src1Step, pSrc2, src2Step, pPrev, roiSize, reset, sse, sum1, sum2);
+    else            mcl_TemporalDiff_C1R<uint16_t>(pSrc1, src1Step, pSrc2, src2Step, pPrev, roiSize, reset, sse, sum1, sum2);
+
+    return MCL_ERR_NONE;
+}
+
+EErrorStatus mclConvert__u32f_C1R(const uint8_t* pSrc, int32_t srcStep, float* pDst, int32_t dstStep, ImageSize roiSize, EBitDepth bd)
+{
+    SPixelKernels kernels;
+
+    if (mclGetPixelKernels(bd, kernels) != MCL_ERR_NONE) return MCL_ERR_INVALID_PARAM;
+    return kernels.convert_32f(pSrc, srcStep, pDst, dstStep, roiSize);
+}
+
+EErrorStatus mclSqr_32f_C1R(const float* pSrc, int srcStep, float* pDst, int dstStep, ImageSize roiSize)
+{
+#if defined(NO_IPP)
+    if (!pSrc || !pDst)                          return MCL_ERR_NULL_PTR;
+    if (roiSize.width < 1 || roiSize.height < 1) return MCL_ERR_INVALID_PARAM;
+
+    srcStep = srcStep >> 2;
+    dstStep = dstStep >> 2;
+
+    float *src, *dst;
+
+    for(int32_t h = 0; h < roiSize.height; h++)
+    {
+        src = (float*)pSrc + h * srcStep;
+        dst = (float*)pDst + h * dstStep;
+
+        for(int32_t w = 0; w < roiSize.width; w++)
+        {
+            dst[w] = src[w] * src[w];
+        }
+    }
+
+    return MCL_ERR_NONE;
+#else
+    return stsIPPtoMCL(ippiSqr_32f_C1R(pSrc, srcStep, pDst, dstStep, roiSize));
+#endif
+}
+
+EErrorStatus mclMul_32f_C1R(const float* pSrc1, int srcStep1, const float* pSrc2, int srcStep2, float* pDst, int dstStep, ImageSize roiSize)
+{
+#if defined(NO_IPP)
+    if (!pSrc1 || !pSrc2 || !pDst)               return MCL_ERR_NULL_PTR;
+    if (roiSize.width < 1 || roiSize.height < 1) return MCL_ERR_INVALID_PARAM;
+
+    srcStep1 = srcStep1 >> 2;
+    srcStep2 = srcStep2 >> 2;
+    dstStep  = dstStep  >> 2;
 
     float *src1, *src2, *dst;
 
@@ -896,38 +1749,95 @@ EErrorStatus mclMean_32f_C1R(const float* pSrc, int srcStep, ImageSize roiSize,
 #endif
 }
 
-EErrorStatus mclFilterRow_32f_C1R(const float* pSrc, int32_t srcStep, float* pDst, int32_t dstStep, ImageSize dstRoiSize, const float* pKernel, int32_t kernelSize, int32_t xAnchor)
-{
+/* Separable filters are templates over the tap count and the row kernel, K = 0 takes it at run time */
 #if defined(NO_IPP)
+typedef void (*mclFilterRowFunc)(const float* src, int32_t tapStep, float* dst, int32_t n, const float* pKernel, int32_t kernelSize);
+
+template <int32_t K, mclFilterRowFunc FLT>
+static EErrorStatus mcl_FilterRow_32f_C1R(const float* pSrc, int32_t srcStep, float* pDst, int32_t dstStep, ImageSize dstRoiSize, const float* pKernel, int32_t kernelSize)
+{
     if (!pSrc || !pDst || !pKernel)                    return MCL_ERR_NULL_PTR;
     if (dstRoiSize.width < 1 || dstRoiSize.height < 1) return MCL_ERR_INVALID_PARAM;
+    if (K) kernelSize = K;
     if (kernelSize < 1 || !(kernelSize&0x1))           return MCL_ERR_INVALID_PARAM;
 
     srcStep = srcStep >> 2;
     dstStep = dstStep >> 2;
 
-    float *src, *dst;
-    double value;
+    for(int32_t h = 0; h < dstRoiSize.height; h++)
+    {
+        FLT(pSrc + h * srcStep - (kernelSize >> 1), 1, pDst + h * dstStep, dstRoiSize.width, pKernel, kernelSize);
+    }
+
+    return MCL_ERR_NONE;
+}
+
+template <int32_t K, mclFilterRowFunc FLT>
+static EErrorStatus mcl_FilterColumn_32f_C1R(const float* pSrc, int32_t srcStep, float* pDst, int32_t dstStep, ImageSize dstRoiSize, const float* pKernel, int32_t kernelSize)
+{
+    if (!pSrc || !pDst || !pKernel)                    return MCL_ERR_NULL_PTR;
+    if (dstRoiSize.width < 1 || dstRoiSize.height < 1) return MCL_ERR_INVALID_PARAM;
+    if (K) kernelSize = K;
+    if (kernelSize < 1 || !(kernelSize&0x1))           return MCL_ERR_INVALID_PARAM;
+
+    srcStep = srcStep >> 2;
+    dstStep = dstStep >> 2;
 
     for(int32_t h = 0; h < dstRoiSize.height; h++)
     {
-        src = (float*)pSrc + h * srcStep;
-        dst = (float*)pDst + h * dstStep;
+        FLT(pSrc + (h - (kernelSize >> 1)) * srcStep, srcStep, pDst + h * dstStep, dstRoiSize.width, pKernel, kernelSize);
+    }
 
-        for(int32_t w = 0; w < dstRoiSize.width; w++)
-        {
-            value = 0.0f;
+    return MCL_ERR_NONE;
+}
 
-            for(int32_t i = 0; i < kernelSize; i++)
-            {
-                value += (double)pKernel[i] * (double)src[w - (kernelSize >> 1) + i];
-            }
+template <int32_t K>
+static void mcl_set_filter_kernels(SFilterKernels &kernels, ECpuLevel level)
+{
+    switch (level) {
+#if defined(MCL_DISPATCH)
+    case CPU_AVX512: kernels.row = mcl_FilterRow_32f_C1R<K, mcl_avx512_filterRow<K> >; kernels.column = mcl_FilterColumn_32f_C1R<K, mcl_avx512_filterRow<K> >; break;
+    case CPU_AVX2:   kernels.row = mcl_FilterRow_32f_C1R<K, mcl_avx2_filterRow<K> >;   kernels.column = mcl_FilterColumn_32f_C1R<K, mcl_avx2_filterRow<K> >;   break;
+    case CPU_SSE42:  kernels.row = mcl_FilterRow_32f_C1R<K, mcl_sse42_filterRow<K> >;  kernels.column = mcl_FilterColumn_32f_C1R<K, mcl_sse42_filterRow<K> >;  break;
+#endif
+    default:         kernels.row = mcl_FilterRow_32f_C1R<K, mcl_c_filterRow<K> >;      kernels.column = mcl_FilterColumn_32f_C1R<K, mcl_c_filterRow<K> >;      break;
+    }
+}
+#else
+static EErrorStatus mcl_FilterRow_32f_C1R(const float* pSrc, int32_t srcStep, float* pDst, int32_t dstStep, ImageSize dstRoiSize, const float* pKernel, int32_t kernelSize)
+{
+    return mclFilterRow_32f_C1R(pSrc, srcStep, pDst, dstStep, dstRoiSize, pKernel, kernelSize, kernelSize >> 1);
+}
 
-            dst[w] = (float)value;
-        }
+static EErrorStatus mcl_FilterColumn_32f_C1R(const float* pSrc, int32_t srcStep, float* pDst, int32_t dstStep, ImageSize dstRoiSize, const float* pKernel, int32_t kernelSize)
+{
+    return mclFilterColumn_32f_C1R(pSrc, srcStep, pDst, dstStep, dstRoiSize, pKernel, kernelSize, kernelSize >> 1);
+}
+#endif
+
+EErrorStatus mclGetFilterKernels(int32_t kernelSize, SFilterKernels &kernels)
+{
+    if (kernelSize < 1 || !(kernelSize&0x1)) return MCL_ERR_INVALID_PARAM;
+
+#if defined(NO_IPP)
+    switch (kernelSize) {
+    case 11: mcl_set_filter_kernels<11>(kernels, mcl_cpu_level); break;
+    case 7:  mcl_set_filter_kernels<7>(kernels, mcl_cpu_level);  break;
+    case 5:  mcl_set_filter_kernels<5>(kernels, mcl_cpu_level);  break;
+    default: kernels.row = mcl_FilterRow_32f_C1R<0, mcl_c_filterRow<0> >; kernels.column = mcl_FilterColumn_32f_C1R<0, mcl_c_filterRow<0> >; break;
     }
+#else
+    kernels.row = mcl_FilterRow_32f_C1R; kernels.column = mcl_FilterColumn_32f_C1R;
+#endif
+    kernels.size = kernelSize;
 
     return MCL_ERR_NONE;
+}
+
+EErrorStatus mclFilterRow_32f_C1R(const float* pSrc, int32_t srcStep, float* pDst, int32_t dstStep, ImageSize dstRoiSize, const float* pKernel, int32_t kernelSize, int32_t xAnchor)
+{
+#if defined(NO_IPP)
+    return mcl_FilterRow_32f_C1R<0, mcl_c_filterRow<0> >(pSrc, srcStep, pDst, dstStep, dstRoiSize, pKernel, kernelSize);
 #elif defined(LEGACY_IPP)
     return stsIPPtoMCL(ippiFilterRow_32f_C1R(pSrc, srcStep, pDst, dstStep, dstRoiSize, pKernel, kernelSize, xAnchor));
 #else
@@ -938,38 +1848,571 @@ EErrorStatus mclFilterRow_32f_C1R(const float* pSrc, int32_t srcStep, float* pDs
 EErrorStatus mclFilterColumn_32f_C1R(const float* pSrc, int32_t srcStep, float* pDst, int32_t dstStep, ImageSize dstRoiSize, const float* pKernel, int32_t kernelSize, int32_t xAnchor)
 {
 #if defined(NO_IPP)
-    if (!pSrc || !pDst || !pKernel)                    return MCL_ERR_NULL_PTR;
-    if (dstRoiSize.width < 1 || dstRoiSize.height < 1) return MCL_ERR_INVALID_PARAM;
-    if (kernelSize < 1 || !(kernelSize&0x1))           return MCL_ERR_INVALID_PARAM;
+    return mcl_FilterColumn_32f_C1R<0, mcl_c_filterRow<0> >(pSrc, srcStep, pDst, dstStep, dstRoiSize, pKernel, kernelSize);
+#elif defined(LEGACY_IPP)
+    return stsIPPtoMCL(ippiFilterColumn_32f_C1R(pSrc, srcStep, pDst, dstStep, dstRoiSize, pKernel, kernelSize, xAnchor));
+#else
+    return MCL_ERR_NONE;
+#endif
+}
 
-    srcStep = srcStep >> 2;
-    dstStep = dstStep >> 2;
+/* Block SSIM: every 4x4 block contributes s1 = sum(a), s2 = sum(b), ss = sum(a*a + b*b) and s12 = sum(a*b),
+   the 8x8 window at block (x, y) is the sum of blocks (x, y), (x+1, y), (x, y+1) and (x+1, y+1) */
+EErrorStatus mclSSIM4x4GetBufferSize(int32_t width, int32_t* pBufferSize)
+{
+    if (!pBufferSize) return MCL_ERR_NULL_PTR;
+    if (width < 8)    return MCL_ERR_INVALID_PARAM;
 
-    float *src, *dst;
-    double value;
+    *pBufferSize = 2 * 4 * (width >> 2) * (int32_t)sizeof(int64_t);
 
-    for(int32_t h = 0; h < dstRoiSize.height; h++)
-    {
-        src = (float*)pSrc + h * srcStep;
-        dst = (float*)pDst + h * dstStep;
+    return MCL_ERR_NONE;
+}
 
-        for(int32_t w = 0; w < dstRoiSize.width; w++)
-        {
-            value = 0.0f;
+void mclSSIM4x4Sums_8u(const uint8_t* pSrc1, int32_t src1Step, const uint8_t* pSrc2, int32_t src2Step, int32_t blocks, int64_t* pSums)
+{
+    int32_t b = 0;
+
+#if defined(MCL_SSE2)
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i one  = _mm_set1_epi16(1);
+    int32_t       tmp[4][4];
+
+    for (; b + 4 <= blocks; b += 4) {
+        __m128i s1l = zero, s1h = zero, s2l = zero, s2h = zero;
+        __m128i ssl = zero, ssh = zero, s12l = zero, s12h = zero;
+
+        for (int32_t y = 0; y < 4; y++) {
+            __m128i a  = _mm_loadu_si128((const __m128i*)(pSrc1 + y * src1Step + (b << 2)));
+            __m128i c  = _mm_loadu_si128((const __m128i*)(pSrc2 + y * src2Step + (b << 2)));
+            __m128i al = _mm_unpacklo_epi8(a, zero), ah = _mm_unpackhi_epi8(a, zero);
+            __m128i cl = _mm_unpacklo_epi8(c, zero), ch = _mm_unpackhi_epi8(c, zero);
+
+            s1l  = _mm_add_epi16(s1l, al); s1h = _mm_add_epi16(s1h, ah);
+            s2l  = _mm_add_epi16(s2l, cl); s2h = _mm_add_epi16(s2h, ch);
+            ssl  = _mm_add_epi32(ssl, _mm_add_epi32(_mm_madd_epi16(al, al), _mm_madd_epi16(cl, cl)));
+            ssh  = _mm_add_epi32(ssh, _mm_add_epi32(_mm_madd_epi16(ah, ah), _mm_madd_epi16(ch, ch)));
+            s12l = _mm_add_epi32(s12l, _mm_madd_epi16(al, cl));
+            s12h = _mm_add_epi32(s12h, _mm_madd_epi16(ah, ch));
+        }
+
+        /* Lanes hold pairs of columns, fold them into per block sums */
+        _mm_storeu_si128((__m128i*)tmp[0], _mm_madd_epi16(s1l, one));
+        _mm_storeu_si128((__m128i*)tmp[1], _mm_madd_epi16(s2l, one));
+        _mm_storeu_si128((__m128i*)tmp[2], ssl);
+        _mm_storeu_si128((__m128i*)tmp[3], s12l);
+        for (int32_t k = 0; k < 2; k++)
+            for (int32_t m = 0; m < 4; m++)
+                pSums[((b + k) << 2) + m] = tmp[m][2 * k] + tmp[m][2 * k + 1];
+
+        _mm_storeu_si128((__m128i*)tmp[0], _mm_madd_epi16(s1h, one));
+        _mm_storeu_si128((__m128i*)tmp[1], _mm_madd_epi16(s2h, one));
+        _mm_storeu_si128((__m128i*)tmp[2], ssh);
+        _mm_storeu_si128((__m128i*)tmp[3], s12h);
+        for (int32_t k = 0; k < 2; k++)
+            for (int32_t m = 0; m < 4; m++)
+                pSums[((b + k + 2) << 2) + m] = tmp[m][2 * k] + tmp[m][2 * k + 1];
+    }
+#endif
+
+    for (; b < blocks; b++) {
+        int32_t s1 = 0, s2 = 0, ss = 0, s12 = 0;
+
+        for (int32_t y = 0; y < 4; y++) {
+            const uint8_t* src1 = pSrc1 + y * src1Step + (b << 2);
+            const uint8_t* src2 = pSrc2 + y * src2Step + (b << 2);
 
-            for(int32_t i = 0; i < kernelSize; i++)
-            {
-                value += (double)pKernel[i] * (double)src[w - (kernelSize >> 1) * srcStep + i * srcStep];
+            for (int32_t x = 0; x < 4; x++) {
+                s1  += src1[x];
+                s2  += src2[x];
+                ss  += src1[x] * src1[x] + src2[x] * src2[x];
+                s12 += src1[x] * src2[x];
             }
+        }
+        pSums[(b << 2) + 0] = s1;
+        pSums[(b << 2) + 1] = s2;
+        pSums[(b << 2) + 2] = ss;
+        pSums[(b << 2) + 3] = s12;
+    }
+}
+
+void mclSSIM4x4Sums_16u(const uint16_t* pSrc1, int32_t src1Step, const uint16_t* pSrc2, int32_t src2Step, int32_t blocks, int64_t* pSums)
+{
+    src1Step = src1Step >> 1;
+    src2Step = src2Step >> 1;
 
-            dst[w] = (float)value;
+    for (int32_t b = 0; b < blocks; b++) {
+        int64_t s1 = 0, s2 = 0, ss = 0, s12 = 0;
+
+        for (int32_t y = 0; y < 4; y++) {
+            const uint16_t* src1 = pSrc1 + y * src1Step + (b << 2);
+            const uint16_t* src2 = pSrc2 + y * src2Step + (b << 2);
+
+            for (int32_t x = 0; x < 4; x++) {
+                s1  += src1[x];
+                s2  += src2[x];
+                ss  += (int64_t)src1[x] * src1[x] + (int64_t)src2[x] * src2[x];
+                s12 += (int64_t)src1[x] * src2[x];
+            }
         }
+        pSums[(b << 2) + 0] = s1;
+        pSums[(b << 2) + 1] = s2;
+        pSums[(b << 2) + 2] = ss;
+        pSums[(b << 2) + 3] = s12;
     }
+}
+
+EErrorStatus mclSSIM8x8_C1R(const uint8_t* pSrc1, int32_t src1Step, const uint8_t* pSrc2, int32_t src2Step, ImageSize roiSize, double& value, uint8_t* pBuffer, EBitDepth bd, bool unbiased)
+{
+    if (!pSrc1 || !pSrc2 || !pBuffer)            return MCL_ERR_NULL_PTR;
+    if (roiSize.width < 8 || roiSize.height < 8) return MCL_ERR_INVALID_PARAM;
+
+    const int32_t blocks = roiSize.width  >> 2;
+    const int32_t brows  = roiSize.height >> 2;
+    const double  max_e  = (D008 == bd) ? 255.0 : (D010 == bd) ? 1023.0 : (D012 == bd) ? 4095.0 : 65535.0;
+    int64_t      *sum0   = (int64_t*)pBuffer;
+    int64_t      *sum1   = sum0 + 4 * blocks;
+    double        c1, c2, total = 0.0;
+
+    if (unbiased) {
+        /* x264: sample variance over the window, constants scaled by 64 and 64*63 */
+        c1 = .01 * .01 * max_e * max_e * 64;
+        c2 = .03 * .03 * max_e * max_e * 64 * 63;
+        if (D008 == bd) { c1 = floor(c1 + .5); c2 = floor(c2 + .5); }
+    } else {
+        /* libvpx: population variance over the window, constants scaled by 64*64 */
+        switch (bd) {
+        case D008: c1 = 26634.0;   c2 = 239708.0;   break;
+        case D010: c1 = 428658.0;  c2 = 3857925.0;  break;
+        case D012: c1 = 6868593.0; c2 = 61817334.0; break;
+        default:   c1 = floor(.01 * .01 * max_e * max_e * 4096 + .5); c2 = floor(.03 * .03 * max_e * max_e * 4096 + .5); break;
+        }
+    }
+
+    for (int32_t y = 0; y < brows; y++) {
+        const uint8_t* src1 = pSrc1 + (y << 2) * src1Step;
+        const uint8_t* src2 = pSrc2 + (y << 2) * src2Step;
+
+        std::swap(sum0, sum1);
+        if (D008 == bd) mclSSIM4x4Sums_8u(src1, src1Step, src2, src2Step, blocks, sum1);
+        else            mclSSIM4x4Sums_16u((const uint16_t*)src1, src1Step, (const uint16_t*)src2, src2Step, blocks, sum1);
+        if (!y) continue;
+
+        for (int32_t x = 0; x < blocks - 1; x++) {
+            const int64_t *a = sum0 + (x << 2), *b = sum1 + (x << 2);
+            double s1  = (double)(a[0] + a[4] + b[0] + b[4]);
+            double s2  = (double)(a[1] + a[5] + b[1] + b[5]);
+            double ss  = (double)(a[2] + a[6] + b[2] + b[6]);
+            double s12 = (double)(a[3] + a[7] + b[3] + b[7]);
+
+            if (unbiased) {
+                double vars  = ss * 64 - s1 * s1 - s2 * s2;
+                double covar = s12 * 64 - s1 * s2;
+                total += (2 * s1 * s2 + c1) * (2 * covar + c2) / ((s1 * s1 + s2 * s2 + c1) * (vars + c2));
+            } else {
+                total += (2 * s1 * s2 + c1) * (2 * 64 * s12 - 2 * s1 * s2 + c2) / ((s1 * s1 + s2 * s2 + c1) * (64 * ss - s1 * s1 - s2 * s2 + c2));
+            }
+        }
+    }
+
+    value = total / (double)((blocks - 1) * (brows - 1));
 
     return MCL_ERR_NONE;
-#elif defined(LEGACY_IPP)
-    return stsIPPtoMCL(ippiFilterColumn_32f_C1R(pSrc, srcStep, pDst, dstStep, dstRoiSize, pKernel, kernelSize, xAnchor));
-#else
+}
+
+EErrorStatus mclSSIMFast_C1R(const uint8_t* pSrc1, int32_t src1Step, const uint8_t* pSrc2, int32_t src2Step, ImageSize roiSize, double& value, uint8_t* pBuffer, EBitDepth bd)
+{
+    return mclSSIM8x8_C1R(pSrc1, src1Step, pSrc2, src2Step, roiSize, value, pBuffer, bd, true);
+}
+
+EErrorStatus mclSSIMBox_C1R(const uint8_t* pSrc1, int32_t src1Step, const uint8_t* pSrc2, int32_t src2Step, ImageSize roiSize, double& value, uint8_t* pBuffer, EBitDepth bd)
+{
+    return mclSSIM8x8_C1R(pSrc1, src1Step, pSrc2, src2Step, roiSize, value, pBuffer, bd, false);
+}
+
+/* Half precision storage */
+static inline uint16_t mcl_f32_to_f16(float f)
+{
+    uint32_t x, sign, man, half, rem;
+    int32_t  exp;
+
+    memcpy(&x, &f, sizeof(x));
+    sign = (x >> 16) & 0x8000;
+    exp  = (int32_t)((x >> 23) & 0xff) - 127 + 15;
+    man  = x & 0x7fffff;
+
+    if (((x >> 23) & 0xff) == 0xff) return (uint16_t)(sign | 0x7c00 | (man ? 0x200 : 0)); // Inf/NaN
+    if (exp >= 31) return (uint16_t)(sign | 0x7c00); // Overflow
+    if (exp <= 0) {
+        if (exp < -10) return (uint16_t)sign; // Underflow
+        uint32_t shift = (uint32_t)(14 - exp), mid = 1u << (shift - 1);
+        man |= 0x800000;
+        half = man >> shift; rem = man & ((1u << shift) - 1);
+        if (rem > mid || (rem == mid && (half & 1))) half++;
+        return (uint16_t)(sign | half);
+    }
+
+    half = sign | ((uint32_t)exp << 10) | (man >> 13);
+    rem  = man & 0x1fff;
+    if (rem > 0x1000 || (rem == 0x1000 && (half & 1))) half++; // Carry into exponent is fine
+    return (uint16_t)half;
+}
+
+static inline float mcl_f16_to_f32(uint16_t h)
+{
+    uint32_t sign = (uint32_t)(h & 0x8000) << 16, exp = (h >> 10) & 0x1f, man = h & 0x3ff, x;
+    float    f;
+
+    if (exp == 0) {
+        if (!man) {
+            x = sign;
+        } else { // Subnormal
+            exp = 127 - 15 + 1;
+            while (!(man & 0x400)) { man <<= 1; exp--; }
+            x = sign | (exp << 23) | ((man & 0x3ff) << 13);
+        }
+    }
+    else if (exp == 31) x = sign | 0x7f800000 | (man << 13);
+    else                x = sign | ((exp + 127 - 15) << 23) | (man << 13);
+
+    memcpy(&f, &x, sizeof(f));
+    return f;
+}
+
+static inline uint16_t mcl_f32_to_bf16(float f)
+{
+    uint32_t x;
+
+    memcpy(&x, &f, sizeof(x));
+    if ((x & 0x7fffffff) > 0x7f800000) return (uint16_t)((x >> 16) | 0x40); // Quiet NaN
+    if (!(x & 0x7f800000)) return (uint16_t)((x >> 16) & 0x8000); // Denormals flush to zero like VCVTNEPS2BF16
+    x += 0x7fff + ((x >> 16) & 1); // Round to nearest even
+    return (uint16_t)(x >> 16);
+}
+
+static inline float mcl_bf16_to_f32(uint16_t h)
+{
+    uint32_t x = (uint32_t)h << 16;
+    float    f;
+
+    memcpy(&f, &x, sizeof(f));
+    return f;
+}
+
+#if defined(MCL_DISPATCH)
+// Vector parts of the half conversions, return the number of elements done
+MCL_TARGET("avx2,f16c") static int32_t mcl_f16c_32f16f(const float* pSrc, uint16_t* pDst, int32_t len)
+{
+    int32_t i = 0;
+    for (; i + 8 <= len; i += 8)
+        _mm_storeu_si128((__m128i*)(pDst + i), _mm256_cvtps_ph(_mm256_loadu_ps(pSrc + i), _MM_FROUND_TO_NEAREST_INT));
+    return i;
+}
+
+MCL_TARGET("avx2,f16c") static int32_t mcl_f16c_16f32f(const uint16_t* pSrc, float* pDst, int32_t len)
+{
+    int32_t i = 0;
+    for (; i + 8 <= len; i += 8)
+        _mm256_storeu_ps(pDst + i, _mm256_cvtph_ps(_mm_loadu_si128((const __m128i*)(pSrc + i))));
+    return i;
+}
+
+MCL_TARGET("avx2") static int32_t mcl_avx2_bf1632f(const uint16_t* pSrc, float* pDst, int32_t len)
+{
+    int32_t i = 0;
+    for (; i + 8 <= len; i += 8)
+        _mm256_storeu_ps(pDst + i, _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)(pSrc + i))), 16)));
+    return i;
+}
+
+#if defined(MCL_AVX512BF16)
+MCL_TARGET("avx2,avx512f,avx512vl,avx512bf16") static int32_t mcl_avx512bf16_32fbf16(const float* pSrc, uint16_t* pDst, int32_t len)
+{
+    int32_t i = 0;
+    for (; i + 8 <= len; i += 8)
+        _mm_storeu_si128((__m128i*)(pDst + i), (__m128i)_mm256_cvtneps_pbh(_mm256_loadu_ps(pSrc + i)));
+    return i;
+}
+#endif
+#endif
+
+EErrorStatus mclConvert_32f16f(const float* pSrc, uint16_t* pDst, int32_t len, EFloatFormat ff)
+{
+    int32_t i = 0;
+
+    if (!pSrc || !pDst) return MCL_ERR_NULL_PTR;
+
+    if (ff == FP16) {
+#if defined(MCL_DISPATCH)
+        if (mcl_cpu_level >= CPU_AVX2) i = mcl_f16c_32f16f(pSrc, pDst, len);
+#endif
+        for (; i < len; i++) pDst[i] = mcl_f32_to_f16(pSrc[i]);
+    }
+    else if (ff == BF16) {
+#if defined(MCL_DISPATCH) && defined(MCL_AVX512BF16)
+        if (mcl_cpu_level >= CPU_AVX512 && mcl_cpu_bf16) i = mcl_avx512bf16_32fbf16(pSrc, pDst, len);
+#endif
+        for (; i < len; i++) pDst[i] = mcl_f32_to_bf16(pSrc[i]);
+    }
+    else return MCL_ERR_INVALID_PARAM;
+
     return MCL_ERR_NONE;
+}
+
+EErrorStatus mclConvert_16f32f(const uint16_t* pSrc, float* pDst, int32_t len, EFloatFormat ff)
+{
+    int32_t i = 0;
+
+    if (!pSrc || !pDst) return MCL_ERR_NULL_PTR;
+
+    if (ff == FP16) {
+#if defined(MCL_DISPATCH)
+        if (mcl_cpu_level >= CPU_AVX2) i = mcl_f16c_16f32f(pSrc, pDst, len);
+#endif
+        for (; i < len; i++) pDst[i] = mcl_f16_to_f32(pSrc[i]);
+    }
+    else if (ff == BF16) {
+#if defined(MCL_DISPATCH)
+        if (mcl_cpu_level >= CPU_AVX2) i = mcl_avx2_bf1632f(pSrc, pDst, len);
 #endif
+        for (; i < len; i++) pDst[i] = mcl_bf16_to_f32(pSrc[i]);
+    }
+    else return MCL_ERR_INVALID_PARAM;
+
+    return MCL_ERR_NONE;
+}
+
+EErrorStatus mclConvert__u16f_C1R(const uint8_t* pSrc, int32_t srcStep, uint16_t* pDst, int32_t dstStep, ImageSize roiSize, EBitDepth bd, EFloatFormat ff)
+{
+    const int32_t chunk = 256;
+    float         line[chunk];
+
+    if (!pSrc || !pDst)                          return MCL_ERR_NULL_PTR;
+    if (roiSize.width < 1 || roiSize.height < 1) return MCL_ERR_INVALID_PARAM;
+
+    for (int32_t h = 0; h < roiSize.height; h++) {
+        const uint8_t *src = pSrc + h * srcStep;
+        uint16_t      *dst = (uint16_t*)((uint8_t*)pDst + h * dstStep);
+
+        for (int32_t x = 0; x < roiSize.width; x += chunk) {
+            int32_t n = std::min(chunk, roiSize.width - x);
+
+            if (bd == D008) for (int32_t w = 0; w < n; w++) line[w] = (float)src[x + w];
+            else            for (int32_t w = 0; w < n; w++) line[w] = (float)((const uint16_t*)src)[x + w];
+            mclConvert_32f16f(line, dst + x, n, ff);
+        }
+    }
+
+    return MCL_ERR_NONE;
+}
+
+EErrorStatus mclDownsample2x_16f_C1R(const uint16_t* pSrc, int32_t srcStep, uint16_t* pDst, int32_t dstStep, ImageSize dstRoiSize, EFloatFormat ff)
+{
+    const int32_t chunk = 128;
+    float         r0[2 * chunk], r1[2 * chunk], out[chunk];
+
+    if (!pSrc || !pDst)                                return MCL_ERR_NULL_PTR;
+    if (dstRoiSize.width < 1 || dstRoiSize.height < 1) return MCL_ERR_INVALID_PARAM;
+
+    for (int32_t h = 0; h < dstRoiSize.height; h++) {
+        const uint16_t *src0 = (const uint16_t*)((const uint8_t*)pSrc + (2 * h) * srcStep);
+        const uint16_t *src1 = (const uint16_t*)((const uint8_t*)pSrc + (2 * h + 1) * srcStep);
+        uint16_t       *dst  = (uint16_t*)((uint8_t*)pDst + h * dstStep);
+
+        for (int32_t x = 0; x < dstRoiSize.width; x += chunk) {
+            int32_t n = std::min(chunk, dstRoiSize.width - x);
+
+            mclConvert_16f32f(src0 + 2 * x, r0, 2 * n, ff);
+            mclConvert_16f32f(src1 + 2 * x, r1, 2 * n, ff);
+            for (int32_t w = 0; w < n; w++) out[w] = (r0[2 * w] + r0[2 * w + 1] + r1[2 * w] + r1[2 * w + 1]) * 0.25f;
+            mclConvert_32f16f(out, dst + x, n, ff);
+        }
+    }
+
+    return MCL_ERR_NONE;
+}
+
+/* Resize: rows of a band are filtered horizontally into float rows, the band's output rows are weighted sums of
+   those rows. Taps at the plane borders fold onto the edge samples */
+static const int32_t mcl_resize_band = 16; // Output rows of one band
+
+static double mcl_resize_weight(EResizeFilter filter, double x)
+{
+    x = fabs(x);
+    switch (filter) {
+    case RS_BILINEAR:
+        return (x < 1.0) ? 1.0 - x : 0.0;
+    case RS_BICUBIC: // Catmull-Rom
+        if (x < 1.0) return (1.5 * x - 2.5) * x * x + 1.0;
+        if (x < 2.0) return ((-0.5 * x + 2.5) * x - 4.0) * x + 2.0;
+        return 0.0;
+    default:         // Lanczos3
+        if (x < 1e-9) return 1.0;
+        if (x < 3.0)  return 3.0 * sin(mcl_pi * x) * sin(mcl_pi * x / 3.0) / (mcl_pi * mcl_pi * x * x);
+        return 0.0;
+    }
+}
+
+static void mcl_resize_axis(int32_t src, int32_t dst, EResizeFilter filter, int32_t &taps, std::vector< int32_t > &first, std::vector< float > &weights)
+{
+    double support = (filter == RS_BILINEAR) ? 1.0 : (filter == RS_BICUBIC) ? 2.0 : 3.0;
+    double scale   = (std::max)((double)src / dst, 1.0); // Downscaling widens the filter
+
+    taps = (std::min)((int32_t)ceil(support * scale) * 2, src);
+    first.resize(dst); weights.assign((size_t)dst * taps, 0.0f);
+
+    for (int32_t d = 0; d < dst; d++) {
+        double  center = (d + 0.5) * src / dst - 0.5, sum = 0.0;
+        int32_t start  = (int32_t)floor(center) - (int32_t)ceil(support * scale) + 1, k;
+        std::vector< double > w(taps, 0.0);
+
+        first[d] = (std::max)((std::min)(start, src - taps), 0);
+        for (k = 0; k < (int32_t)ceil(support * scale) * 2; k++) {
+            int32_t s = (std::max)((std::min)(start + k, src - 1), 0);
+            double  v = mcl_resize_weight(filter, (start + k - center) / scale);
+
+            w[s - first[d]] += v; sum += v;
+        }
+        for (k = 0; k < taps; k++) weights[(size_t)d * taps + k] = (float)(w[k] / sum);
+    }
+}
+
+EErrorStatus mclResizeInit(ImageSize srcSize, ImageSize dstSize, EResizeFilter filter, SResizeSpec &spec)
+{
+    if (srcSize.width < 1 || srcSize.height < 1 || dstSize.width < 1 || dstSize.height < 1) return MCL_ERR_INVALID_PARAM;
+
+    spec.srcSize = srcSize; spec.dstSize = dstSize;
+    mcl_resize_axis(srcSize.width, dstSize.width, filter, spec.xTaps, spec.xFirst, spec.xWeights);
+    mcl_resize_axis(srcSize.height, dstSize.height, filter, spec.yTaps, spec.yFirst, spec.yWeights);
+
+    spec.bandRows = 0;
+    for (int32_t y = 0; y < dstSize.height; y += mcl_resize_band) {
+        int32_t last = (std::min)(y + mcl_resize_band, dstSize.height) - 1;
+        spec.bandRows = (std::max)(spec.bandRows, spec.yFirst[last] - spec.yFirst[y] + spec.yTaps);
+    }
+    return MCL_ERR_NONE;
+}
+
+EErrorStatus mclResizeGetBufferSize(const SResizeSpec &spec, int32_t* pBufferSize)
+{
+    if (!pBufferSize) return MCL_ERR_NULL_PTR;
+
+    *pBufferSize = mclGetNumThreads() * (spec.bandRows + 1) * spec.dstSize.width * (int32_t)sizeof(float);
+
+    return MCL_ERR_NONE;
+}
+
+// Output w is the sum of src[w + i * rowStep] weighted by pWeights[i]
+static void mcl_c_sumRows(const float* src, int32_t rowStep, float* dst, int32_t n, const float* pWeights, int32_t taps)
+{
+    for (int32_t w = 0; w < n; w++) {
+        float value = 0.0f;
+        for (int32_t i = 0; i < taps; i++) value += pWeights[i] * src[w + i * rowStep];
+        dst[w] = value;
+    }
+}
+
+#if defined(MCL_DISPATCH)
+MCL_TARGET("sse4.2") static void mcl_sse42_sumRows(const float* src, int32_t rowStep, float* dst, int32_t n, const float* pWeights, int32_t taps)
+{
+    int32_t w = 0;
+
+    for (; w + 4 <= n; w += 4) {
+        __m128 acc = _mm_setzero_ps();
+        for (int32_t i = 0; i < taps; i++) acc = _mm_add_ps(acc, _mm_mul_ps(_mm_set1_ps(pWeights[i]), _mm_loadu_ps(src + w + i * rowStep)));
+        _mm_storeu_ps(dst + w, acc);
+    }
+    mcl_c_sumRows(src + w, rowStep, dst + w, n - w, pWeights, taps);
+}
+
+MCL_TARGET("avx2") static void mcl_avx2_sumRows(const float* src, int32_t rowStep, float* dst, int32_t n, const float* pWeights, int32_t taps)
+{
+    int32_t w = 0;
+
+    for (; w + 8 <= n; w += 8) {
+        __m256 acc = _mm256_setzero_ps();
+        for (int32_t i = 0; i < taps; i++) acc = _mm256_add_ps(acc, _mm256_mul_ps(_mm256_set1_ps(pWeights[i]), _mm256_loadu_ps(src + w + i * rowStep)));
+        _mm256_storeu_ps(dst + w, acc);
+    }
+    mcl_c_sumRows(src + w, rowStep, dst + w, n - w, pWeights, taps);
+}
+
+MCL_TARGET("avx512f,avx512bw,avx512vl") static void mcl_avx512_sumRows(const float* src, int32_t rowStep, float* dst, int32_t n, const float* pWeights, int32_t taps)
+{
+    int32_t w = 0;
+
+    for (; w + 16 <= n; w += 16) {
+        __m512 acc = _mm512_setzero_ps();
+        for (int32_t i = 0; i < taps; i++) acc = _mm512_add_ps(acc, _mm512_mul_ps(_mm512_set1_ps(pWeights[i]), _mm512_loadu_ps(src + w + i * rowStep)));
+        _mm512_storeu_ps(dst + w, acc);
+    }
+    mcl_c_sumRows(src + w, rowStep, dst + w, n - w, pWeights, taps);
+}
+#endif
+
+template< typename T >
+static void mcl_Resize_C1R(const uint8_t* pSrc, int32_t srcStep, uint8_t* pDst, int32_t dstStep, const SResizeSpec &spec, float* pBuffer, float maxValue,
+                           void (*sumRows)(const float*, int32_t, float*, int32_t, const float*, int32_t))
+{
+    const int32_t dw = spec.dstSize.width, bands = (spec.dstSize.height + mcl_resize_band - 1) / mcl_resize_band;
+    int32_t       b;
+
+#if defined(_OPENMP)
+    #pragma omp parallel for schedule(dynamic,1) num_threads(mclGetNumThreads())
+#endif
+    for (b = 0; b < bands; b++) {
+#if defined(_OPENMP)
+        float  *rows = pBuffer + (size_t)omp_get_thread_num() * (spec.bandRows + 1) * dw;
+#else
+        float  *rows = pBuffer;
+#endif
+        float  *out = rows + (size_t)spec.bandRows * dw;
+        int32_t y0 = b * mcl_resize_band, y1 = (std::min)(y0 + mcl_resize_band, spec.dstSize.height);
+        int32_t r0 = spec.yFirst[y0], r1 = spec.yFirst[y1 - 1] + spec.yTaps, r, x, y, k;
+
+        for (r = r0; r < r1; r++) {
+            const T *src = (const T*)(pSrc + (size_t)r * srcStep);
+            float   *row = rows + (size_t)(r - r0) * dw;
+
+            for (x = 0; x < dw; x++) {
+                const T     *s = src + spec.xFirst[x];
+                const float *w = &spec.xWeights[(size_t)x * spec.xTaps];
+                float        v = 0.0f;
+
+                for (k = 0; k < spec.xTaps; k++) v += w[k] * (float)s[k];
+                row[x] = v;
+            }
+        }
+        for (y = y0; y < y1; y++) {
+            T *dst = (T*)(pDst + (size_t)y * dstStep);
+
+            sumRows(rows + (size_t)(spec.yFirst[y] - r0) * dw, dw, out, dw, &spec.yWeights[(size_t)y * spec.yTaps], spec.yTaps);
+            for (x = 0; x < dw; x++) dst[x] = (T)(std::min)((std::max)(out[x] + 0.5f, 0.0f), maxValue);
+        }
+    }
+}
+
+EErrorStatus mclResize_C1R(const uint8_t* pSrc, int32_t srcStep, uint8_t* pDst, int32_t dstStep, const SResizeSpec &spec, uint8_t* pBuffer, EBitDepth bd)
+{
+    void (*sumRows)(const float*, int32_t, float*, int32_t, const float*, int32_t) = mcl_c_sumRows;
+
+    if (!pSrc || !pDst || !pBuffer)                                       return MCL_ERR_NULL_PTR;
+    if ((int32_t)spec.yFirst.size() != spec.dstSize.height || !spec.bandRows) return MCL_ERR_INVALID_PARAM;
+
+#if defined(MCL_DISPATCH)
+    switch (mcl_cpu_level) {
+    case CPU_AVX512: sumRows = mcl_avx512_sumRows; break;
+    case CPU_AVX2:   sumRows = mcl_avx2_sumRows;   break;
+    case CPU_SSE42:  sumRows = mcl_sse42_sumRows;  break;
+    default:         break;
+    }
+#endif
+
+    switch (bd) {
+    case D008: mcl_Resize_C1R< uint8_t  >(pSrc, srcStep, pDst, dstStep, spec, (float*)pBuffer, 255.0f, sumRows);   break;
+    case D010: mcl_Resize_C1R< uint16_t >(pSrc, srcStep, pDst, dstStep, spec, (float*)pBuffer, 1023.0f, sumRows);  break;
+    case D012: mcl_Resize_C1R< uint16_t >(pSrc, srcStep, pDst, dstStep, spec, (float*)pBuffer, 4095.0f, sumRows);  break;
+    default:   mcl_Resize_C1R< uint16_t >(pSrc, srcStep, pDst, dstStep, spec, (float*)pBuffer, 65535.0f, sumRows); break;
+    }
+
+    return MCL_ERR_NONE;
 }